@@ -11,44 +11,129 @@
 #include "configBits.h"
 #include "constants.h"
 
-void I2C_Master_Init(const unsigned long c)
+#if I2C_SSPADD < 1 || I2C_SSPADD > 255
+#error "I2C_HZ can't be generated from _XTAL_FREQ"
+#endif
+
+unsigned char i2c_err;
+unsigned int i2c_timeouts, i2c_nacks, i2c_collisions, i2c_recoveries;
+
+void I2C_Master_Init(void)
 {
   // See Datasheet pg171, I2C mode configuration
   SSPSTAT = 0b00000000;
   SSPCON1 = 0b00101000;
   SSPCON2 = 0b00000000;
-  SSPADD = (_XTAL_FREQ/(4*c))-1;
+  SSPADD = I2C_SSPADD;
   TRISC3 = 1;        //Setting as input as given in datasheet
   TRISC4 = 1;        //Setting as input as given in datasheet
 }
 
-void I2C_Master_Wait()
+unsigned char I2C_Master_Wait()
 {
-  while ((SSPSTAT & 0x04) || (SSPCON2 & 0x1F));
+  unsigned int n = I2C_WAIT_TRIES;
+
+  if (i2c_err & I2C_ERR_BUS) return i2c_err & I2C_ERR_BUS;
+  while ((SSPSTAT & 0x04) || (SSPCON2 & 0x1F)){
+    if (--n == 0){
+      i2c_err |= I2C_ERR_TIMEOUT;
+      i2c_timeouts++;
+      return I2C_ERR_TIMEOUT;
+    }
+  }
+  return 0;
 }
 
 void I2C_Master_Start()
 {
-  I2C_Master_Wait();
+  if (I2C_Master_Wait()) return;
   SEN = 1;
 }
 
 void I2C_Master_RepeatedStart()
 {
-  I2C_Master_Wait();
+  if (I2C_Master_Wait()) return;
   RSEN = 1;
 }
 
 void I2C_Master_Stop()
 {
-  I2C_Master_Wait();
+  //A collision drops the MSSP back to idle partway through, it is looked
+  //for once at the end of the transaction rather than on every wait
+  if (I2C_Master_Wait()) return;
+  if (PIR2bits.BCLIF){
+    PIR2bits.BCLIF = 0;
+    i2c_err |= I2C_ERR_BUSCOL;
+    i2c_collisions++;
+    return;
+  }
   PEN = 1;
 }
 
-void I2C_Master_Write(unsigned d)
+static unsigned char i2c_send(unsigned d)
 {
-  I2C_Master_Wait();
+  //Byte out, then its ACK
+  unsigned char err = I2C_Master_Wait();
+
+  if (err) return err;
   SSPBUF = d;
+  if (SSPCON1bits.WCOL){
+    SSPCON1bits.WCOL = 0;
+    i2c_err |= I2C_ERR_WCOL;
+    i2c_collisions++;
+    return I2C_ERR_WCOL;
+  }
+  err = I2C_Master_Wait();
+  if (err) return err;
+  return ACKSTAT ? I2C_ERR_NACK : 0;
+}
+
+unsigned char I2C_Master_Write(unsigned d)
+{
+  unsigned char err = i2c_send(d);
+
+  if (err == I2C_ERR_NACK){
+    i2c_err |= I2C_ERR_NACK;
+    i2c_nacks++;
+  }
+  return err;
+}
+
+unsigned char I2C_Master_Probe(unsigned char a)
+{
+  //For devices that may be missing or busy, the caller sends the STOP
+  I2C_Master_Start();
+  return i2c_send(a) == 0;
+}
+
+void I2C_Recover(void)
+{
+  //Nine clocks free a device left driving SDA halfway through a byte and
+  //a STOP puts every device back to idle. Open drain by hand with the
+  //MSSP off: TRIS = 0 pulls the line low (LAT = 0), TRIS = 1 lets the
+  //pull-up take it high
+  unsigned char n;
+
+  SSPCON1bits.SSPEN = 0;
+  LATCbits.LATC3 = 0;
+  LATCbits.LATC4 = 0;
+  for (n = 0; n < 9; n++){
+    TRISC3 = 0;
+    __delay_us(I2C_HALF_US);
+    TRISC3 = 1;
+    __delay_us(I2C_HALF_US);
+  }
+  TRISC3 = 0;                       //STOP: SDA rises while SCL is high
+  TRISC4 = 0;
+  __delay_us(I2C_HALF_US);
+  TRISC3 = 1;
+  __delay_us(I2C_HALF_US);
+  TRISC4 = 1;
+  __delay_us(I2C_HALF_US);
+  PIR2bits.BCLIF = 0;
+  I2C_Master_Init();
+  i2c_err = 0;
+  i2c_recoveries++;
 }
 
 void I2C_ColorSens_Init(void){
@@ -95,11 +180,11 @@ void I2C_ColorSens_ClearInt(void){
 unsigned char I2C_Master_Read(unsigned char a)
 {
   unsigned char temp;
-  I2C_Master_Wait();
+  if (I2C_Master_Wait()) return 0;
   RCEN = 1;
-  I2C_Master_Wait();
+  if (I2C_Master_Wait()) return 0;
   temp = SSPBUF;
-  I2C_Master_Wait();
+  if (I2C_Master_Wait()) return 0;
   ACKDT = (a)?0:1;
   ACKEN = 1;
   return temp;
@@ -1,5 +1,42 @@
-void I2C_Master_Init(const unsigned long c);
-//void I2C_ColorSens_Init(void);
-void I2C_Master_Write(unsigned d);
+//Bus clock. 10 kHz is out of the baud generator's reach at 40 MHz, the
+//PLL profile runs the bus at the DS1307's 100 kHz
+#ifdef CLK_HSPLL
+#define I2C_HZ          100000UL
+#else
+#define I2C_HZ          10000UL
+#endif
+#define I2C_SSPADD      ((_XTAL_FREQ / 4 + I2C_HZ / 2) / I2C_HZ - 1)
+
+//I2C_Master_Wait() gives up after two bytes' worth of bit times, polling
+//at most every I2C_POLL_CYCLES instruction cycles, so a device holding
+//SCL can't hang the caller
+#define I2C_POLL_CYCLES 4
+#define I2C_WAIT_TRIES  ((unsigned int)(18UL * (_XTAL_FREQ / 4) / I2C_HZ / I2C_POLL_CYCLES))
+#define I2C_HALF_US     (500000UL / I2C_HZ)     //Half a bit, I2C_Recover() clocks
+
+//i2c_err collects what went wrong since the last I2C_Recover(). After a
+//timeout or a bus collision the MSSP is in no state to go on, and every
+//call leaves the bus alone until then: reads give 0 and a transaction
+//that failed halfway ends there. After a NACK or WCOL it carries on so
+//the STOP still goes out. The main loop recovers the bus after a timeout
+//or collision; a NACK or WCOL is only cleared, and the next pass retries
+#define I2C_ERR_NACK    0x01    //Byte not acknowledged (ACKSTAT)
+#define I2C_ERR_WCOL    0x02    //SSPBUF written while busy (WCOL)
+#define I2C_ERR_TIMEOUT 0x04    //Still busy after I2C_WAIT_TRIES polls
+#define I2C_ERR_BUSCOL  0x08    //Bus collision (BCLIF)
+#define I2C_ERR_BUS     (I2C_ERR_TIMEOUT | I2C_ERR_BUSCOL)
+
+extern unsigned char i2c_err;
+extern unsigned int i2c_timeouts, i2c_nacks, i2c_collisions, i2c_recoveries;   //Since power up, wrap
+
+void I2C_Master_Init(void);
+unsigned char I2C_Master_Wait(void);            //0, or I2C_ERR_BUS bits
+void I2C_Master_Start(void);
+void I2C_Master_RepeatedStart(void);
+void I2C_Master_Stop(void);
+void I2C_Recover(void);                         //9 SCL clocks, STOP, MSSP set up again
+void I2C_ColorSens_Init(void);
+unsigned char I2C_Master_Write(unsigned d);     //0 = acknowledged
+unsigned char I2C_Master_Probe(unsigned char a);    //Start and address, 1 = acknowledged, a NACK is no error
 unsigned char I2C_Master_Read(unsigned char a);
 void delay_10ms(unsigned char n);
\ No newline at end of file
@@ -0,0 +1,66 @@
+/*
+ * File:   ambient.c
+ * Author: Administrator
+ *
+ * Spike filter and ambient baseline, see ambient.h.
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include "param.h"
+#include "ambient.h"
+
+persistent amb_t amb[2];
+
+static uint16_t amb_median(uint16_t a, uint16_t b, uint16_t c){
+    uint16_t t;
+    if(a > b){
+        t = a;
+        a = b;
+        b = t;
+    }
+    if(c >= b) return b;
+    return c > a ? c : a;
+}
+
+void amb_start(void){
+    uint8_t s;
+
+    for(s=0;s<2;s++){
+        amb[s].fill = 0;
+        amb[s].settled = 0;
+        amb[s].above = param[P_AMBIENTCLEAR];
+    }
+}
+
+void amb_filter(amb_t *a, unsigned int *c){
+    //The first samples of a run stand in for the ones before them
+    uint8_t n;
+    uint16_t x;
+
+    for(n=0;n<4;n++){
+        x = c[n];
+        if(!a->fill){
+            a->prev[0][n] = x;
+            a->prev[1][n] = x;
+        }
+        c[n] = amb_median(a->prev[0][n], a->prev[1][n], x);
+        a->prev[0][n] = a->prev[1][n];
+        a->prev[1][n] = x;
+    }
+    a->fill = 1;
+}
+
+void amb_track(amb_t *a, const unsigned int *c){
+    uint8_t n;
+    uint16_t x, above;
+
+    for(n=0;n<4;n++){
+        x = c[n] > AMB_MAX ? AMB_MAX : c[n];
+        if(!a->settled) a->acc[n] = x << AMB_SHIFT;
+        else a->acc[n] += x - (a->acc[n] >> AMB_SHIFT);
+    }
+    a->settled = 1;
+    above = (a->acc[0] >> AMB_SHIFT) + param[P_AMBIENTMARGIN];
+    a->above = above < param[P_BOTTLEHIGH] ? above : param[P_BOTTLEHIGH] - 1;
+}
@@ -0,0 +1,47 @@
+/*
+ * File:   ambient.h
+ * Author: Administrator
+ *
+ * Ambient light tracking for the colour sensors. Raw samples go through
+ * a median of 3 first, so a single integration spike (a reflection, a
+ * flicker) never reaches the detection. Samples taken with no bottle in
+ * front then feed an exponential average of the clear, red, green and
+ * blue levels, and a bottle is present when the clear count rises more
+ * than ambient_margin above it. The threshold follows slow lighting
+ * drift without recalibrating ambient_clear by hand.
+ *
+ * The average is kept as AMB_SCALE times the level in 16 bits, with
+ * acc += x - acc / AMB_SCALE per sample, which is a time constant of
+ * AMB_SCALE ambient samples (about 1.6 s of gaps between bottles, the
+ * sensor is polled every PM_GAPPOLLMS there). Inputs are clipped to
+ * AMB_MAX so the sum can't overflow. Both calls are a fixed four
+ * channel pass with no division.
+ *
+ * Until the first ambient sample of a run ambient_clear is the
+ * threshold, and it never goes to bottle_high or above.
+ */
+
+#ifndef AMBIENT_H
+#define	AMBIENT_H
+
+#include <stdint.h>
+
+#define AMB_SHIFT           4
+#define AMB_SCALE           (1 << AMB_SHIFT)
+#define AMB_MAX             (0xFFFF >> AMB_SHIFT)
+
+typedef struct {
+    uint16_t acc[4];                //AMB_SCALE x ambient clear, red, green, blue
+    uint16_t prev[2][4];            //Last two raw samples, for the median
+    uint8_t fill;                   //prev holds samples of this run
+    uint8_t settled;                //acc holds an ambient sample
+    uint16_t above;                 //Clear count that means a bottle
+} amb_t;
+
+extern persistent amb_t amb[2];     //Top (or only) and bottom sensor, by MUX_ channel
+
+void amb_start(void);               //New run, threshold back to ambient_clear
+void amb_filter(amb_t *a, unsigned int *c);         //Median of 3 in place
+void amb_track(amb_t *a, const unsigned int *c);    //c has no bottle in it
+
+#endif	/* AMBIENT_H */
@@ -0,0 +1,96 @@
+/*
+ * File:   clock.c
+ * Author: Administrator
+ *
+ * Epoch and millisecond counters, see clock.h.
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include "configBits.h"
+#include "timers.h"
+#include "keypad.h"
+#include "clock.h"
+
+#if !TMR2_PERIOD_EXACT(KP_TICK_MS * 1000UL, KP_TMR2_PRE, KP_TMR2_POST)
+#error "The TMR2 tick isn't a whole number of us at this _XTAL_FREQ, clk_tick_isr() would drift"
+#endif
+
+//Tens digit of a BCD byte, so a conversion is one lookup and an add
+static const uint8_t bcd_tens[16] = {0, 10, 20, 30, 40, 50, 60, 70, 80, 90,
+                                     100, 110, 120, 130, 140, 150};
+//Days before the first of each month in a common year
+static const uint16_t month_days[12] = {0, 31, 59, 90, 120, 151,
+                                        181, 212, 243, 273, 304, 334};
+
+//Persistent, so a run's times carry over a watchdog reset (watchdog.h)
+static persistent volatile uint32_t clk_ms;     //Since clk_init(), wraps after 49 days
+static persistent volatile uint32_t clk_sec;
+static persistent uint16_t clk_frac;            //ms into the current second
+static persistent uint16_t clk_us;              //us into the current ms
+
+uint8_t bcd_to_bin(uint8_t bcd){
+    return bcd_tens[bcd >> 4] + (bcd & 0x0F);
+}
+
+uint32_t rtc_to_epoch(const uint8_t *reg){
+    uint8_t year = bcd_to_bin(reg[6]);
+    uint8_t month = bcd_to_bin(reg[5] & 0x1F);
+    uint8_t day = bcd_to_bin(reg[4] & 0x3F);
+    uint16_t days;
+
+    if(month < 1 || month > 12) month = 1;      //Unset clock
+    if(day < 1) day = 1;
+    //2000 is a leap year and every fourth one after it up to 2099
+    days = 365U * year + ((year + 3) >> 2) + month_days[month - 1] + day - 1;
+    if((year & 3) == 0 && month > 2) days += 1;
+    return days * CLK_DAY
+         + bcd_to_bin(reg[2] & 0x3F) * 3600UL
+         + bcd_to_bin(reg[1] & 0x7F) * 60U
+         + bcd_to_bin(reg[0] & 0x7F);           //Bit 7 is clock halt
+}
+
+void clk_init(uint32_t epoch){
+    uint8_t ie = TMR2IE;
+
+    TMR2IE = 0;
+    clk_ms = 0;
+    clk_sec = epoch;
+    clk_frac = 0;
+    clk_us = 0;
+    TMR2IE = ie;
+}
+
+uint32_t clk_millis(void){
+    //Four byte read, retry if the tick landed in between
+    uint32_t t;
+    do{
+        t = clk_ms;
+    }while(t != clk_ms);
+    return t;
+}
+
+uint32_t clk_now(void){
+    uint32_t t;
+    do{
+        t = clk_sec;
+    }while(t != clk_sec);
+    return t;
+}
+
+void clk_tick_isr(void){
+    //Whole ms of the tick, and its us part carried until they make one
+    uint8_t ms = CLK_TICK_US / 1000;
+
+    clk_us += CLK_TICK_US % 1000;
+    if(clk_us >= 1000){
+        clk_us -= 1000;
+        ms += 1;
+    }
+    clk_ms += ms;
+    clk_frac += ms;
+    if(clk_frac >= 1000){
+        clk_frac -= 1000;
+        clk_sec += 1;
+    }
+}
@@ -0,0 +1,31 @@
+/*
+ * File:   clock.h
+ * Author: Administrator
+ *
+ * Integer time keeping. The DS1307 is read once at power up and turned
+ * into seconds since 2000-01-01 00:00:00; from then on the keypad TMR2
+ * tick advances a millisecond counter and the seconds with it. The tick
+ * is counted at the length PR2 gives it (CLK_TICK_US), not KP_TICK_MS,
+ * or the clock would gain 0.16% at 10 MHz with nothing to correct it. Run
+ * lengths are clk_millis() differences, so they don't care about the
+ * hour, day or year turning over, and nothing here touches floats.
+ */
+
+#ifndef CLOCK_H
+#define	CLOCK_H
+
+#include <stdint.h>
+
+#define CLK_YEAR0           2000    //DS1307 years are 00..99 from here
+#define CLK_DAY             86400UL
+//TMR2 tick after PR2 rounding, 9984 us at 10 MHz. Needs timers.h and keypad.h
+#define CLK_TICK_US         TMR2_PERIOD_US(KP_TICK_MS * 1000UL, KP_TMR2_PRE, KP_TMR2_POST)
+
+uint8_t bcd_to_bin(uint8_t bcd);
+uint32_t rtc_to_epoch(const uint8_t *reg);  //DS1307 registers 0..6, 24 hour mode
+void clk_init(uint32_t epoch);
+uint32_t clk_millis(void);
+uint32_t clk_now(void);                     //Seconds since CLK_YEAR0
+void clk_tick_isr(void);
+
+#endif	/* CLOCK_H */
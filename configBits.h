@@ -6,7 +6,15 @@
  */
 
 // CONFIG1H
+// Clock profile: the 10 MHz crystal as it is, or with CLK_HSPLL defined
+// for the build (xc8 -DCLK_HSPLL) the PLL's 4x, 40 MHz. Timer reloads,
+// delays and baud rates follow _XTAL_FREQ; the few settings that can't
+// hold across both test CLK_HSPLL themselves (I2C.h, keypad.h)
+#ifdef CLK_HSPLL
+#pragma config OSC = HSPLL      // Oscillator Selection bits (HS oscillator, PLL enabled (Clock Frequency = 4 x FOSC1))
+#else
 #pragma config OSC = HS         // Oscillator Selection bits (HS oscillator)
+#endif
 #pragma config FCMEN = OFF      // Fail-Safe Clock Monitor Enable bit (Fail-Safe Clock Monitor disabled)
 #pragma config IESO = OFF       // Internal/External Oscillator Switchover bit (Oscillator Switchover mode disabled)
 
@@ -16,8 +24,11 @@
 #pragma config BORV = 3         // Brown Out Reset Voltage bits (Minimum setting)
 
 // CONFIG2H
+// The WDT is started by wd_start() once start up is done, see watchdog.h.
+// WDT_PERIOD_MS is the nominal 4 ms x WDTPS, keep the two in step
 #pragma config WDT = OFF        // Watchdog Timer Enable bit (WDT disabled (control is placed on the SWDTEN bit))
-#pragma config WDTPS = 32768    // Watchdog Timer Postscale Select bits (1:32768)
+#pragma config WDTPS = 128      // Watchdog Timer Postscale Select bits (1:128)
+#define WDT_PERIOD_MS   512
 
 // CONFIG3H
 #pragma config CCP2MX = PORTC   // CCP2 MUX bit (CCP2 input/output is multiplexed with RC1)
@@ -66,4 +77,8 @@
 #include <xc.h>
 #include <string.h>
 
+#ifdef CLK_HSPLL
+#define _XTAL_FREQ 40000000      // Define osc freq for use in delay macros
+#else
 #define _XTAL_FREQ 10000000      // Define osc freq for use in delay macros 
+#endif
@@ -0,0 +1,139 @@
+/*
+ * File:   eeprom.c
+ * Author: Administrator
+ *
+ * Interrupt driven internal EEPROM writer. eeprom_writebyte() queues the
+ * byte and returns; each completed write raises EEIF and eeprom_isr()
+ * starts the next one. Reads check the queue first so they always see
+ * the most recently written value.
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include "configBits.h"
+#include "eeprom.h"
+
+#define EE_QUEUE_MASK   (EE_QUEUE_SIZE - 1)
+
+static uint16_t ee_addr[EE_QUEUE_SIZE];
+static uint8_t ee_data[EE_QUEUE_SIZE];
+static volatile uint8_t ee_head;        //Entry currently being written
+static volatile uint8_t ee_count;       //Entries queued, including the active one
+static volatile uint8_t ee_active;      //A hardware write is in progress
+
+static void ee_start(void){
+    uint8_t gie = GIE;
+
+    EEADRH = (uint8_t)(ee_addr[ee_head] >> 8);
+    EEADR = (uint8_t)ee_addr[ee_head];
+    EEDATA = ee_data[ee_head];
+    EECON1bits.EEPGD = 0;       // Select EEPROM data memory
+    EECON1bits.CFGS = 0;        // Access flash/EEPROM NOT config. registers
+    EECON1bits.WREN = 1;
+
+    GIE = 0;                    // Unlock sequence must not be interrupted
+    EECON2 = 0x55;
+    EECON2 = 0xAA;
+    EECON1bits.WR = 1;
+    GIE = gie;
+
+    ee_active = 1;
+}
+
+static void ee_poll(void){
+    //Used where the EEIF interrupt can't run (inside isr() or with EEIE off)
+    if(PIR2bits.EEIF) eeprom_isr();
+}
+
+void eeprom_init(void){
+    ee_head = 0;
+    ee_count = 0;
+    ee_active = 0;
+    PIR2bits.EEIF = 0;
+    PIE2bits.EEIE = 1;
+}
+
+void eeprom_isr(void){
+    PIR2bits.EEIF = 0;          // Must be cleared in software after each write
+    if(!ee_active) return;
+
+    ee_head = (ee_head + 1) & EE_QUEUE_MASK;
+    ee_count--;
+    if(ee_count) ee_start();
+    else{
+        EECON1bits.WREN = 0;    // Disable write until the next queued byte
+        ee_active = 0;
+    }
+}
+
+void eeprom_writebyte(uint16_t address, uint8_t data){
+    uint8_t slot;
+
+    PIE2bits.EEIE = 0;
+    while(ee_count == EE_QUEUE_SIZE) ee_poll();     //Full, wait for one slot
+
+    slot = (ee_head + ee_count) & EE_QUEUE_MASK;
+    ee_addr[slot] = address;
+    ee_data[slot] = data;
+    ee_count++;
+    if(!ee_active) ee_start();
+    PIE2bits.EEIE = 1;
+}
+
+uint8_t eeprom_readbyte(uint16_t address){
+    uint8_t n, slot, data;
+
+    PIE2bits.EEIE = 0;
+    for(n = ee_count; n; n--){                      //Newest queued value wins
+        slot = (ee_head + n - 1) & EE_QUEUE_MASK;
+        if(ee_addr[slot] == address){
+            data = ee_data[slot];
+            PIE2bits.EEIE = 1;
+            return data;
+        }
+    }
+
+    // EEADR is shared with the write in progress, at most one byte time
+    while(EECON1bits.WR);
+
+    EEADRH = (uint8_t)(address >> 8);
+    EEADR = (uint8_t)address;
+    EECON1bits.EEPGD = 0;       // Select EEPROM Data Memory
+    EECON1bits.CFGS = 0;        // Access flash/EEPROM NOT config. registers
+    EECON1bits.RD = 1;          // Start a read cycle
+    data = EEDATA;
+
+    ee_poll();                  // Restart the queue if the write just finished
+    PIE2bits.EEIE = 1;
+    return data;
+}
+
+void eeprom_write_record(uint16_t address, const uint8_t *data, uint8_t len){
+    uint8_t n;
+
+    eeprom_writebyte(address, EE_MARKER_OPEN);
+    for(n = 0; n < len; n++) eeprom_writebyte(address + 1 + n, data[n]);
+    eeprom_writebyte(address, EE_MARKER_VALID);     //Commit, queue is FIFO
+}
+
+uint8_t eeprom_read_record(uint16_t address, uint8_t *data, uint8_t len){
+    uint8_t n;
+
+    if(eeprom_readbyte(address) != EE_MARKER_VALID) return 0;
+    for(n = 0; n < len; n++) data[n] = eeprom_readbyte(address + 1 + n);
+    return 1;
+}
+
+void eeprom_invalidate_record(uint16_t address){
+    eeprom_writebyte(address, EE_MARKER_OPEN);
+}
+
+uint8_t eeprom_busy(void){
+    return ee_count != 0;
+}
+
+void eeprom_flush(void){
+    PIE2bits.EEIE = 0;
+    while(ee_count) ee_poll();
+    PIE2bits.EEIE = 1;
+}
@@ -0,0 +1,39 @@
+/*
+ * File:   eeprom.h
+ * Author: Administrator
+ *
+ * Queued internal EEPROM writer. Writes are started one at a time and
+ * advanced from the EEIF interrupt so callers never wait ~4ms per byte.
+ *
+ * The queue has one producer, the main loop: eeprom_writebyte(),
+ * eeprom_write_record() and eeprom_invalidate_record() must not be
+ * called from isr(). Their critical section only turns EEIE off, which
+ * keeps the EEIF drain out but not a second producer. The simulator
+ * stops a run that calls them from isr().
+ */
+
+#ifndef EEPROM_H
+#define	EEPROM_H
+
+#include <stdint.h>
+
+#define EE_QUEUE_SIZE       32      //Pending byte writes, must be a power of 2. A whole
+                                    //param or history save fits, so they never wait on it
+
+//Record layout: [marker][data 0]..[data len-1]
+//The marker is written OPEN before the data and VALID after it, so a
+//record interrupted by a power loss reads back as not committed.
+#define EE_MARKER_OPEN      0x00
+#define EE_MARKER_VALID     0xA5
+
+void eeprom_init(void);
+uint8_t eeprom_readbyte(uint16_t address);
+void eeprom_writebyte(uint16_t address, uint8_t data);
+void eeprom_write_record(uint16_t address, const uint8_t *data, uint8_t len);
+uint8_t eeprom_read_record(uint16_t address, uint8_t *data, uint8_t len);
+void eeprom_invalidate_record(uint16_t address);
+uint8_t eeprom_busy(void);
+void eeprom_flush(void);
+void eeprom_isr(void);
+
+#endif	/* EEPROM_H */
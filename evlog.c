@@ -0,0 +1,149 @@
+/*
+ * File:   evlog.c
+ * Author: Administrator
+ *
+ * Per-bottle event log. One page of records is kept in RAM and written to
+ * the external EEPROM in a single transaction once it fills, so the bus
+ * cost per bottle stays a small fraction of the colour sensor reads.
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include "configBits.h"
+#include "I2C.h"
+#include "eeprom.h"
+#include "evlog.h"
+
+//Persistent, a watchdog reset keeps the page and its place (watchdog.h)
+static persistent evlog_rec_t ev_page[EVLOG_RECS_PER_PAGE];    //Page being filled
+static persistent evlog_rec_t ev_cur;                           //Bottle in front of the sensor
+static persistent uint8_t ev_fill;      //Records in ev_page
+static persistent uint8_t ev_run;
+static persistent uint8_t ev_busy;      //A page write cycle may be in progress
+static persistent uint16_t ev_page_rec; //Index of the first record in ev_page
+static persistent uint16_t ev_stream;   //Next record for evlog_stream_next()
+
+static void ev_wait_ready(void){
+    //Acknowledge polling, the 24LC256 NACKs its address during a write cycle
+    uint8_t n, ack;
+
+    if(!ev_busy) return;
+    for(n=0;n<EVLOG_POLL_TRIES;n++){
+        ack = I2C_Master_Probe(EVLOG_ADDR_W);
+        I2C_Master_Stop();
+        if(ack) break;
+        __delay_ms(1);
+    }
+    ev_busy = 0;
+}
+
+static void ev_write_page(void){
+    uint8_t n, len = ev_fill * EVLOG_REC_SIZE;
+    uint8_t *p = (uint8_t *)ev_page;
+    uint16_t addr = ev_page_rec * EVLOG_REC_SIZE;
+
+    ev_wait_ready();
+    I2C_Master_Start();
+    I2C_Master_Write(EVLOG_ADDR_W);
+    I2C_Master_Write(addr >> 8);
+    I2C_Master_Write(addr & 0xFF);
+    for(n=0;n<len;n++) I2C_Master_Write(p[n]);
+    I2C_Master_Stop();
+    ev_busy = 1;
+}
+
+static void ev_read(uint16_t addr, uint8_t *p, uint8_t len){
+    uint8_t n;
+
+    ev_wait_ready();
+    I2C_Master_Start();
+    I2C_Master_Write(EVLOG_ADDR_W);
+    I2C_Master_Write(addr >> 8);
+    I2C_Master_Write(addr & 0xFF);
+    I2C_Master_RepeatedStart();
+    I2C_Master_Write(EVLOG_ADDR_R);
+    for(n=0;n<len-1;n++) p[n] = I2C_Master_Read(1);    //Sequential read
+    p[len-1] = I2C_Master_Read(0);                      //Final read, no ack
+    I2C_Master_Stop();
+}
+
+void evlog_init(void){
+    ev_run = eeprom_readbyte(EVLOG_RUNADDR);
+    ev_fill = 0;
+    ev_busy = 0;
+    ev_page_rec = 0;
+    ev_stream = 0;
+}
+
+void evlog_start_run(void){
+    ev_run += 1;
+    eeprom_writebyte(EVLOG_RUNADDR, ev_run);
+    ev_fill = 0;
+    ev_page_rec = 0;
+    ev_stream = 0;
+}
+
+void evlog_bottle_begin(uint32_t tick){
+    ev_cur.t_detect = tick;
+    ev_cur.dwell = 0;
+    ev_cur.peak[0] = 0;
+}
+
+void evlog_bottle_sample(const unsigned int *c){
+    ev_cur.dwell += 1;
+    if(c[0] > ev_cur.peak[0]){
+        ev_cur.peak[0] = c[0];
+        ev_cur.peak[1] = c[1];
+        ev_cur.peak[2] = c[2];
+        ev_cur.peak[3] = c[3];
+    }
+}
+
+void evlog_bottle_end(uint8_t cls){
+    //Runs with interrupts off, a full page waits for evlog_poll(). ev_cur
+    //is complete even when the log is full, TLM_BOTTLE sends it. A main
+    //loop pass decides one bottle at most, so the page is written by now
+    ev_cur.run = ev_run;
+    ev_cur.cls = cls;
+    if(ev_fill == EVLOG_RECS_PER_PAGE) return;             //Page not written yet
+    if(ev_page_rec + ev_fill >= EVLOG_MAX_RECS) return;    //Log full
+    ev_page[ev_fill] = ev_cur;
+    ev_fill += 1;
+}
+
+void evlog_poll(void){
+    if(ev_fill != EVLOG_RECS_PER_PAGE) return;
+    ev_write_page();
+    ev_page_rec += EVLOG_RECS_PER_PAGE;
+    ev_fill = 0;
+}
+
+void evlog_flush(void){
+    //Partial page, the records stay buffered and are rewritten with the page
+    if(ev_fill) ev_write_page();
+}
+
+const evlog_rec_t *evlog_last(void){
+    return &ev_cur;
+}
+
+uint16_t evlog_count(void){
+    return ev_page_rec + ev_fill;
+}
+
+void evlog_stream_begin(void){
+    ev_stream = 0;
+}
+
+uint8_t evlog_stream_next(evlog_rec_t *rec){
+    if(ev_stream >= EVLOG_MAX_RECS) return 0;
+    if(ev_stream >= ev_page_rec && ev_stream < ev_page_rec + ev_fill){
+        *rec = ev_page[ev_stream - ev_page_rec];
+    }
+    else{
+        ev_read(ev_stream * EVLOG_REC_SIZE, (uint8_t *)rec, EVLOG_REC_SIZE);
+        if(rec->run != ev_run) return 0;
+    }
+    ev_stream += 1;
+    return 1;
+}
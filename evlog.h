@@ -0,0 +1,56 @@
+/*
+ * File:   evlog.h
+ * Author: Administrator
+ *
+ * Per-bottle event log on an external 24LC256 I2C EEPROM. Records are
+ * collected in a one page RAM buffer and written with a single page write.
+ */
+
+#ifndef EVLOG_H
+#define	EVLOG_H
+
+#include <stdint.h>
+
+#define EVLOG_ADDR_W        0b10100000  //24LC256, A2..A0 = 0, + Write
+#define EVLOG_ADDR_R        0b10100001  //24LC256, A2..A0 = 0, + Read
+#define EVLOG_SIZE          32768       //Bytes
+#define EVLOG_PAGE_SIZE     64          //Bytes per page write
+#define EVLOG_REC_SIZE      16
+#define EVLOG_RECS_PER_PAGE (EVLOG_PAGE_SIZE / EVLOG_REC_SIZE)
+#define EVLOG_MAX_RECS      (EVLOG_SIZE / EVLOG_REC_SIZE)
+#define EVLOG_RUNADDR       62          //Internal EEPROM, current run id
+#define EVLOG_POLL_TRIES    10          //1ms acknowledge polls, write cycle is 5ms
+
+//Bus budget: one page write (control + 2 address + 64 data bytes) is issued
+//per EVLOG_RECS_PER_PAGE bottles, and every bottle costs at least
+//EVLOG_MIN_SAMPLES colour sensor reads (control + 8 data bytes each).
+//Bit times are 9 per byte on both sides, so the ratio is exact.
+#define EVLOG_MIN_SAMPLES   21          //det.picbug > 20
+#define EVLOG_MAX_OVERHEAD  10          //Percent of the sensor read bus time
+#define EVLOG_PAGE_BYTES    (3 + EVLOG_PAGE_SIZE)
+#define EVLOG_SENSOR_BYTES  (9 * EVLOG_MIN_SAMPLES * EVLOG_RECS_PER_PAGE)
+#if EVLOG_PAGE_BYTES * 100 > EVLOG_MAX_OVERHEAD * EVLOG_SENSOR_BYTES
+#error "Event log page writes exceed the I2C bus overhead budget"
+#endif
+
+typedef struct {
+    uint8_t run;                //Run id, records of older runs are ignored
+    uint8_t cls;                //bottle_count_array index, 1..4
+    uint16_t dwell;             //Samples with the bottle in front of the sensor
+    uint32_t t_detect;          //operation() sample index of the first sample
+    uint16_t peak[4];           //Clear, red, green, blue at the clear peak
+} evlog_rec_t;
+
+void evlog_init(void);
+void evlog_start_run(void);
+void evlog_bottle_begin(uint32_t tick);
+void evlog_bottle_sample(const unsigned int *c);
+void evlog_bottle_end(uint8_t cls);
+void evlog_poll(void);              //Main loop, writes a full page with interrupts on
+void evlog_flush(void);             //Main loop, at the end of a run
+const evlog_rec_t *evlog_last(void);
+uint16_t evlog_count(void);
+void evlog_stream_begin(void);
+uint8_t evlog_stream_next(evlog_rec_t *rec);
+
+#endif	/* EVLOG_H */
@@ -0,0 +1,139 @@
+/*
+ * File:   keypad.c
+ * Author: Administrator
+ *
+ * Debounced keypad events from INT1 and a TMR2 tick.
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include "configBits.h"
+#include "timers.h"
+#include "keypad.h"
+
+#if !TMR2_FITS(KP_TICK_MS * 1000UL, KP_TMR2_PRE, KP_TMR2_POST)
+#error "KP_TICK_MS can't be generated from TMR2 at this _XTAL_FREQ"
+#endif
+
+#define KP_QUEUE_MASK   (KP_QUEUE_SIZE - 1)
+#define KP_TICKS(ms)    (((ms) + KP_TICK_MS - 1) / KP_TICK_MS)
+#define KP_DATA         PORTBbits.RB1           //74C922 data available, high while a key is down
+
+enum kp_state {
+    KP_IDLE,
+    KP_BOUNCE,          //Edge seen, waiting for it to hold
+    KP_HELD,
+    KP_LETGO            //Line dropped, waiting for it to stay down
+};
+
+static kp_event_t kp_queue[KP_QUEUE_SIZE];
+static volatile uint8_t kp_head;        //Written by the ISR
+static volatile uint8_t kp_tail;        //Written by the main loop
+static volatile uint16_t kp_now;        //Ticks since kp_init()
+static uint8_t kp_state;
+static uint8_t kp_key;
+static uint16_t kp_count;               //Ticks since the press was accepted
+static uint8_t kp_gap;                  //Ticks since the line dropped
+static uint8_t kp_rate;                 //Ticks to the next repeat
+static uint16_t kp_edge;                //kp_now at the last edge
+static uint16_t kp_repeat;
+uint8_t kp_dropped;
+
+void kp_init(uint16_t repeat){
+    kp_head = 0;
+    kp_tail = 0;
+    kp_now = 0;
+    kp_state = KP_IDLE;
+    kp_repeat = repeat;
+    kp_dropped = 0;
+
+    INTEDG1 = 1;                //Rising edge, key down
+    PR2 = TMR2_PR2(KP_TICK_MS * 1000UL, KP_TMR2_PRE, KP_TMR2_POST);
+    TMR2 = 0;
+    T2CON = TMR2_T2CON(KP_TMR2_PRE, KP_TMR2_POST);     //Off
+    TMR2IF = 0;
+    TMR2IE = 1;
+    TMR2ON = 1;
+}
+
+static void kp_post(uint8_t type, uint16_t t){
+    uint8_t next = (kp_head + 1) & KP_QUEUE_MASK;
+    if(next == kp_tail){
+        kp_dropped += 1;
+        return;
+    }
+    kp_queue[kp_head].type = type;
+    kp_queue[kp_head].key = kp_key;
+    kp_queue[kp_head].t = t;
+    kp_head = next;
+}
+
+uint8_t kp_get(kp_event_t *e){
+    if(kp_tail == kp_head) return 0;
+    *e = kp_queue[kp_tail];
+    kp_tail = (kp_tail + 1) & KP_QUEUE_MASK;
+    return 1;
+}
+
+uint8_t kp_pending(void){
+    return kp_tail != kp_head;
+}
+
+uint16_t kp_ticks(void){
+    //Two byte read, retry if the tick landed between them
+    uint16_t t;
+    do{
+        t = kp_now;
+    }while(t != kp_now);
+    return t;
+}
+
+void kp_edge_isr(void){
+    //A bounce while a key is being timed changes nothing
+    if(kp_state != KP_IDLE) return;
+    kp_key = PORTB >> 4;
+    kp_edge = kp_now;
+    kp_count = 0;
+    kp_state = KP_BOUNCE;
+}
+
+void kp_tick_isr(void){
+    kp_now += 1;
+    switch(kp_state){
+        case KP_BOUNCE:
+            if(!KP_DATA) kp_state = KP_IDLE;
+            else if(++kp_count >= KP_TICKS(KP_DEBOUNCE_MS)){
+                kp_post(KP_PRESS, kp_edge);
+                kp_count = 0;
+                kp_rate = 1;
+                kp_state = KP_HELD;
+            }
+            break;
+        case KP_HELD:
+            if(!KP_DATA){
+                kp_edge = kp_now;
+                kp_gap = 0;
+                kp_state = KP_LETGO;
+                break;
+            }
+            if(kp_count != 0xFFFF) kp_count += 1;
+            if(kp_count == KP_TICKS(KP_LONG_MS)) kp_post(KP_LONG, kp_now);
+            if((kp_repeat & KP_BIT(kp_key)) && kp_count >= KP_TICKS(KP_REPEAT_MS) && --kp_rate == 0){
+                kp_post(KP_REPEAT, kp_now);
+                kp_rate = KP_TICKS(KP_RATE_MS);
+            }
+            break;
+        case KP_LETGO:
+            if(KP_DATA && (PORTB >> 4) == kp_key){
+                kp_state = KP_HELD;         //Contact bounce, still the same press
+                break;
+            }
+            if(KP_DATA || ++kp_gap >= KP_TICKS(KP_DEBOUNCE_MS)){
+                kp_post(KP_RELEASE, kp_edge);
+                kp_state = KP_IDLE;
+                //Rolled straight onto another key, its edge came while this one was timed
+                if(KP_DATA) kp_edge_isr();
+            }
+            break;
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * File:   keypad.h
+ * Author: Administrator
+ *
+ * Keypad driver for the 74C922 encoder: key code on RB7:RB4, data
+ * available on RB1/INT1. The INT1 edge only latches the key; TMR2 ticks
+ * every KP_TICK_MS to debounce the press and release, time long presses
+ * and auto-repeat, and posts events for the main loop to read with
+ * kp_get(). Nothing in the interrupt waits for a key to be let go.
+ */
+
+#ifndef KEYPAD_H
+#define	KEYPAD_H
+
+#include <stdint.h>
+
+//Key codes as read from PORTB<7:4>
+#define KP_1            0
+#define KP_2            1
+#define KP_3            2
+#define KP_A            3
+#define KP_4            4
+#define KP_5            5
+#define KP_6            6
+#define KP_B            7
+#define KP_7            8
+#define KP_8            9
+#define KP_9            10
+#define KP_C            11
+#define KP_STAR         12
+#define KP_0            13
+#define KP_HASH         14
+#define KP_D            15
+#define KP_BIT(k)       (1u << (k))
+
+//Event types
+#define KP_PRESS        1
+#define KP_RELEASE      2
+#define KP_LONG         3           //Held for KP_LONG_MS, once per press
+#define KP_REPEAT       4           //Held past KP_REPEAT_MS, keys in the repeat mask only
+
+//TMR2 can't count 10 ms at 40 MHz, the PLL profile ticks every 4 ms
+#ifdef CLK_HSPLL
+#define KP_TICK_MS      4
+#else
+#define KP_TICK_MS      10
+#endif
+#define KP_DEBOUNCE_MS  30          //Both edges must hold this long
+#define KP_LONG_MS      1000
+#define KP_REPEAT_MS    500         //First repeat
+#define KP_RATE_MS      200         //Then one every
+#define KP_QUEUE_SIZE   8           //Must be a power of 2
+
+//TMR2 scaling for KP_TICK_MS, PR2 and T2CON come from timers.h
+#define KP_TMR2_PRE     16
+#define KP_TMR2_POST    10
+
+typedef struct {
+    uint8_t type;
+    uint8_t key;
+    uint16_t t;                     //kp_ticks() at the edge, press or release
+} kp_event_t;
+
+extern uint8_t kp_dropped;          //Events lost to a full queue
+
+void kp_init(uint16_t repeat);      //Mask of KP_BIT() keys that auto-repeat
+uint8_t kp_get(kp_event_t *e);
+uint8_t kp_pending(void);
+uint16_t kp_ticks(void);
+void kp_edge_isr(void);
+void kp_tick_isr(void);
+
+#endif	/* KEYPAD_H */
@@ -13,6 +13,13 @@
 
 void initLCD(void) {
     __delay_ms(15);
+    resetLCD();
+    __delay_ms(13);
+}
+
+void resetLCD(void) {
+    //The instructions without the power up wait, enough for an LCD that
+    //stayed powered through a PIC reset, whatever nibble it was on
     lcdInst(0b00110011);        //Force into 8bit mode
     lcdInst(0b00110011);        //Should require only three commands, but
     lcdInst(0b00110010);        //Seems to be demanding five in this case. 
@@ -20,7 +27,7 @@ void initLCD(void) {
     lcdInst(0b00001111);
     lcdInst(0b00000110);
     lcdInst(0b00000001);
-    __delay_ms(15);
+    __delay_ms(2);              //Clear display, 1.52 ms
 }
 
 void lcdInst(char data) {
@@ -0,0 +1,62 @@
+/*
+ * File:   lut.c
+ * Author: Administrator
+ *
+ * Table classifier, see lut.h.
+ */
+
+#include <stdint.h>
+#include "lut.h"
+#include "lut_table.h"
+
+//8192 / c for c = 128..255, so that v * lut_recip[c - 128] >> 9 is
+//v * LUT_N / c
+static const uint8_t lut_recip[128] = {
+    64, 63, 63, 62, 62, 61, 61, 60, 60, 59, 59, 58, 58, 58, 57, 57,
+    56, 56, 56, 55, 55, 54, 54, 54, 53, 53, 53, 52, 52, 52, 51, 51,
+    51, 50, 50, 50, 49, 49, 49, 49, 48, 48, 48, 47, 47, 47, 47, 46,
+    46, 46, 46, 45, 45, 45, 45, 44, 44, 44, 44, 43, 43, 43, 43, 42,
+    42, 42, 42, 42, 41, 41, 41, 41, 40, 40, 40, 40, 40, 39, 39, 39,
+    39, 39, 39, 38, 38, 38, 38, 38, 37, 37, 37, 37, 37, 37, 36, 36,
+    36, 36, 36, 36, 35, 35, 35, 35, 35, 35, 35, 34, 34, 34, 34, 34,
+    34, 33, 33, 33, 33, 33, 33, 33, 33, 32, 32, 32, 32, 32, 32, 32
+};
+
+static uint8_t lut_step(uint8_t v, uint8_t k){
+    uint8_t q = (uint8_t)(((uint16_t)v * k) >> 9);
+    return q < LUT_N ? q : LUT_N - 1;
+}
+
+void lut_quantize(const unsigned int *crgb, uint8_t *rq, uint8_t *bq){
+    unsigned int c = crgb[0], r = crgb[1], b = crgb[3];
+    uint8_t k;
+
+    if(!c){
+        *rq = 0;
+        *bq = 0;
+        return;
+    }
+    //Shares above 1 come from noise or the gains, they go in the last step
+    if(r > c) r = c;
+    if(b > c) b = c;
+    while(c > 255){
+        c >>= 1;
+        r >>= 1;
+        b >>= 1;
+    }
+    while(c < 128){
+        c <<= 1;
+        r <<= 1;
+        b <<= 1;
+    }
+    k = lut_recip[c - 128];
+    *rq = lut_step((uint8_t)r, k);
+    *bq = lut_step((uint8_t)b, k);
+}
+
+uint8_t lut_classify(uint8_t grid, const unsigned int *crgb){
+    uint8_t rq, bq;
+
+    lut_quantize(crgb, &rq, &bq);
+    return lut_class[grid][rq][bq];
+}
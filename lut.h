@@ -0,0 +1,33 @@
+/*
+ * File:   lut.h
+ * Author: Administrator
+ *
+ * Table classifier, the alternative to the red/blue ratio thresholds
+ * selected with the classifier parameter. A reading's chromaticity, red
+ * and blue as shares of clear, is quantized into a LUT_N x LUT_N grid and
+ * the cell holds the class: 0 for neither, 1 for YOP, 2 for ESKA, as in
+ * det.read_top and det.read_bot. There is one grid for the cap reading
+ * and one for the body.
+ *
+ * The grids are const and stay in program memory. They come from
+ * lut_table.h, which tools/lutgen writes from labelled traces, so
+ * retuning them is a data-only change. Quantizing takes no division:
+ * clear is shifted into 128..255, then one 8 x 8 multiply by a
+ * reciprocal from a table gives each share.
+ */
+
+#ifndef LUT_H
+#define	LUT_H
+
+#include <stdint.h>
+
+#define LUT_N               16      //Grid steps per share, 1/16 each
+#define LUT_TOP             0       //Cap grid
+#define LUT_BOT             1       //Body grid
+
+extern const uint8_t lut_class[2][LUT_N][LUT_N];    //[grid][red share][blue share]
+
+void lut_quantize(const unsigned int *crgb, uint8_t *rq, uint8_t *bq);
+uint8_t lut_classify(uint8_t grid, const unsigned int *crgb);
+
+#endif	/* LUT_H */
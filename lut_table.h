@@ -0,0 +1,47 @@
+/*
+ * File:   lut_table.h
+ *
+ * Written by tools/lutgen from 600 bottles in 60 traces, 64 samples
+ * per reading. Do not edit, run lutgen again. Rows are the red share
+ * of clear, columns the blue share, both in steps of 1/LUT_N.
+ * 0 = neither, 1 = YOP, 2 = ESKA.
+ */
+
+const uint8_t lut_class[2][LUT_N][LUT_N] = {
+    {   //LUT_TOP
+        {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
+        {0,0,0,0,0,0,0,0,0,2,2,0,0,0,0,0},
+        {0,0,0,0,0,0,0,2,2,2,2,2,2,2,0,0},
+        {0,0,0,0,0,0,2,0,2,2,2,2,2,2,0,0},
+        {0,0,0,0,0,0,2,2,2,2,2,2,2,2,2,0},
+        {0,0,0,0,0,0,2,2,2,2,2,2,0,0,0,0},
+        {0,0,0,0,0,0,0,2,0,0,0,0,0,0,0,0},
+        {0,0,0,1,0,0,0,0,0,0,0,0,0,0,0,0},
+        {0,0,1,1,1,0,0,0,0,0,0,0,0,0,0,0},
+        {0,0,1,1,1,1,0,0,0,0,0,0,0,0,0,0},
+        {0,0,1,1,1,1,0,0,0,0,0,0,0,0,0,0},
+        {0,0,1,1,1,1,0,0,0,0,0,0,0,0,0,0},
+        {0,0,0,1,1,1,0,0,0,0,0,0,0,0,0,0},
+        {0,0,0,1,1,1,0,0,0,0,0,0,0,0,0,0},
+        {0,0,0,0,1,0,0,0,0,0,0,0,0,0,0,0},
+        {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}
+    },
+    {   //LUT_BOT
+        {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
+        {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
+        {0,0,0,0,0,0,0,0,2,0,0,0,0,0,0,0},
+        {0,0,0,0,0,2,2,2,2,2,2,2,0,0,0,0},
+        {0,0,0,0,0,2,2,2,2,2,2,2,2,0,0,0},
+        {0,0,0,0,0,0,0,2,2,2,2,2,2,2,0,0},
+        {0,0,0,0,0,0,0,0,2,2,2,2,2,0,0,0},
+        {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
+        {0,0,1,1,0,0,0,0,0,0,0,0,0,0,0,0},
+        {0,1,1,1,0,0,0,0,0,0,0,0,0,0,0,0},
+        {0,1,1,1,1,0,0,0,0,0,0,0,0,0,0,0},
+        {0,1,1,1,1,1,0,0,0,0,0,0,0,0,0,0},
+        {0,0,1,1,1,0,0,0,0,0,0,0,0,0,0,0},
+        {0,1,1,1,1,0,0,0,0,0,0,0,0,0,0,0},
+        {0,0,0,1,1,0,0,0,0,0,0,0,0,0,0,0},
+        {0,0,0,1,0,0,0,0,0,0,0,0,0,0,0,0}
+    }
+};
@@ -10,10 +10,13 @@
 
 #define __delay_1s() for(char i=0;i<100;i++){__delay_ms(10);}
 #define __lcd_shift() lcdInst(0b11111000)
-#define __bcd_to_num(num) (num & 0x0F) + ((num & 0xF0)>>4)*10
 #define __lcd_newline() lcdInst(0b11000000)
 #define __lcd_clear() lcdInst(0b00000001)
 #define __lcd_home() lcdInst(0b10000000)
+//num/den compared against k/100 without a division; matches the float
+//compare for den == 0 as well (inf > k, never < k)
+#define __ratio_gt(num, den, k) ((unsigned long)(num)*100 > (unsigned long)(k)*(den))
+#define __ratio_lt(num, den, k) ((unsigned long)(num)*100 < (unsigned long)(k)*(den))
 
 
 #endif	/* MACROS_H */
@@ -6,16 +6,128 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include <math.h>
 #include "configBits.h"
 #include "constants.h"
 #include "lcd.h"
 #include "I2C.h"
 #include "macros.h"
+#include "eeprom.h"
+#include "evlog.h"
+#include "uart.h"
+#include "telemetry.h"
+#include "param.h"
+#include "keypad.h"
+#include "clock.h"
+#include "metrics.h"
+#include "power.h"
+#include "mux.h"
+#include "ambient.h"
+#include "wb.h"
+#include "lut.h"
+#include "timers.h"
+#include "watchdog.h"
 #include "main.h"
-#include "eeprom_routines.h"
+
+//VARIABLES, declared and described in main.h
+int i;
+int j;
+const char timeset[7] = {   0x30, //Seconds 
+                            0x19, //Minutes
+                            0x13, //Hour, 24 hour mode
+                            0x02, //Day of the week, Monday = 1
+                            0x11, //Day/Date
+                            0x04, //Month
+                            0x17};//Year, last two digits
+persistent enum state curr_state;
+enum state last_state;
+
+const screen_t screens[] = {
+    {standby,       -1, 1, 500},    //STANDBY
+    {emergencystop, -1, 1, 0},      //EMERGENCYSTOP
+    {operation,     -1, 1, 0},      //OPERATION, paced by operation()
+    {operationend,  -1, 1, 500},    //OPERATIONEND
+    {date_time,     -1, 1, 300},    //DATETIME
+    {bottle_counts,  0, 3, 300},    //BOTTLECOUNT
+    {bottle_counts,  1, 3, 300},    //BOTTLECOUNT1
+    {bottle_counts,  2, 3, 300},    //BOTTLECOUNT2
+    {bottle_counts,  3, 3, 300},    //BOTTLECOUNT3
+    {bottle_counts,  4, 3, 300},    //BOTTLECOUNT4
+    {bottle_time,   -1, 1, 300},    //BOTTLETIME
+    {throughput,    -1, 3, 300},    //THROUGHPUT
+    {calibration,   -1, 1, 300}     //CALIBRATE
+};
+
+const keybind_t keymap[] = {
+    {KP_1,      run_start,      OPERATION},
+    {KP_7,      run_stop,       OPERATIONEND},
+    {KP_STAR,   estop,          EMERGENCYSTOP},
+    {KP_HASH,   NULL,           STANDBY},
+    {KP_A,      NULL,           DATETIME},
+    {KP_2,      NULL,           BOTTLECOUNT},
+    {KP_4,      NULL,           BOTTLECOUNT1},
+    {KP_5,      NULL,           BOTTLECOUNT2},
+    {KP_6,      NULL,           BOTTLECOUNT3},
+    {KP_B,      NULL,           BOTTLECOUNT4},
+    {KP_3,      NULL,           BOTTLETIME},
+    {KP_9,      NULL,           THROUGHPUT},
+    {KP_8,      sensor_readout, NOSTATE},
+    {KP_C,      log_readout,    NOSTATE},
+    {KP_D,      calibrate,      CALIBRATE}
+};
+#define KEYMAPLEN           (sizeof(keymap)/sizeof(keymap[0]))
+
+unsigned char time[7];
+persistent unsigned long run_begin;
+persistent unsigned long run_started;
+unsigned long run_ms;
+persistent unsigned long bottle_in;
+persistent unsigned int batch_count;
+persistent unsigned char run_ending;
+persistent unsigned char run_idle;
+persistent unsigned long run_end_at;
+persistent unsigned char run_slot;
+persistent unsigned char run_seq;
+int temp;
+unsigned char bus_stuck;
+unsigned long bus_stuck_at;
+
+persistent unsigned long bottle_count_array[5];
+unsigned long history_started;
+unsigned char ui_page;
+
+int operation_disp = 0;
+persistent int operation_timeout;
+persistent unsigned long operation_ticks;
+evlog_rec_t ev_rec;
+persistent unsigned int color[4];
+persistent unsigned int colorprev[4];
+persistent unsigned int colorprev2[4];
+unsigned char color_low[4];
+unsigned char color_high[4];
+
+persistent int servo0_timer;
+persistent int servo1_timer;
+char servo0_flag;
+char servo1_flag;
+
+near persistent det_t det;
+
+#if SERVO_PS == 0 || !TMR16_FITS(SERVO_SHORT_US, SERVO_PS) || !TMR16_FITS(SERVO_LONG_US, SERVO_PS)
+#error "The servo frame can't be timed by TMR1/TMR3 at this _XTAL_FREQ"
+#endif
+#if IDLETICK_PS == 0
+#error "IDLETICK_MS is longer than TMR0 can count at this _XTAL_FREQ"
+#endif
+#if HISTORYRECLEN + 2 > EE_QUEUE_SIZE
+#error "A savedata() checkpoint (record, markers, invalidate) doesn't fit the EEPROM queue"
+#endif
 
 void main(void) {
+    kp_event_t key;
+    const screen_t *screen;
+    uint8_t warm, marker;
+    
+    warm = wd_init();           //Watchdog reset in a run, see watchdog.h
     
     // <editor-fold defaultstate="collapsed" desc=" STARTUP SEQUENCE ">
     
@@ -46,93 +158,110 @@ void main(void) {
     
     nRBPU = 0;
     
-    initLCD();
-    I2C_Master_Init(10000);     //Initialize I2C Master with 100KHz clock
-    I2C_ColorSens_Init();       //Initialize TCS34725 Color Sensor
+    if(warm) resetLCD();        //Powered, but maybe halfway through a byte
+    else initLCD();
+    I2C_Master_Init();          //Initialize I2C Master at I2C_HZ
+    if(warm){
+        I2C_Recover();          //The reset may have come halfway through a byte
+        mux_reset();
+    }
+    else mux_init();            //Second sensor, if the board has the mux
+    if(!warm){                  //Otherwise still set up, pm_resume() starts it
+        I2C_ColorSens_Init();   //Initialize TCS34725 Color Sensor
+        if(mux_dual){
+            mux_select(MUX_BOT);
+            I2C_ColorSens_Init();
+            mux_select(MUX_TOP);
+        }
+    }
+    uart_init();                //Telemetry on RC6/RC7
+    kp_init(REPEATKEYS);        //Keypad events, TMR2 tick
     
     //Set Timer Properties
     TMR0 = 0;
     T08BIT = 0;
     T0CS = 0;
-    PSA = 0;
-    T0PS2 = 1;
-    T0PS1 = 1;
-    T0PS0 = 1;  
+    PSA = IDLETICK_PS == 1;
+    T0PS2 = TMR0_T0PS(IDLETICK_PS) >> 2;
+    T0PS1 = TMR0_T0PS(IDLETICK_PS) >> 1 & 1;
+    T0PS0 = TMR0_T0PS(IDLETICK_PS) & 1;
     
     TMR1 = 0;
     servo0_flag = 0;
-    servo0_timer = 1;
+    if(!warm) servo0_timer = 1;
     T1CON = 0b10000001;
     TMR1ON = 0;
     TMR1CS = 0;
-    T1CKPS1 = 0;
-    T1CKPS0 = 0;
+    T1CKPS1 = TMR13_CKPS(SERVO_PS) >> 1;
+    T1CKPS0 = TMR13_CKPS(SERVO_PS) & 1;
     TMR1IE = 1;
     
     TMR3 = 0;
     servo1_flag = 0;
-    servo1_timer = 1;
+    if(!warm) servo1_timer = 1;
     T3CON = 0b1000001;
     TMR3ON = 0;
     TMR3CS = 0;
-    T3CKPS1 = 0;
-    T3CKPS0 = 0;
+    T3CKPS1 = TMR13_CKPS(SERVO_PS) >> 1;
+    T3CKPS0 = TMR13_CKPS(SERVO_PS) & 1;
     TMR3IE = 1;
       
     
     //</editor-fold>
-    for(i=0;i<5;i++) bottle_count_disp[i] = -1;
-    for(i=20;i<50;i++) eeprom_writebyte(i, 0);
-    
-    curr_state = STANDBY;
+    eeprom_init();
+    param_init();
+    if(warm){
+        wb_init();
+        run_resume();
+        last_state = OPERATION;
+    }
+    else{
+        for(i=0;i<HISTORYSLOTS;i++){
+            //Committed runs outlive a power cycle and a torn save already
+            //reads OPEN. Only a blank or garbled marker is rewritten, once
+            marker = eeprom_readbyte(HISTORYADDR(i));
+            if(marker != EE_MARKER_VALID && marker != EE_MARKER_OPEN) eeprom_invalidate_record(HISTORYADDR(i));
+        }
+        evlog_init();
+        read_time();
+        clk_init(rtc_to_epoch(time));
+        pm_init();              //Sensor in its wait state until a run starts
+        memset(&det, 0, sizeof(det));
+        operation_ticks = 0;
+        mt_start();
+        
+        curr_state = wb_init() ? STANDBY : CALIBRATE;     //New unit, ask for the white card first
+        last_state = STANDBY;
+    }
+    tlm_reset(wd_cause, wd_resets, curr_state, operation_ticks);
+    wd_start();
     
     while(1){
-        switch(curr_state){
-            case STANDBY:
-                standby();
-                __delay_ms(500);
-                break;
-            case EMERGENCYSTOP:
-                emergencystop();
-                break;
-            case OPERATION:
-                operation();
-                __delay_ms(2);
-                __delay_us(400);
-                break;
-            case OPERATIONEND:
-                operationend();
-                __delay_ms(500);
-                break;
-            case DATETIME:
-                date_time();
-                __delay_ms(300);
-                break;
-            case BOTTLECOUNT:
-                bottle_count();
-                __delay_ms(300);
-                break;
-            case BOTTLECOUNT1:
-                bottle_count1();
-                __delay_ms(300);
-                break;
-            case BOTTLECOUNT2:
-                bottle_count2();
-                __delay_ms(300);
-                break;
-            case BOTTLECOUNT3:
-                bottle_count3();
-                __delay_ms(300);
-                break;
-            case BOTTLECOUNT4:
-                bottle_count4();
-                __delay_ms(300);
-                break;
-            case BOTTLETIME:
-                bottle_time();
-                __delay_ms(300);
-                break;
+        CLRWDT();               //Once a pass, idle_ms() waits clear it too
+        if(i2c_err & I2C_ERR_BUS){
+            if(!bus_stuck || clk_millis() - bus_stuck_at >= BUSRETRYMS) bus_recover();
         }
+        else i2c_err = 0;       //NACK or WCOL, the bus is fine and the next pass retries
+        param_poll(curr_state == OPERATION);    //Before tlm_poll(), whose commit replies use it
+        tlm_poll();
+        evlog_poll();
+        while(kp_get(&key)) key_event(&key);
+        if(curr_state != last_state){
+            tlm_state(last_state, curr_state, operation_ticks);
+            if(curr_state == OPERATIONEND){
+                evlog_flush();  //Last page of the run
+                tlm_counts(bottle_count_array);
+                tlm_profile(operation_ticks, evlog_count());
+                tlm_i2c(i2c_timeouts, i2c_nacks, i2c_collisions, i2c_recoveries);
+                tlm_rate(mt.bottles, mt.gap_min, mt_rate_now(), mt_rate_avg());
+                tlm_hist(TLM_HIST_GAP, MT_GAP_BASE_MS, mt.gap_hist);
+                tlm_hist(TLM_HIST_DWELL, MT_DWELL_BASE_MS, mt.dwell_hist);
+            }
+            last_state = curr_state;
+        }
+        screen = &screens[curr_state];
+        screen->render();
+        idle_ms(screen->refresh_ms);
         //__delay_ms(MAINPOLLINGDELAYMS);
     }
     
@@ -141,155 +270,19 @@ void main(void) {
 
 void interrupt isr(void){
     if (INT1IF) {
-        switch(PORTB>>4){
-            case 0:    //KP_1 -- OPERATION START
-                LATAbits.LATA2 = 1; //Start centrifuge motor
-                TMR0IE = 1;         //Start timer with interrupts
-                TMR0ON = 1;         
-                TMR0 = 0;
-                TMR1ON = 1;
-                TMR3ON = 1;
-                operation_timeout = 0;
-                
-                read_time();
-                start_time[1] = time[1];
-                start_time[0] = time[0];
-                for(i=0;i<5;i++){
-                    bottle_count_array[i] = 0;
-                    bottle_count_disp[i] = -1;
-                }
-                __lcd_clear();
-                __delay_ms(100);
-                __lcd_home();
-                printf("running               ");
-
-                curr_state = OPERATION;
-                break;
-            case 1:    //KP_2 -- BOTTLECOUNT
-//                bottle_count_disp[0] += 1;
-//                curr_state = BOTTLECOUNT;
-                temp = bottle_count_disp[0];
-                for(i=0;i<5;i++) bottle_count_disp[i] = -1;
-                bottle_count_disp[0] = temp + 1;
-                bottle_count_array[0] = eeprom_readbyte(20);
-                bottle_count_array[1] = eeprom_readbyte(21);
-                bottle_count_array[2] = eeprom_readbyte(22);
-                bottle_count_array[3] = eeprom_readbyte(23);
-                bottle_count_array[4] = eeprom_readbyte(24);
-                curr_state = BOTTLECOUNT;
-                while((PORTB>>4) == 1){}
-                break;
-            case 2:    //KP_3
-                operation_time = etime - stime;
-                for(i=0;i<5;i++) bottle_count_disp[i] = -1;
-                curr_state = BOTTLETIME;
-                break;
-            case 3:    //KP_A
-                for(i=0;i<5;i++) bottle_count_disp[i] = -1;
-                curr_state = DATETIME;
-                break;
-            case 4:     //KP_4
-                temp = bottle_count_disp[1];
-                for(i=0;i<5;i++) bottle_count_disp[i] = -1;
-                bottle_count_disp[1] = temp + 1;
-                bottle_count_array[0] = eeprom_readbyte(25);
-                bottle_count_array[1] = eeprom_readbyte(26);
-                bottle_count_array[2] = eeprom_readbyte(27);
-                bottle_count_array[3] = eeprom_readbyte(28);
-                bottle_count_array[4] = eeprom_readbyte(29);
-                curr_state = BOTTLECOUNT1;
-                while((PORTB>>4) == 4){}
-                break;
-            case 5:     //KP_5
-                temp = bottle_count_disp[2];
-                for(i=0;i<5;i++) bottle_count_disp[i] = -1;
-                bottle_count_disp[2] = temp + 1;
-                bottle_count_array[0] = eeprom_readbyte(30);
-                bottle_count_array[1] = eeprom_readbyte(31);
-                bottle_count_array[2] = eeprom_readbyte(32);
-                bottle_count_array[3] = eeprom_readbyte(33);
-                bottle_count_array[4] = eeprom_readbyte(34);
-                curr_state = BOTTLECOUNT2;
-                while((PORTB>>4) == 5){}
-                break;
-            case 6:     //KP_6
-                temp = bottle_count_disp[3];
-                for(i=0;i<5;i++) bottle_count_disp[i] = -1;
-                bottle_count_disp[3] = temp + 1;
-                bottle_count_array[0] = eeprom_readbyte(35);
-                bottle_count_array[1] = eeprom_readbyte(36);
-                bottle_count_array[2] = eeprom_readbyte(37);
-                bottle_count_array[3] = eeprom_readbyte(38);
-                bottle_count_array[4] = eeprom_readbyte(39);
-                curr_state = BOTTLECOUNT3;
-                while((PORTB>>4) == 6){}
-                break;
-            case 7:     //KP_B
-                temp = bottle_count_disp[4];
-                for(i=0;i<5;i++) bottle_count_disp[i] = -1;
-                bottle_count_disp[4] = temp + 1;
-                bottle_count_array[0] = eeprom_readbyte(40);
-                bottle_count_array[1] = eeprom_readbyte(41);
-                bottle_count_array[2] = eeprom_readbyte(42);
-                bottle_count_array[3] = eeprom_readbyte(43);
-                bottle_count_array[4] = eeprom_readbyte(44);
-                curr_state = BOTTLECOUNT4;
-                while((PORTB>>4) == 7){}
-                break;
-            case 8:    //KP_7
-                LATAbits.LATA2 = 0; //Stop centrifuge motor
-                TMR0IE = 0;         //Disable timer
-                TMR0ON = 0;
-                TMR1ON = 0;
-                TMR3ON = 0;
-                
-                read_time();
-                end_time[1] = time[1];
-                end_time[0] = time[0];
-                stime = 60*dec_to_hex(start_time[1])+dec_to_hex(start_time[0]);
-                etime = 60*dec_to_hex(end_time[1])+dec_to_hex(end_time[0]);
-                __lcd_clear();
-                for(i=0;i<5;i++) bottle_count_disp[i] = -1;
-                savedata();
-                curr_state = OPERATIONEND;
-                break;
-            case 9:    //KP_8 -- TESTING
-                read_colorsensor();
-                __lcd_home();
-                printf("C%u R%u                ", color[0], color[1]);
-                __lcd_newline();
-                printf("G%u B%u                ", color[2], color[3]);
-                break;
-            case 12:   //KP_*
-                LATAbits.LATA2 = 0; //Stop centrifuge motor
-                di();               //Disable all interrupts
-                TMR0ON = 0;
-                __lcd_clear();
-                curr_state = EMERGENCYSTOP;
-                break;
-            case 14:   //KP_#
-                for(i=0;i<5;i++) bottle_count_disp[i] = -1;
-                curr_state = STANDBY;
-                break;
-            case 10:   //KP_9 -- TESTING
-                //set_time();
-                break;
-            case 11:   //KP_C -- TESTING
-                //savedata();
-                break;
-        }
+        kp_edge_isr();
         INT1IF = 0;
     }
     else if (TMR1IF){
         if(servo0_flag){
             LATCbits.LATC0 = 0;
-            TMR1 = 16517;
+            TMR1 = SERVO_LOW;
             servo0_flag = 0;
         }
         else{
             LATCbits.LATC0 = 1;
-            if(servo0_timer) TMR1 = 63000;
-            else TMR1 = 62000;
+            if(servo0_timer) TMR1 = SERVO_SHORT;
+            else TMR1 = SERVO_LONG;
             servo0_flag = 1;
         }
         TMR1IF = 0;
@@ -297,36 +290,38 @@ void interrupt isr(void){
     else if (TMR3IF){
         if(servo1_flag){
             LATCbits.LATC1 = 0;
-            TMR3 = 16517;
+            TMR3 = SERVO_LOW;
             servo1_flag = 0;
         }
         else{
             LATCbits.LATC1 = 1;
-            if(servo1_timer) TMR3 = 62000;
-            else TMR3 = 63000;
+            if(servo1_timer) TMR3 = SERVO_LONG;
+            else TMR3 = SERVO_SHORT;
             servo1_flag = 1;
         }
         TMR3IF = 0;
     }
+    else if (TMR2IF){
+        kp_tick_isr();
+        clk_tick_isr();
+        TMR2IF = 0;
+    }
+    else if (PIE2bits.EEIE && PIR2bits.EEIF){   //EEIE off is eeprom.c's critical section
+        eeprom_isr();
+    }
+    else if (PIE1bits.TXIE && PIR1bits.TXIF){
+        uart_tx_isr();
+    }
+    else if (PIR1bits.RCIF){
+        uart_rx_isr();
+    }
+    else if (INT0IE && INT0IF){
+        pm_sensor_isr();
+        INT0IF = 0;
+    }
     else if (TMR0IF){
-        if(operation_timeout > 2){
-            LATAbits.LATA2 = 0; //Stop centrifuge motor
-            TMR0IE = 0;         //Disable timer
-            TMR0ON = 0;
-            TMR1ON = 0;
-            TMR3ON = 0;
-
-            read_time();
-            end_time[1] = time[1];
-            end_time[0] = time[0];
-            stime = 60*dec_to_hex(start_time[1])+dec_to_hex(start_time[0]);
-            etime = 60*dec_to_hex(end_time[1])+dec_to_hex(end_time[0]);
-            __lcd_clear();
-            for(i=0;i<5;i++) bottle_count_disp[i] = -1;
-            savedata();
-            curr_state = OPERATIONEND;
-        }
-        else operation_timeout += 1;
+        operation_timeout += 1;
+        if(IDLESTOP && operation_timeout >= IDLESTOP * IDLETICKS) run_idle = 1;
         TMR0IF = 0;
     }
     else{
@@ -339,6 +334,213 @@ void interrupt isr(void){
     return;
 }
 
+void key_event(const kp_event_t *e){
+    //Runs from the main loop. A press, or a repeat of one of REPEATKEYS,
+    //runs the key's row in keymap[]; holding C rewinds the event log
+    unsigned char n;
+
+    if(e->type == KP_LONG && e->key == KP_C){
+        evlog_stream_begin();
+        __lcd_home();
+        printf("Log start: %u     ", evlog_count());
+        __lcd_newline();
+        printf("                ");
+        return;
+    }
+    if(e->type != KP_PRESS && e->type != KP_REPEAT) return;
+    for(n=0;n<KEYMAPLEN;n++){
+        if(keymap[n].key != e->key) continue;
+        if(keymap[n].action) keymap[n].action();
+        if(keymap[n].next != NOSTATE) ui_enter(keymap[n].next);
+        return;
+    }
+}
+
+void ui_enter(unsigned char next){
+    //Entering the screen already shown steps to its next page
+    const screen_t *s = &screens[next];
+
+    if(next == curr_state && ui_page + 1 < s->pages) ui_page += 1;
+    else ui_page = 0;
+    curr_state = next;
+    if(s->history >= 0) load_history(s->history);
+}
+
+void run_start(void){
+    LATAbits.LATA2 = 1; //Start centrifuge motor
+    TMR0IE = 1;         //Start timer with interrupts
+    TMR0ON = 1;         
+    TMR0 = 0;
+    TMR1ON = 1;
+    TMR3ON = 1;
+    operation_timeout = 0;
+    operation_ticks = 0;
+    batch_count = 0;
+    run_ending = 0;
+    run_idle = 0;
+    det.decided = 0;
+    run_slot = HISTORYSLOTS;
+    amb_start();
+    pm_run(1);
+    evlog_start_run();
+    
+    run_begin = clk_millis();
+    run_started = clk_now();
+    mt_start();
+    for(i=0;i<5;i++) bottle_count_array[i] = 0;
+    wd_arm(1);
+    __lcd_clear();
+    __delay_ms(100);
+    __lcd_home();
+    printf("running               ");
+}
+
+void run_resume(void){
+    //run_start() after a watchdog reset, without starting the run over:
+    //counts, the bottle in front of the sensor, servo positions, clock
+    //and log page are persistent. The total is summed again in case the
+    //reset came in the middle of bottle_decide()
+    LATAbits.LATA2 = 1; //Centrifuge motor back on
+    TMR0IE = 1;
+    TMR0ON = 1;
+    TMR0 = 0;
+    TMR1ON = 1;
+    TMR3ON = 1;
+    bottle_count_array[0] = bottle_count_array[1] + bottle_count_array[2]
+                          + bottle_count_array[3] + bottle_count_array[4];
+    pm_resume();
+    curr_state = OPERATION;
+    __lcd_home();
+    printf("running               ");
+}
+
+void bus_recover(void){
+    //A timeout or bus collision since the last pass. Whatever glitched
+    //the bus may have reset the sensors too, so they are set up again,
+    //back to back if a run is on. Should the bus still be stuck it fails
+    //fast, and is tried again BUSRETRYMS later
+    I2C_Recover();
+    mux_reset();
+    mux_select(MUX_TOP);
+    I2C_ColorSens_Init();
+    if(mux_dual){
+        mux_select(MUX_BOT);
+        I2C_ColorSens_Init();
+        mux_select(MUX_TOP);
+    }
+    pm_init();
+    if(curr_state == OPERATION && !run_ending) pm_run(1);
+    bus_stuck = (i2c_err & I2C_ERR_BUS) != 0;
+    bus_stuck_at = clk_millis();
+    tlm_i2c(i2c_timeouts, i2c_nacks, i2c_collisions, i2c_recoveries);
+}
+
+void run_stop(void){
+    //KP_7, the end of a batch, or IDLESTOP periods without a bottle
+    LATAbits.LATA2 = 0; //Stop centrifuge motor
+    TMR0IE = 0;         //Disable timer
+    TMR0ON = 0;
+    TMR1ON = 0;
+    TMR3ON = 0;
+    pm_run(0);
+    wd_arm(0);
+
+    run_ms = clk_millis() - run_begin;
+    __lcd_clear();
+    savedata();
+    ui_page = 0;
+    curr_state = OPERATIONEND;
+}
+
+void estop(void){
+    LATAbits.LATA2 = 0; //Stop centrifuge motor
+    di();               //Disable all interrupts
+    TMR0ON = 0;
+    wd_arm(0);          //Not restarted by a watchdog reset
+    wd_stop();          //Nor reset at all, emergencystop() parks for good
+    __lcd_clear();
+}
+
+void sensor_readout(void){
+    //KP_8, testing. Top sensor when there are two
+    mux_select(MUX_TOP);
+    read_colorsensor();
+    __lcd_home();
+    printf("C%u R%u                ", color[0], color[1]);
+    __lcd_newline();
+    printf("G%u B%u                ", color[2], color[3]);
+}
+
+void calibrate(void){
+    //KP_D, white reference card in front of the sensors. Both are
+    //sampled and either both gains are kept or neither
+    uint32_t sum[4];
+    uint16_t avg[4];
+    uint8_t s, n, k, ok = 1;
+
+    pm_run(1);
+    __delay_ms(5);      //First integration after the wait state
+    for(s=0;s<2;s++){
+        if(s == MUX_BOT && !mux_dual) break;
+        mux_select(s);
+        for(n=0;n<4;n++) sum[n] = 0;
+        for(k=0;k<WB_SAMPLES;k++){
+            read_colorsensor();     //Longer than an integration at 10 kHz, always a new one
+            for(n=0;n<4;n++) sum[n] += color[n];
+        }
+        for(n=0;n<4;n++) avg[n] = (uint16_t)(sum[n] / WB_SAMPLES);
+        if(!wb_set(s, avg)) ok = 0;
+    }
+    pm_run(0);
+    if(ok){
+        wb_commit();
+        wb_status = WB_OK;
+    }
+    else{
+        wb_init();      //Back to the stored gains
+        wb_status = WB_FAIL;
+    }
+}
+
+void calibration(void){
+    __lcd_home();
+    if(wb_status == WB_OK){
+        printf("WB R%u G%u B%u%%        ", WB_PCT(wb_gain[0][0]), WB_PCT(wb_gain[0][1]), WB_PCT(wb_gain[0][2]));
+        __lcd_newline();
+        if(mux_dual) printf("Bot R%u G%u B%u%%       ", WB_PCT(wb_gain[1][0]), WB_PCT(wb_gain[1][1]), WB_PCT(wb_gain[1][2]));
+        else printf("#: done           ");
+        return;
+    }
+    if(wb_status == WB_FAIL) printf("No white card    ");
+    else printf("White card, D    ");
+    __lcd_newline();
+    printf("#: skip          ");
+}
+
+void log_readout(void){
+    //KP_C, event log read-out, one bottle per press
+    __lcd_home();
+    if(evlog_stream_next(&ev_rec)){
+        printf("#%lu c%u d%u          ", ev_rec.t_detect, ev_rec.cls, ev_rec.dwell);
+        __lcd_newline();
+        printf("C%u R%u B%u          ", ev_rec.peak[0], ev_rec.peak[1], ev_rec.peak[3]);
+    }
+    else{
+        evlog_stream_begin();
+        printf("Log end: %u       ", evlog_count());
+        __lcd_newline();
+        printf("                ");
+    }
+}
+
+void idle_ms(unsigned int ms){
+    //Screen refresh delays end early when a key event is waiting. The
+    //TMR2 tick wakes the CPU at least every KP_TICK_MS
+    unsigned long start = clk_millis();
+
+    while(clk_millis() - start < ms && !kp_pending()) pm_idle();
+}
+
 void standby(void){
     __lcd_home();
     printf("standby          ");
@@ -358,18 +560,6 @@ void set_time(void){
     I2C_Master_Stop(); //Stop condition
 }
 
-int dec_to_hex(int num) {                   //Convert decimal unsigned char to hexadecimal int
-    int i = 0, quotient = num, temp, hexnum = 0;
- 
-    while (quotient != 0) {
-        temp = quotient % 16;
-        hexnum += temp*pow(10,i);
-        quotient = quotient / 16;
-        i += 1;
-    }
-    return hexnum;
-}
-
 void date_time(void){
     //Reset RTC memory pointer 
     I2C_Master_Start(); //Start condition
@@ -413,256 +603,296 @@ void read_time(void){
     return;
 }
 
-void bottle_count(void){
-    switch(bottle_count_disp[0] % 3){
-        case 0:
-            __lcd_home();
-            printf("Bottle Count         ");
-            __lcd_newline();
-            printf("Total: %d            ", bottle_count_array[0]);
-            break;
-        case 1:
-            __lcd_home();
-            printf("YOP W/ CAP: %d  ", bottle_count_array[1]);
-            __lcd_newline();
-            printf("YOP NO CAP: %d  ", bottle_count_array[2]);
-            break;
-        case 2:
-            __lcd_home();
-            printf("ESKA W/ CAP: %d ", bottle_count_array[3]);
-            __lcd_newline();
-            printf("ESKA NO CAP: %d ", bottle_count_array[4]);
-            break;
-        default:
-            while(1){
-                __lcd_home();
-                printf("ERR: BAD BTLCNT");
-            }
-            break;
-    }
-    return;
-}
+void bottle_counts(void){
+    //Every count screen: the current run or a saved one, three pages
+    signed char age = screens[curr_state].history;
+    unsigned long ago = clk_now() - history_started;
 
-void bottle_count1(void){
-    switch(bottle_count_disp[1] % 3){
+    __lcd_home();
+    switch(ui_page){
         case 0:
-            __lcd_home();
-            printf("BttlCnt Prev 1        ");
+            //A saved run says how long ago it started, from the epoch
+            //seconds, unless it has no start or the clock went back
+            if(!age) printf("Bottle Count    ");
+            else if(!history_started || clk_now() < history_started) printf("BttlCnt Prev %d  ", age);
+            else if(ago < 3600) printf("Prev %d, %lum ago   ", age, ago / 60);
+            else if(ago < CLK_DAY) printf("Prev %d, %luh ago   ", age, ago / 3600);
+            else printf("Prev %d, %lud ago   ", age, ago / CLK_DAY);
             __lcd_newline();
-            printf("Total: %d           ", bottle_count_array[0]);
+            printf("Total: %lu       ", bottle_count_array[0]);
             break;
         case 1:
-            __lcd_home();
-            printf("YOP W/ CAP: %d  ", bottle_count_array[1]);
+            printf("YOP W/ CAP: %lu ", bottle_count_array[1]);
             __lcd_newline();
-            printf("YOP NO CAP: %d  ", bottle_count_array[2]);
-            break;
-        case 2:
-            __lcd_home();
-            printf("ESKA W/ CAP: %d ", bottle_count_array[3]);
-            __lcd_newline();
-            printf("ESKA NO CAP: %d ", bottle_count_array[4]);
+            printf("YOP NO CAP: %lu ", bottle_count_array[2]);
             break;
         default:
-            while(1){
-                __lcd_home();
-                printf("ERR: BAD BTLCNT");
-            }
-            break;
-    }
-    return;
-}
-
-void bottle_count2(void){
-    switch(bottle_count_disp[2] % 3){
-        case 0:
-            __lcd_home();
-            printf("BttlCnt Prev 2         ");
+            printf("ESKA W/ CAP:%lu ", bottle_count_array[3]);
             __lcd_newline();
-            printf("Total: %d            ", bottle_count_array[0]);
-            break;
-        case 1:
-            __lcd_home();
-            printf("YOP W/ CAP: %d  ", bottle_count_array[1]);
-            __lcd_newline();
-            printf("YOP NO CAP: %d  ", bottle_count_array[2]);
-            break;
-        case 2:
-            __lcd_home();
-            printf("ESKA W/ CAP: %d ", bottle_count_array[3]);
-            __lcd_newline();
-            printf("ESKA NO CAP: %d ", bottle_count_array[4]);
-            break;
-        default:
-            while(1){
-                __lcd_home();
-                printf("ERR: BAD BTLCNT");
-            }
+            printf("ESKA NO CAP:%lu ", bottle_count_array[4]);
             break;
     }
     return;
 }
 
-void bottle_count3(void){
-    switch(bottle_count_disp[3] % 3){
-        case 0:
-            __lcd_home();
-            printf("BttlCnt Prev 3         ");
-            __lcd_newline();
-            printf("Total: %d            ", bottle_count_array[0]);
-            break;
-        case 1:
-            __lcd_home();
-            printf("YOP W/ CAP: %d  ", bottle_count_array[1]);
-            __lcd_newline();
-            printf("YOP NO CAP: %d  ", bottle_count_array[2]);
-            break;
-        case 2:
-            __lcd_home();
-            printf("ESKA W/ CAP: %d ", bottle_count_array[3]);
-            __lcd_newline();
-            printf("ESKA NO CAP: %d ", bottle_count_array[4]);
-            break;
-        default:
-            while(1){
-                __lcd_home();
-                printf("ERR: BAD BTLCNT");
-            }
-            break;
-    }
+void bottle_time(void){
+    __lcd_home();
+    printf("Total Operation          ");
+    __lcd_newline();
+    printf("Time: %lu.%u s          ", run_ms / 1000, (unsigned int)(run_ms % 1000) / 100);
     return;
 }
 
-void bottle_count4(void){
-    switch(bottle_count_disp[4] % 3){
+void throughput(void){
+    //Last or current run, see metrics.h. The histogram pages give each
+    //bucket one digit, + for more than 9
+    char bar[MT_BUCKETS + 1];
+    unsigned char b;
+    unsigned int now = mt_rate_now(), avg = mt_rate_avg();
+
+    __lcd_home();
+    switch(ui_page){
         case 0:
-            __lcd_home();
-            printf("BttlCnt Prev 4          ");
+            printf("Now %u.%u/min     ", now / 10, now % 10);
             __lcd_newline();
-            printf("Total: %d           ", bottle_count_array[0]);
+            printf("Avg %u.%u/min     ", avg / 10, avg % 10);
             break;
         case 1:
-            __lcd_home();
-            printf("YOP W/ CAP: %d  ", bottle_count_array[1]);
-            __lcd_newline();
-            printf("YOP NO CAP: %d  ", bottle_count_array[2]);
-            break;
-        case 2:
-            __lcd_home();
-            printf("ESKA W/ CAP: %d ", bottle_count_array[3]);
+            if(mt.gap_min == MT_NONE) printf("Min gap: -       ");
+            else printf("Min gap: %u ms   ", mt.gap_min);
             __lcd_newline();
-            printf("ESKA NO CAP: %d ", bottle_count_array[4]);
+            printf("Bottles: %u      ", mt.bottles);
             break;
         default:
-            while(1){
-                __lcd_home();
-                printf("ERR: BAD BTLCNT");
-            }
+            bar[MT_BUCKETS] = 0;
+            for(b=0;b<MT_BUCKETS;b++) bar[b] = mt.gap_hist[b] > 9 ? '+' : '0' + mt.gap_hist[b];
+            printf("Gap   %s  ", bar);
+            __lcd_newline();
+            for(b=0;b<MT_BUCKETS;b++) bar[b] = mt.dwell_hist[b] > 9 ? '+' : '0' + mt.dwell_hist[b];
+            printf("Dwell %s  ", bar);
             break;
     }
     return;
 }
 
-void bottle_time(void){
-    __lcd_home();
-    printf("Total Operation          ");
-    __lcd_newline();
-    printf("Time: %d s             ", operation_time);
-    return;
-}
-
 void operation(void){
-    if(bottle_count_array[0] > 9){
-        __delay_ms(1000);
-        LATAbits.LATA2 = 0; //Stop centrifuge motor
-        TMR0IE = 0;         //Disable timer
-        TMR0ON = 0;
-        TMR1ON = 0;
-        TMR3ON = 0;
-
-        read_time();
-        end_time[1] = time[1];
-        end_time[0] = time[0];
-        stime = 60*dec_to_hex(start_time[1])+dec_to_hex(start_time[0]);
-        etime = 60*dec_to_hex(end_time[1])+dec_to_hex(end_time[0]);
-        curr_state = OPERATIONEND;
-        __lcd_clear();
-        for(i=0;i<5;i++) bottle_count_disp[i] = -1;
-        savedata();
+    if(run_idle){
+        run_stop();             //Set by isr(), the stop runs on the bus
+        return;
+    }
+    if(run_ending){
+        //Sampling stops with the batch, keys are still read meanwhile
+        if(clk_millis() - run_end_at >= BATCHENDMS) run_stop();
+        else pm_idle();
+        return;
+    }
+    if(pm_gap){
+        if(!pm_gap_over()){
+            //Nothing in front of the sensor, wait for its INT or a timer
+            pm_idle();
+            return;
+        }
+        //The first read after a wake is phase locked to the end of an
+        //integration and can take half of each, it is dropped
+        read_colorsensor();
+    }
+    if(i2c_err){
+        pm_idle();              //Bus stuck, waiting on bus_recover()
+        return;
+    }
+    if(mux_dual){
+        operation_dual();
         return;
     }
+    colorprev2[0] = colorprev[0];
+    colorprev2[1] = colorprev[1];
+    colorprev2[2] = colorprev[2];
+    colorprev2[3] = colorprev[3];
     colorprev[0] = color[0];
     colorprev[1] = color[1];
     colorprev[2] = color[2];
     colorprev[3] = color[3];
+    operation_ticks += 1;
     
     GIE = 0;
     read_colorsensor();
-    if(color[0]>AMBIENTTCSCLEAR){
-        flag_bottle = 1;
-        flag_picbug += 1;
-        if(color[3]>color[1] && !flag_top_read) flag_eskaC += 1;
-        if(color[1]>NOCAPDISTINGUISH || color[2]>NOCAPDISTINGUISH)flag_yopNC = 1;
+    if(i2c_err){
+        GIE = 1;                //Sample lost, bus_recover() is next
+        return;
+    }
+    wb_apply(MUX_TOP, color);
+    amb_filter(&amb[MUX_TOP], color);
+    if(color[0]>amb[MUX_TOP].above){
+        if(!det.bottle){
+            evlog_bottle_begin(operation_ticks);
+            bottle_in = clk_millis();
+        }
+        evlog_bottle_sample(color);
+        det.bottle = 1;
+        if(det.picbug != 255) det.picbug += 1;
+        if(color[3]>color[1] && !det.top_read && det.eskaC < 2) det.eskaC += 1;
+        if(color[1]>NOCAPDISTINGUISH || color[2]>NOCAPDISTINGUISH)det.yopNC = 1;
         if(color[0]>TCSBOTTLEHIGH){
-            if(!flag_top_read){
-                r = (float) color[1];
-                b = (float) color[3];
+            if(!det.top_read){
 //                __lcd_home();
 //                printf("%u, %u, %u,      ", color[1], color[2], color[3]);
-                if(r/b > 2 && r>16) bottle_read_top = 1;
-                else if(r/b < 0.75) bottle_read_top = 2;
-                else bottle_read_top = 0;
-                flag_top_read = 1;
+                if(LUTCLASSIFIER) det.read_top = lut_classify(LUT_TOP, color);
+                else if(__ratio_gt(color[1], color[3], TOPYOPRATIO) && color[1]>TOPYOPRED) det.read_top = 1;
+                else if(__ratio_lt(color[1], color[3], TOPESKARATIO)) det.read_top = 2;
+                else det.read_top = 0;
+                det.top_read = 1;
             }       //FOR FINAL REPORT SIMPLICITY REMOVE CERTAIN MINOR CODE OPTIMIZATIONS
-            flag_bottle_high = 1;
+            det.bottle_high = 1;
         }
         else if(color[0]<TCSBOTTLEHIGH){
-            if(flag_bottle_high){
-                r_p = (float) colorprev[1];
-                b_p = (float) colorprev[3];
-                if(r_p/b_p > 3.2 && r_p>18) bottle_read_bot = 1;
-                else if(r_p/b_p < 0.75) bottle_read_bot = 2;
-                else bottle_read_bot = 0;
-                flag_bottle_high = 0;
+            if(det.bottle_high){
+                //The last sample above straddles the trailing edge at 10 kHz, its
+                //green and blue are already ambient. The one before it is used
+                //when it was above too
+                unsigned int *body = colorprev2[0] > TCSBOTTLEHIGH ? colorprev2 : colorprev;
+                if(LUTCLASSIFIER) det.read_bot = lut_classify(LUT_BOT, body);
+                else if(__ratio_gt(body[1], body[3], BOTYOPRATIO) && body[1]>BOTYOPRED) det.read_bot = 1;
+                else if(__ratio_lt(body[1], body[3], BOTESKARATIO)) det.read_bot = 2;
+                else det.read_bot = 0;
+                det.bottle_high = 0;
             }
         }
     }
-    else if(flag_bottle && flag_picbug > 20){
-        flag_picbug = 0;
-        bottle_count_array[0] += 1;
-        TMR0 = 0;
-        if(bottle_read_top == 2 || bottle_read_bot == 2 || flag_eskaC>1){
-            bottle_count_array[3] += 1;
-            servo1_timer = 1;
+    else if(det.bottle && det.picbug > BOTTLEMINSAMPLES) bottle_decide();
+    else if(det.picbug < 3 && det.picbug > 0) det.picbug -= 1;
+    GIE  = 1;
+    if(!det.bottle && color[0] <= amb[MUX_TOP].above){
+        amb_track(&amb[MUX_TOP], color);
+        pm_arm(amb[MUX_TOP].above);
+        return;
+    }
+    __delay_us(SAMPLEPAD_US);   //Sample period, with the sensor read
+    return;
+}
+
+void bottle_decide(void){
+    //Counts, sorts and reports the bottle in front of the sensor
+    det.picbug = 0;
+    bottle_count_array[0] += 1;
+    TMR0 = 0;
+    operation_timeout = 0;
+    if(det.read_top == 2 || det.read_bot == 2 || det.eskaC>1){
+        bottle_count_array[3] += 1;
+        servo1_timer = 1;
+        evlog_bottle_end(3);
+    }
+    else if(det.read_top == 1 || det.read_bot == 1){
+        bottle_count_array[1] += 1;
+        servo0_timer = 1;
+        evlog_bottle_end(1);
+    }
+    else if(det.yopNC){
+        bottle_count_array[2] += 1;
+        servo0_timer = 0;
+        evlog_bottle_end(2);
+    }
+    else{
+        bottle_count_array[4] += 1;
+        servo1_timer = 0;
+        evlog_bottle_end(4);
+    }
+    mt_bottle(bottle_in, clk_millis() - bottle_in);
+    if(++batch_count >= BATCHSIZE){
+        batch_count = 0;
+        if(CONTINUOUS) savedata();          //Checkpoint, HISTORYRECLEN + 2 queued writes
+        else{
+            run_ending = 1;
+            run_end_at = clk_millis();
         }
-        else if(bottle_read_top == 1 || bottle_read_bot == 1){
-            bottle_count_array[1] += 1;
-            servo0_timer = 1;
+    }
+    tlm_send(TLM_BOTTLE, evlog_last(), EVLOG_REC_SIZE);
+    tlm_counts(bottle_count_array);
+    det.bottle = 0;
+    det.bottle_high = 0;
+    det.top_read = 0;
+    det.yopNC = 0;
+//    __lcd_home();
+//    __lcd_newline();   //TESTING
+//    printf("%d       ", det.eskaC);
+    det.eskaC = 0;
+//    printf("%d, %d, %d", color[1], color[2], color[3]);
+//    printf("%d, %d, %d", bottle_count_array[0], det.read_top, det.read_bot);
+}
+
+void operation_dual(void){
+    //Each pass reads both sensors through the mux, top then bottom. Cap
+    //and body are classified as their readings come in and the bottle is
+    //decided once both are known and it has been there as long as
+    //BOTTLEMINSAMPLES single sensor samples, while it is still in front
+    //of the sensors. Each sensor is classified on its second sample
+    //above TCSBOTTLEHIGH, the first one may straddle the leading edge.
+    //Interrupts stay on: isr() no longer touches the bus, the idle stop
+    //included (run_idle), and two reads with them off would stretch
+    //every servo pulse
+    unsigned int top[4];
+    unsigned char clear;
+
+    operation_ticks += 1;
+    mux_select(MUX_TOP);
+    read_colorsensor();
+    if(i2c_err) return;                 //Sample lost, bus_recover() is next
+    wb_apply(MUX_TOP, color);
+    amb_filter(&amb[MUX_TOP], color);
+    top[0] = color[0];
+    top[1] = color[1];
+    top[2] = color[2];
+    top[3] = color[3];
+    mux_select(MUX_BOT);
+    read_colorsensor();
+    if(i2c_err) return;
+    wb_apply(MUX_BOT, color);
+    amb_filter(&amb[MUX_BOT], color);
+    clear = top[0] <= amb[MUX_TOP].above && color[0] <= amb[MUX_BOT].above;
+    if(det.decided){
+        if(clear) det.decided = 0;      //Trailing edge, ready for the next bottle
+    }
+    else if(!clear){
+        if(!det.bottle){
+            evlog_bottle_begin(operation_ticks);
+            bottle_in = clk_millis();
         }
-        else if(flag_yopNC){
-            bottle_count_array[2] += 1;
-            servo0_timer = 0;
+        evlog_bottle_sample(color);
+        det.bottle = 1;
+        if(det.picbug != 255) det.picbug += 1;
+        if(top[3]>top[1] && det.top_read < 2 && det.eskaC < 2) det.eskaC += 1;
+        if(top[1]>NOCAPDISTINGUISH || top[2]>NOCAPDISTINGUISH || color[1]>NOCAPDISTINGUISH || color[2]>NOCAPDISTINGUISH) det.yopNC = 1;
+        if(top[0]>TCSBOTTLEHIGH && det.top_read < 2 && ++det.top_read == 2){
+            if(LUTCLASSIFIER) det.read_top = lut_classify(LUT_TOP, top);
+            else if(__ratio_gt(top[1], top[3], TOPYOPRATIO) && top[1]>TOPYOPRED) det.read_top = 1;
+            else if(__ratio_lt(top[1], top[3], TOPESKARATIO)) det.read_top = 2;
+            else det.read_top = 0;
         }
-        else{
-            bottle_count_array[4] += 1;
-            servo1_timer = 0;
+        if(color[0]>TCSBOTTLEHIGH && det.bottle_high < 2 && ++det.bottle_high == 2){
+            if(LUTCLASSIFIER) det.read_bot = lut_classify(LUT_BOT, color);
+            else if(__ratio_gt(color[1], color[3], BOTYOPRATIO) && color[1]>BOTYOPRED) det.read_bot = 1;
+            else if(__ratio_lt(color[1], color[3], BOTESKARATIO)) det.read_bot = 2;
+            else det.read_bot = 0;
         }
-        flag_bottle = 0;
-        flag_bottle_high = 0;
-        flag_top_read = 0;
-        flag_yopNC = 0;
-//        __lcd_home();
-//        __lcd_newline();   //TESTING
-//        printf("%d       ", flag_eskaC);
-        flag_eskaC = 0;
-
-//        printf("%d, %d, %d", color[1], color[2], color[3]);
-//        printf("%f", r_p/b_p);      
-//        printf("%d, %d, %d", bottle_count_array[0], bottle_read_top, bottle_read_bot);
-    }
-    else if(flag_picbug < 3 && flag_picbug > 0) flag_picbug -= 1;
-    GIE  = 1;
-    return;
+        if(det.top_read == 2 && det.bottle_high == 2 && det.picbug > BOTTLEMINSAMPLES/2){
+            bottle_decide();
+            det.decided = 1;
+        }
+    }
+    else if(det.bottle && det.picbug > BOTTLEMINSAMPLES/2){
+        //Gone before both sensors had a reading, decide on what there is
+        if(det.top_read < 2) det.read_top = 0;
+        if(det.bottle_high < 2) det.read_bot = 0;
+        bottle_decide();
+    }
+    else if(det.picbug < 3 && det.picbug > 0) det.picbug -= 1;
+    if(!det.bottle && !det.decided && clear){
+        amb_track(&amb[MUX_TOP], top);
+        amb_track(&amb[MUX_BOT], color);
+        pm_arm(amb[MUX_TOP].above);
+    }
+#if DUALPAD_US > 0
+    else __delay_us(DUALPAD_US);
+#endif
 }
 
 void operationend(void){
@@ -673,6 +903,7 @@ void operationend(void){
 
 void emergencystop(void){
     di();
+    wd_stop();          //The spin below never clears the WDT
     PORTAbits.RA2 = 0;
     __lcd_clear();
     __lcd_home();
@@ -733,6 +964,7 @@ void read_colorsensor(void){
     color_low[3] = I2C_Master_Read(1); 
     color_high[3] = I2C_Master_Read(0); //Final read for blue, no ack 
     I2C_Master_Stop();                  //Stop condition
+    if(i2c_err) return;                 //Keeps the last reading
     color[0] = (color_high[0] << 8)|(color_low[0]);
     color[1] = (color_high[1] << 8)|(color_low[1]);
     color[2] = (color_high[2] << 8)|(color_low[2]);
@@ -741,83 +973,75 @@ void read_colorsensor(void){
     return;
 }
 
-uint8_t eeprom_readbyte(uint16_t address) {
-
-    // Set address registers
-    EEADRH = (uint8_t)(address >> 8);
-    EEADR = (uint8_t)address;
-
-    EECON1bits.EEPGD = 0;       // Select EEPROM Data Memory
-    EECON1bits.CFGS = 0;        // Access flash/EEPROM NOT config. registers
-    EECON1bits.RD = 1;          // Start a read cycle
-
-    // A read should only take one cycle, and then the hardware will clear
-    // the RD bit
-    while(EECON1bits.RD == 1);
-
-    return EEDATA;              // Return data
+unsigned char history_newest(unsigned char *seq){
+    //Returns the slot holding the most recent committed run, or HISTORYSLOTS
+    unsigned char slot, newest = HISTORYSLOTS;
+    unsigned char rec[HISTORYRECLEN];
+    
+    for(slot=0;slot<HISTORYSLOTS;slot++){
+        if(!eeprom_read_record(HISTORYADDR(slot), rec, 1)) continue;
+        if(newest == HISTORYSLOTS || (signed char)(rec[0] - *seq) > 0){
+            newest = slot;
+            *seq = rec[0];
+        }
+    }
+    return newest;
 }
 
-void eeprom_writebyte(uint16_t address, uint8_t data) {    
-    // Set address registers
-    EEADRH = (uint8_t)(address >> 8);
-    EEADR = (uint8_t)address;
-
-    EEDATA = data;          // Write data we want to write to SFR
-    EECON1bits.EEPGD = 0;   // Select EEPROM data memory
-    EECON1bits.CFGS = 0;    // Access flash/EEPROM NOT config. registers
-    EECON1bits.WREN = 1;    // Enable writing of EEPROM (this is disabled again after the write completes)
+void load_history(unsigned char age){
+    //Loads the run saved age runs ago (0 = latest) into bottle_count_array
+    unsigned char slot, seq = 0;
+    unsigned char rec[HISTORYRECLEN];
+    
+    for(i=0;i<5;i++) bottle_count_array[i] = 0;
+    history_started = 0;
+    if(history_newest(&seq) == HISTORYSLOTS) return;
+    seq -= age;
+    for(slot=0;slot<HISTORYSLOTS;slot++){
+        if(eeprom_read_record(HISTORYADDR(slot), rec, HISTORYRECLEN - 1) && rec[0] == seq){
+            for(i=0;i<5;i++) bottle_count_array[i] = rec[2*i+1] | ((unsigned int)rec[2*i+2] << 8);
+            history_started = rec[11] | ((unsigned int)rec[12] << 8) | ((unsigned long)rec[13] << 16) | ((unsigned long)rec[14] << 24);
+            return;
+        }
+    }
+}
 
-    // The next three lines of code perform the required operations to
-    // initiate a EEPROM write
-    EECON2 = 0x55;          // Part of required sequence for write to internal EEPROM
-    EECON2 = 0xAA;          // Part of required sequence for write to internal EEPROM
-    EECON1bits.WR = 1;      // Part of required sequence for write to internal EEPROM
+unsigned char history_free(void){
+    //An empty slot, else the one holding the oldest run
+    unsigned char slot, oldest = 0, seq, oldseq = 0;
 
-    // Loop until write operation is complete
-    while(PIR2bits.EEIF == 0)
-    {
-        continue;   // Do nothing, are just waiting
+    for(slot=0;slot<HISTORYSLOTS;slot++){
+        if(!eeprom_read_record(HISTORYADDR(slot), &seq, 1)) return slot;
+        if(slot == 0 || (signed char)(seq - oldseq) < 0){
+            oldest = slot;
+            oldseq = seq;
+        }
     }
-
-    PIR2bits.EEIF = 0;      //Clearing EEIF bit (this MUST be cleared in software after each write)
-    EECON1bits.WREN = 0;    // Disable write (for safety, it is re-enabled next time a EEPROM write is performed)
+    return oldest;
 }
 
 void savedata(void) {
-//    for(i=19;i--;i>=0){
-//        eeprom_writebyte(25+i, eeprom_readbyte(20+i));
-//    }
-//    for(i=0;i++;i<5){
-//        eeprom_writebyte((20+i), bottle_count_array[i]); 
-//    }
-    eeprom_writebyte(44, eeprom_readbyte(39));
-    eeprom_writebyte(43, eeprom_readbyte(38));
-    eeprom_writebyte(42, eeprom_readbyte(37));
-    eeprom_writebyte(41, eeprom_readbyte(36));
-    eeprom_writebyte(40, eeprom_readbyte(35));
-    
-    eeprom_writebyte(39, eeprom_readbyte(34));
-    eeprom_writebyte(38, eeprom_readbyte(33));
-    eeprom_writebyte(37, eeprom_readbyte(32));
-    eeprom_writebyte(36, eeprom_readbyte(31));
-    eeprom_writebyte(35, eeprom_readbyte(30));
-    
-    eeprom_writebyte(34, eeprom_readbyte(29));
-    eeprom_writebyte(33, eeprom_readbyte(28));
-    eeprom_writebyte(32, eeprom_readbyte(27));
-    eeprom_writebyte(31, eeprom_readbyte(26));
-    eeprom_writebyte(30, eeprom_readbyte(25));
-    
-    eeprom_writebyte(29, eeprom_readbyte(34));
-    eeprom_writebyte(28, eeprom_readbyte(23));
-    eeprom_writebyte(27, eeprom_readbyte(22));
-    eeprom_writebyte(26, eeprom_readbyte(21));
-    eeprom_writebyte(25, eeprom_readbyte(20));
+    //Each save of the run is a new committed record in a free slot, so
+    //the previous runs and the run's last checkpoint stay intact until it
+    //is complete. The checkpoint is dropped after, the queue is FIFO
+    unsigned char slot;
+    unsigned char rec[HISTORYRECLEN];
+    unsigned long n;
     
-    eeprom_writebyte(24, bottle_count_array[4]);
-    eeprom_writebyte(23, bottle_count_array[3]);
-    eeprom_writebyte(22, bottle_count_array[2]);
-    eeprom_writebyte(21, bottle_count_array[1]);
-    eeprom_writebyte(20, bottle_count_array[0]);
-}
\ No newline at end of file
+    if(run_slot == HISTORYSLOTS){
+        run_seq = 0;
+        history_newest(&run_seq);
+        run_seq += 1;
+    }
+    slot = history_free();
+    rec[0] = run_seq;
+    for(i=0;i<5;i++){
+        n = bottle_count_array[i] > 0xFFFF ? 0xFFFF : bottle_count_array[i];
+        rec[2*i+1] = (unsigned char)n;
+        rec[2*i+2] = (unsigned char)(n >> 8);
+    }
+    for(i=0;i<4;i++) rec[11+i] = (unsigned char)(run_started >> (8*i));
+    eeprom_write_record(HISTORYADDR(slot), rec, HISTORYRECLEN - 1);
+    if(run_slot != HISTORYSLOTS) eeprom_invalidate_record(HISTORYADDR(run_slot));
+    run_slot = slot;
+}
@@ -3,38 +3,45 @@
 
 //FUNCTIONS
 void set_time(void);
-int dec_to_hex(int num);
 void date_time(void);
 void read_time(void);
-void bottle_count(void);
-void bottle_count1(void);
-void bottle_count2(void);
-void bottle_count3(void);
-void bottle_count4(void);
+void bottle_counts(void);
 void bottle_time(void);
+void throughput(void);
 void standby(void);
 void operation(void);
+void operation_dual(void);
+void bottle_decide(void);
 void operationend(void);
 void emergencystop(void);
 void servo_rotate0(int degree);
 void servo_rotate1(int degree);
 void read_colorsensor(void);
-uint8_t eeprom_readbyte(uint16_t);
-void eeprom_writebyte(uint16_t, uint8_t);
+unsigned char history_newest(unsigned char *seq);
+unsigned char history_free(void);
+void load_history(unsigned char age);
 void savedata(void);
+void key_event(const kp_event_t *e);
+void idle_ms(unsigned int ms);
+void ui_enter(unsigned char next);
+void run_start(void);
+void run_stop(void);
+void estop(void);
+void sensor_readout(void);
+void log_readout(void);
+void calibrate(void);
+void calibration(void);
+void run_resume(void);
+void bus_recover(void);
 
 
 //VARIABLES
-int i;
-int j;
-const char keys[] = "123A456B789C*0#D";
-const char timeset[7] = {   0x30, //Seconds 
-                            0x19, //Minutes
-                            0x13, //Hour, 24 hour mode
-                            0x02, //Day of the week, Monday = 1
-                            0x11, //Day/Date
-                            0x04, //Month
-                            0x17};//Year, last two digits
+//Defined in main.c. persistent ones are what a run resumes with after a
+//watchdog reset, see watchdog.h. XC8 doesn't clear them, main() does on
+//a cold start
+extern int i;
+extern int j;
+extern const char timeset[7];   //Written by set_time()
 
 enum state {
         STANDBY,
@@ -47,19 +54,47 @@ enum state {
         BOTTLECOUNT2,
         BOTTLECOUNT3,
         BOTTLECOUNT4,
-        BOTTLETIME
+        BOTTLETIME,
+        THROUGHPUT,
+        CALIBRATE
     };
-enum state curr_state;
+extern persistent enum state curr_state;
+extern enum state last_state;   //For state transition telemetry
 
-unsigned char time[7];
-unsigned char start_time[2];
-unsigned char end_time[2];
-int stime;
-int etime;
-int operation_time;
-int temp;
+//Screens, one row per enum state in the same order. history is the run
+//load_history() brings in when a key enters the screen, -1 for none.
+//Entering the screen already shown steps through its pages
+typedef struct {
+    void (*render)(void);
+    signed char history;
+    unsigned char pages;
+    unsigned int refresh_ms;    //Wait after drawing, cut short by a key
+} screen_t;
+extern const screen_t screens[];
 
+//Keys, action runs first and may be NULL, then next is entered
+#define NOSTATE             0xFF
+typedef struct {
+    unsigned char key;
+    void (*action)(void);
+    unsigned char next;
+} keybind_t;
+extern const keybind_t keymap[];
 
+extern unsigned char time[7];
+extern persistent unsigned long run_begin;     //clk_millis() at the start of the run
+extern persistent unsigned long run_started;   //clk_now() at the start of the run, saved with it
+extern unsigned long run_ms;    //Length of the last run
+extern persistent unsigned long bottle_in;     //clk_millis() at the bottle's first sample
+extern persistent unsigned int batch_count;    //Bottles since the last batch ended
+extern persistent unsigned char run_ending;    //Batch done, waiting out BATCHENDMS
+extern persistent unsigned char run_idle;      //IDLESTOP reached, isr() leaves run_stop() to operation()
+extern persistent unsigned long run_end_at;
+extern persistent unsigned char run_slot;      //History slot holding this run, HISTORYSLOTS before the first save
+extern persistent unsigned char run_seq;
+extern int temp;
+extern unsigned char bus_stuck; //bus_recover() didn't clear the error
+extern unsigned long bus_stuck_at;
 
 //For bottle count
 //0 = Total
@@ -67,36 +102,99 @@ int temp;
 //2 = YOP - CAP
 //3 = ESKA + CAP
 //4 = ESKA - CAP
-int bottle_count_disp[5] = -1; //Data for bottle display screen
-int bottle_count_array[5];
-
-int operation_disp = 0;         //Data for operation running animation
-int operation_timeout = 0;
-unsigned int color[4];          //Stores TCS data in form clear, red, green, blue
-unsigned int colorprev[4];
-unsigned char color_low[4];     //For reading colors
-unsigned char color_high[4];
-
-int servo0_timer;       //1250 = 1ms
-int servo1_timer;       
-char servo0_flag;
-char servo1_flag;
-
-//Bottle Detection Logic
-int flag_bottle;
-int flag_bottle_high;
-int flag_top_read;
-int flag_yopNC;
-int flag_picbug;
-int flag_eskaC;
-int bottle_read_top;
-int bottle_read_bot;
-float r, b, r_p, b_p;
+extern persistent unsigned long bottle_count_array[5];
+extern unsigned long history_started;   //run_started of the run load_history() brought in, 0 for none
+extern unsigned char ui_page;   //Page of the screen shown, see screens[]
+
+extern int operation_disp;      //Data for operation running animation
+extern persistent int operation_timeout;
+extern persistent unsigned long operation_ticks;   //operation() samples since the run started
+extern evlog_rec_t ev_rec;      //Event log read-out
+extern persistent unsigned int color[4];       //Stores TCS data in form clear, red, green, blue
+extern persistent unsigned int colorprev[4];
+extern persistent unsigned int colorprev2[4];   //Sample before colorprev, read_bot is taken from it
+extern unsigned char color_low[4];  //For reading colors
+extern unsigned char color_high[4];
+
+extern persistent int servo0_timer;            //Position, picks the pulse width in isr()
+extern persistent int servo1_timer;
+extern char servo0_flag;
+extern char servo1_flag;
+
+//Bottle Detection Logic, tested on every sample. Fields are as wide as
+//their values and det is near, in the access bank, so most tests are a
+//single bit instruction with no bank switch
+typedef struct {
+    uint8_t picbug;             //Samples of this bottle, held at 255
+    unsigned bottle : 1;        //Something in front of the sensor
+    unsigned yopNC : 1;         //Red or green above NOCAPDISTINGUISH
+    unsigned decided : 1;       //Two sensors: counted, waiting for the trailing edge
+    unsigned eskaC : 2;         //Cap samples bluer than red, held at 2
+    unsigned top_read : 2;      //Cap classified, two sensors: cap samples up to 2
+    unsigned bottle_high : 2;   //Body in view, two sensors: body samples up to 2
+    unsigned read_top : 2;      //0 = neither, 1 = YOP, 2 = ESKA
+    unsigned read_bot : 2;
+} det_t;
+extern near persistent det_t det;
 
 //CONSTANTS
 #define MAINPOLLINGDELAYMS  10
-#define AMBIENTTCSCLEAR     18
-#define TCSBOTTLEHIGH       30
-#define NOCAPDISTINGUISH    130
+#define REPEATKEYS          (KP_BIT(KP_2) | KP_BIT(KP_4) | KP_BIT(KP_5) | KP_BIT(KP_6) | KP_BIT(KP_B))
+
+//Tunable over the telemetry link, see param.h for defaults and limits
+#define TCSBOTTLEHIGH       param[P_BOTTLEHIGH]
+#define NOCAPDISTINGUISH    param[P_NOCAPDISTINGUISH]
+#define TOPYOPRATIO         param[P_TOPYOPRATIO]
+#define TOPESKARATIO        param[P_TOPESKARATIO]
+#define BOTYOPRATIO         param[P_BOTYOPRATIO]
+#define BOTESKARATIO        param[P_BOTESKARATIO]
+#define TOPYOPRED           param[P_TOPYOPRED]
+#define BOTYOPRED           param[P_BOTYOPRED]
+#define BOTTLEMINSAMPLES    param[P_MINSAMPLES]
+#define BATCHSIZE           param[P_BATCHSIZE]
+#define CONTINUOUS          param[P_CONTINUOUS]
+#define IDLESTOP            param[P_IDLESTOP]
+#define LUTCLASSIFIER       param[P_CLASSIFIER]
+#define BATCHENDMS          1000    //Lets the last bottle of a batch reach its chute
+#define BUSRETRYMS          100     //Between bus_recover() tries while the bus stays stuck
+
+//Timers, turned into reloads and prescalers by timers.h. A servo frame
+//on TMR1/TMR3 is the pulse then SERVO_LOW_US; the two pulse widths are
+//the two positions of each servo. IDLESTOP counts IDLESTOP_MS steps of
+//IDLETICKS TMR0 overflows, more than one where the clock outruns 1:256
+#define SERVO_LOW_US        19608
+#define SERVO_SHORT_US      1014
+#define SERVO_LONG_US       1414
+#define SERVO_PS            TMR16_PS(SERVO_LOW_US)
+#define SERVO_LOW           TMR16_RELOAD(SERVO_LOW_US, SERVO_PS)
+#define SERVO_SHORT         TMR16_RELOAD(SERVO_SHORT_US, SERVO_PS)
+#define SERVO_LONG          TMR16_RELOAD(SERVO_LONG_US, SERVO_PS)
+#define IDLESTOP_MS         6700
+#define IDLETICKS           (TMR0_PS(IDLESTOP_MS) ? 1 : TMR0_PS(IDLESTOP_MS / 2) ? 2 : \
+                             TMR0_PS(IDLESTOP_MS / 4) ? 4 : 8)
+#define IDLETICK_MS         (IDLESTOP_MS / IDLETICKS)
+#define IDLETICK_PS         TMR0_PS(IDLETICK_MS)
+
+//Sample spacing. The thresholds, the spike filter and BOTTLEMINSAMPLES
+//were tuned on samples a 10 kHz read plus one 2.4 ms integration apart.
+//A faster bus pads what its reads save back in: SAMPLE_BITS is one
+//read_colorsensor(), a two sensor pass is two of those and two selects
+#define TUNED_I2C_HZ        10000UL
+#define SAMPLE_BITS         83UL    //Start, address, 8 bytes, stop
+#define SELECT_BITS         20UL    //Start, address, control, stop
+#define BUS_US(bits, hz)    ((bits) * 1000000UL / (hz))
+#define BUS_SAVED_US(bits)  (BUS_US(bits, TUNED_I2C_HZ) - BUS_US(bits, I2C_HZ))
+#define SAMPLEPAD_US        (2400 + BUS_SAVED_US(SAMPLE_BITS))
+#define DUALPAD_US          BUS_SAVED_US(2 * SAMPLE_BITS + 2 * SELECT_BITS)
+
+//Run history in internal EEPROM, one committed record per run:
+//[marker][sequence][total][YOP+C][YOP-C][ESKA+C][ESKA-C][started]
+//Counts are u16 little endian, held at 65535, started is the run's
+//clk_now() as u32. A run that checkpoints writes a new copy and drops
+//the old one once the new is committed
+#define HISTORYBASE         96
+#define HISTORYSLOTS        6       //Latest + 4 previous + 1 being written
+#define HISTORYRECLEN       16
+#define HISTORYADDR(slot)   (HISTORYBASE + (slot)*HISTORYRECLEN)
 
 #endif	/* MAIN_H */
\ No newline at end of file
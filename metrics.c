@@ -0,0 +1,69 @@
+/*
+ * File:   metrics.c
+ * Author: Administrator
+ *
+ * Run throughput, see metrics.h.
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include "metrics.h"
+
+persistent metrics_t mt;
+
+static uint16_t mt_clip(uint32_t ms){
+    return ms > 0xFFFE ? 0xFFFE : (uint16_t)ms;
+}
+
+static uint16_t mt_per_min(uint32_t gap){
+    //x10, a gap under one clock tick reads as no rate
+    return gap < 10 ? 0 : (uint16_t)(600000UL / gap);
+}
+
+static uint8_t mt_bucket(uint16_t ms, uint16_t base){
+    //Buckets double in width, at most MT_BUCKETS - 1 shifts
+    uint8_t b = 0;
+    while(b < MT_BUCKETS - 1 && ms >= base){
+        base <<= 1;
+        b += 1;
+    }
+    return b;
+}
+
+void mt_start(void){
+    uint8_t b;
+
+    mt.bottles = 0;
+    mt.gap_last = 0;
+    mt.gap_min = MT_NONE;
+    for(b=0;b<MT_BUCKETS;b++){
+        mt.gap_hist[b] = 0;
+        mt.dwell_hist[b] = 0;
+    }
+}
+
+void mt_bottle(uint32_t arrived, uint32_t dwell){
+    uint16_t gap;
+
+    if(mt.bottles == 0xFFFF) return;
+    if(mt.bottles == 0) mt.first = arrived;
+    else{
+        gap = mt_clip(arrived - mt.last);
+        mt.gap_last = gap;
+        if(gap < mt.gap_min) mt.gap_min = gap;
+        mt.gap_hist[mt_bucket(gap, MT_GAP_BASE_MS)] += 1;
+    }
+    mt.dwell_hist[mt_bucket(mt_clip(dwell), MT_DWELL_BASE_MS)] += 1;
+    mt.last = arrived;
+    mt.bottles += 1;
+}
+
+uint16_t mt_rate_now(void){
+    if(mt.bottles < 2) return 0;
+    return mt_per_min(mt.gap_last);
+}
+
+uint16_t mt_rate_avg(void){
+    if(mt.bottles < 2) return 0;
+    return mt_per_min((mt.last - mt.first) / (mt.bottles - 1));
+}
@@ -0,0 +1,39 @@
+/*
+ * File:   metrics.h
+ * Author: Administrator
+ *
+ * Throughput of the current run, updated once per sorted bottle in a
+ * fixed number of steps: rate now and on average, the closest two
+ * bottles have been, and histograms of the gap between bottles and of
+ * how long each one sat in front of the sensor. A short gap histogram
+ * with a wide dwell one points at the sorter, a long gap one at the line.
+ */
+
+#ifndef METRICS_H
+#define	METRICS_H
+
+#include <stdint.h>
+
+#define MT_BUCKETS          8
+#define MT_GAP_BASE_MS      250     //Gap buckets <250, <500 .. <16000, the rest
+#define MT_DWELL_BASE_MS    25      //Dwell buckets <25, <50 .. <1600, the rest
+#define MT_NONE             0xFFFF  //gap_min before the second bottle
+
+typedef struct {
+    uint16_t bottles;
+    uint32_t first;                 //clk_millis() the first bottle arrived
+    uint32_t last;
+    uint16_t gap_last;              //ms, arrival to arrival
+    uint16_t gap_min;
+    uint16_t gap_hist[MT_BUCKETS];
+    uint16_t dwell_hist[MT_BUCKETS];
+} metrics_t;
+
+extern persistent metrics_t mt;
+
+void mt_start(void);
+void mt_bottle(uint32_t arrived, uint32_t dwell);
+uint16_t mt_rate_now(void);         //Bottles/min x10, from the last gap
+uint16_t mt_rate_avg(void);         //Bottles/min x10, first to last bottle
+
+#endif	/* METRICS_H */
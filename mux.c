@@ -0,0 +1,38 @@
+/*
+ * File:   mux.c
+ * Author: Administrator
+ *
+ * TCA9548A channel selection, see mux.h.
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include "configBits.h"
+#include "I2C.h"
+#include "mux.h"
+
+#define MUX_W               0b11100000  //7bit address 0x70 + Write
+#define MUX_NONE            0xFF
+
+persistent uint8_t mux_dual;            //Persistent, a warm start doesn't probe (watchdog.h)
+static persistent uint8_t mux_ch;       //Channel last written, saves a transaction per read
+
+void mux_init(void){
+    mux_dual = I2C_Master_Probe(MUX_W); //Nobody at 0x70, one sensor on the main bus
+    if(mux_dual) I2C_Master_Write(1 << MUX_TOP);
+    I2C_Master_Stop();
+    mux_ch = mux_dual ? MUX_TOP : MUX_NONE;
+}
+
+void mux_select(uint8_t ch){
+    if(!mux_dual || ch == mux_ch) return;
+    I2C_Master_Start();
+    I2C_Master_Write(MUX_W);
+    I2C_Master_Write(1 << ch);
+    I2C_Master_Stop();
+    mux_ch = i2c_err ? MUX_NONE : ch;   //Not sure it took, written again next time
+}
+
+void mux_reset(void){
+    if(mux_dual) mux_ch = MUX_NONE;
+}
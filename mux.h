@@ -0,0 +1,31 @@
+/*
+ * File:   mux.h
+ * Author: Administrator
+ *
+ * TCA9548A I2C multiplexer for a second TCS34725. Both sensors answer at
+ * 0x29, so each sits on its own downstream channel: the top one looks at
+ * the cap, the bottom one at the bottle body. A write to the mux control
+ * register connects the channels whose bits are set until the next
+ * write. The RTC and the 24LC256 stay on the main bus and are reachable
+ * whatever is selected.
+ *
+ * Boards with one sensor have no mux and keep it on the main bus.
+ * mux_init() tells the two apart by whether the mux acknowledges its
+ * address, and mux_select() does nothing without one.
+ */
+
+#ifndef MUX_H
+#define	MUX_H
+
+#include <stdint.h>
+
+#define MUX_TOP             0       //Downstream channel of the cap sensor
+#define MUX_BOT             1       //Body sensor
+
+extern persistent uint8_t mux_dual; //Mux found, both sensors fitted
+
+void mux_init(void);                //Probes for the mux, leaves MUX_TOP selected
+void mux_select(uint8_t ch);
+void mux_reset(void);               //Channel unknown after a bus recovery, the next select writes it
+
+#endif	/* MUX_H */
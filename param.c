@@ -0,0 +1,131 @@
+/*
+ * File:   param.c
+ * Author: Administrator
+ *
+ * Parameter table, validation, EEPROM persistence and the serial get/set
+ * commands.
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include "configBits.h"
+#include "eeprom.h"
+#include "evlog.h"
+#include "telemetry.h"
+#include "param.h"
+
+#if 2 * PARAM_COUNT + 2 > EE_QUEUE_SIZE
+#error "A param_commit() record and its markers don't fit the EEPROM queue"
+#endif
+
+typedef struct {
+    uint16_t def;
+    uint16_t min;
+    uint16_t max;
+} param_limit_t;
+
+static const param_limit_t param_limits[PARAM_COUNT] = {
+    {18,  1, 1000},                         //P_AMBIENTCLEAR
+    {30,  2, 2000},                         //P_BOTTLEHIGH
+    {130, 1, 65535},                        //P_NOCAPDISTINGUISH
+    {200, 1, 2000},                         //P_TOPYOPRATIO, 2.00
+    {75,  1, 2000},                         //P_TOPESKARATIO, 0.75
+    {320, 1, 2000},                         //P_BOTYOPRATIO, 3.20
+    {75,  1, 2000},                         //P_BOTESKARATIO, 0.75
+    {16,  0, 1000},                         //P_TOPYOPRED
+    {18,  0, 1000},                         //P_BOTYOPRED
+    {20,  EVLOG_MIN_SAMPLES - 1, 200},      //P_MINSAMPLES, keeps the log bus budget
+    {10,  1, 65535},                        //P_BATCHSIZE
+    {0,   0, 1},                            //P_CONTINUOUS
+    {4,   0, 255},                          //P_IDLESTOP
+    {10,  1, 1000},                         //P_AMBIENTMARGIN
+    {0,   0, 1},                            //P_CLASSIFIER
+};
+
+uint16_t param[PARAM_COUNT];
+static uint8_t param_pending;           //Commit asked for, param_poll() writes it
+static uint8_t param_running;           //Run going at the last param_poll()
+
+static uint8_t param_check(uint8_t id, uint16_t value){
+    if(id >= PARAM_COUNT) return PARAM_EID;
+    if(value < param_limits[id].min || value > param_limits[id].max) return PARAM_ERANGE;
+    if(id == P_AMBIENTCLEAR && value >= param[P_BOTTLEHIGH]) return PARAM_EORDER;
+    if(id == P_BOTTLEHIGH && value <= param[P_AMBIENTCLEAR]) return PARAM_EORDER;
+    return PARAM_OK;
+}
+
+void param_defaults(void){
+    uint8_t id;
+
+    for(id=0;id<PARAM_COUNT;id++) param[id] = param_limits[id].def;
+}
+
+void param_init(void){
+    //Stored values are used only if the record is committed and every
+    //value still passes the current limits
+    uint8_t id;
+
+    if(!eeprom_read_record(PARAMADDR, (uint8_t *)param, sizeof(param))){
+        param_defaults();
+        return;
+    }
+    for(id=0;id<PARAM_COUNT;id++){
+        if(param_check(id, param[id]) != PARAM_OK){
+            param_defaults();
+            return;
+        }
+    }
+}
+
+uint8_t param_set(uint8_t id, uint16_t value){
+    uint8_t status = param_check(id, value);
+
+    if(status == PARAM_OK) param[id] = value;
+    return status;
+}
+
+void param_commit(void){
+    eeprom_write_record(PARAMADDR, (const uint8_t *)param, sizeof(param));
+}
+
+void param_poll(uint8_t running){
+    //A commit is 2 * PARAM_COUNT + 2 EEPROM writes, ~4 ms each. During a
+    //run they would hold up the next checkpoint, so a commit waits for
+    //the run to end and the queue to drain. A reset before that loses it
+    param_running = running;
+    if(!param_pending || running || eeprom_busy()) return;
+    param_pending = 0;
+    param_commit();
+}
+
+static void param_reply(uint8_t id, uint8_t status){
+    uint8_t payload[4];
+    uint16_t value = (id < PARAM_COUNT) ? param[id] : 0;
+
+    payload[0] = id;
+    payload[1] = (uint8_t)value;
+    payload[2] = (uint8_t)(value >> 8);
+    payload[3] = status;
+    tlm_send(TLM_PARAM, payload, sizeof(payload));
+}
+
+void param_command(uint8_t type, const uint8_t *payload, uint8_t len){
+    switch(type){
+        case TLM_CMD_GET:
+            if(len != 1) return;
+            param_reply(payload[0], payload[0] < PARAM_COUNT ? PARAM_OK : PARAM_EID);
+            break;
+        case TLM_CMD_SET:
+            if(len != 3) return;
+            param_reply(payload[0], param_set(payload[0], payload[1] | (payload[2] << 8)));
+            break;
+        case TLM_CMD_COMMIT:
+            param_pending = 1;
+            param_reply(0xFF, param_running ? PARAM_DEFERRED : PARAM_OK);
+            break;
+        case TLM_CMD_DEFAULTS:
+            param_defaults();
+            param_reply(0xFF, PARAM_OK);
+            break;
+    }
+}
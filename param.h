@@ -0,0 +1,58 @@
+/*
+ * File:   param.h
+ * Author: Administrator
+ *
+ * Runtime tunable detection/classification thresholds. The table is a
+ * plain global array indexed by constants, so reading a parameter costs
+ * the same as reading any other global. Values are changed over the
+ * telemetry link and committed to internal EEPROM.
+ */
+
+#ifndef PARAM_H
+#define	PARAM_H
+
+#include <stdint.h>
+
+#define P_AMBIENTCLEAR      0   //Clear level above which a bottle is present, until ambient.c has a baseline
+#define P_BOTTLEHIGH        1   //Clear level of the bottle body
+#define P_NOCAPDISTINGUISH  2   //Red/green level marking a YOP without cap
+#define P_TOPYOPRATIO       3   //Cap red/blue x100 above which it is YOP
+#define P_TOPESKARATIO      4   //Cap red/blue x100 below which it is ESKA
+#define P_BOTYOPRATIO       5   //Body red/blue x100 above which it is YOP
+#define P_BOTESKARATIO      6   //Body red/blue x100 below which it is ESKA
+#define P_TOPYOPRED         7   //Minimum cap red for a YOP decision
+#define P_BOTYOPRED         8   //Minimum body red for a YOP decision
+#define P_MINSAMPLES        9   //Samples before a bottle is counted
+#define P_BATCHSIZE         10  //Bottles per batch
+#define P_CONTINUOUS        11  //0 = stop after one batch, 1 = checkpoint each batch and carry on
+#define P_IDLESTOP          12  //IDLESTOP_MS (6.7 s) steps without a bottle before the run stops, 0 = never
+#define P_AMBIENTMARGIN     13  //Clear counts above the tracked ambient that mean a bottle
+#define P_CLASSIFIER        14  //0 = red/blue ratio thresholds, 1 = lut.c tables
+#define PARAM_COUNT         15
+
+//Host side names, same order as the ids above (used by tools/tlmctl)
+#define PARAM_NAMES { "ambient_clear", "bottle_high", "nocap_distinguish", \
+                      "top_yop_ratio", "top_eska_ratio", "bot_yop_ratio",   \
+                      "bot_eska_ratio", "top_yop_red", "bot_yop_red",       \
+                      "min_samples", "batch_size", "continuous",            \
+                      "idle_stop", "ambient_margin", "classifier" }
+
+#define PARAMADDR           64  //Internal EEPROM record, 1 + 2*PARAM_COUNT bytes, full at 15 (history at 96)
+
+//param_set() status, returned to the host in TLM_PARAM frames
+#define PARAM_OK            0
+#define PARAM_EID           1   //No such parameter
+#define PARAM_ERANGE        2   //Outside the parameter's limits
+#define PARAM_EORDER        3   //Would put ambient_clear >= bottle_high
+#define PARAM_DEFERRED      4   //Commit held until the run ends
+
+extern uint16_t param[PARAM_COUNT];
+
+void param_init(void);
+void param_defaults(void);
+uint8_t param_set(uint8_t id, uint16_t value);
+void param_commit(void);
+void param_poll(uint8_t running);   //Main loop, writes a commit asked for outside a run
+void param_command(uint8_t type, const uint8_t *payload, uint8_t len);
+
+#endif	/* PARAM_H */
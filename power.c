@@ -0,0 +1,130 @@
+/*
+ * File:   power.c
+ * Author: Administrator
+ *
+ * IDLE mode waits and TCS34725 power states, see power.h.
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include "configBits.h"
+#include "I2C.h"
+#include "clock.h"
+#include "mux.h"
+#include "power.h"
+
+#define TCS_W               0b01010010  //7bit address 0x29 + Write
+#define TCS_CMD             0x80
+#define TCS_AUTOINC         0xA0
+#define TCS_CLEARINT        0xE6        //Special function, clear the RGBC interrupt
+#define TCS_ENABLE          0x00
+#define TCS_WTIME           0x03
+#define TCS_AILTL           0x04
+#define TCS_PERS            0x0C
+#define TCS_CDATAL          0x14
+
+#define TCS_PON             0x01
+#define TCS_AEN             0x02
+#define TCS_WEN             0x08
+#define TCS_AIEN            0x10
+
+volatile uint8_t pm_woke;
+uint8_t pm_gap;
+static uint32_t pm_armed_at;
+
+static void tcs_write(uint8_t reg, uint8_t value){
+    I2C_Master_Start();
+    I2C_Master_Write(TCS_W);
+    I2C_Master_Write(TCS_CMD | reg);
+    I2C_Master_Write(value);
+    I2C_Master_Stop();
+}
+
+static void tcs_command(uint8_t cmd){
+    I2C_Master_Start();
+    I2C_Master_Write(TCS_W);
+    I2C_Master_Write(cmd);
+    I2C_Master_Stop();
+}
+
+void pm_init(void){
+    uint8_t ch = mux_dual ? MUX_BOT : MUX_TOP;
+
+    OSCCONbits.IDLEN = 1;       //SLEEP enters IDLE, peripherals keep their clock
+    INTEDG0 = 0;                //Sensor INT is active low
+    INT0IE = 0;
+    pm_gap = 0;
+    do{
+        mux_select(ch);
+        tcs_write(TCS_WTIME, PM_WTIME);
+        tcs_write(TCS_PERS, 1); //One integration past the threshold
+    }while(ch-- != MUX_TOP);
+    pm_run(0);
+}
+
+void pm_resume(void){
+    //A run after a watchdog reset: the PIC side of pm_init() again, the
+    //sensors kept WTIME and PERS and go straight back to back
+    OSCCONbits.IDLEN = 1;
+    INTEDG0 = 0;
+    pm_run(1);
+}
+
+void pm_idle(void){
+    SLEEP();
+    NOP();
+}
+
+void pm_run(uint8_t on){
+    //The interrupt is enabled by pm_arm(), once the thresholds are set.
+    //With two sensors both change state, the top one is left selected
+    uint8_t ch = mux_dual ? MUX_BOT : MUX_TOP;
+
+    INT0IE = 0;
+    do{
+        mux_select(ch);
+        if(on) tcs_write(TCS_ENABLE, TCS_PON | TCS_AEN);
+        else tcs_write(TCS_ENABLE, TCS_PON | TCS_AEN | TCS_WEN);
+        tcs_command(TCS_AUTOINC | TCS_CDATAL);  //read_colorsensor() only reads
+    }while(ch-- != MUX_TOP);
+    pm_gap = 0;
+}
+
+void pm_arm(uint16_t above){
+    //AILT = 0 never trips, AIHT = above. Only the top sensor's INT is
+    //wired to RB0, a bottle covers both at once
+    mux_select(MUX_TOP);
+    I2C_Master_Start();
+    I2C_Master_Write(TCS_W);
+    I2C_Master_Write(TCS_AUTOINC | TCS_AILTL);
+    I2C_Master_Write(0);
+    I2C_Master_Write(0);
+    I2C_Master_Write((uint8_t)above);
+    I2C_Master_Write((uint8_t)(above >> 8));
+    I2C_Master_Stop();
+    //Flag cleared before the interrupt, so an edge from here on is seen.
+    //A status left over from an earlier integration is cleared before
+    //AIEN can drive the pin with it
+    INT0IE = 0;
+    INT0IF = 0;
+    pm_woke = 0;
+    tcs_command(TCS_CLEARINT);
+    tcs_write(TCS_ENABLE, TCS_PON | TCS_AEN | TCS_AIEN);
+    INT0IE = 1;
+    tcs_command(TCS_AUTOINC | TCS_CDATAL);
+    pm_armed_at = clk_millis();
+    pm_gap = 1;
+}
+
+uint8_t pm_gap_over(void){
+    //Sensor INT, or the PM_GAPPOLLMS fallback in case an edge was missed
+    if(pm_woke || clk_millis() - pm_armed_at >= PM_GAPPOLLMS){
+        pm_gap = 0;
+        return 1;
+    }
+    return 0;
+}
+
+void pm_sensor_isr(void){
+    pm_woke = 1;
+}
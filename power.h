@@ -0,0 +1,45 @@
+/*
+ * File:   power.h
+ * Author: Administrator
+ *
+ * Power manager. Waiting is done in IDLE mode (IDLEN = 1, SLEEP), which
+ * stops the CPU but keeps the timers running, so the keypad tick and the
+ * clock carry on and any interrupt wakes it: the 10 ms TMR2 tick, INT1
+ * from the keypad, the EUSART, or INT0 from the TCS34725.
+ *
+ * Outside a run the sensor cycles through its wait state (WEN, WTIME)
+ * and spends most of its time there. During a run it integrates back to
+ * back, and between bottles its clear channel threshold interrupt is
+ * armed so the PIC can idle until something is in front of it. The
+ * sensor INT output (open drain, active low) goes to RB0/INT0 with a
+ * pull-up. With the second sensor behind the mux (mux.h) both follow
+ * the run, and the top one carries the threshold interrupt.
+ *
+ * Wake to first valid sample: INT asserts at the end of the integration
+ * that crossed the threshold. operation() reads that data and drops it,
+ * as the read straddles the next integration's end, and keeps the read
+ * after it. The cost is the interrupt, one pass of the main loop and two
+ * reads, 7.1 ms each with I2C at 10 kHz. The simulator reports INT to the
+ * first read and to the first kept sample.
+ */
+
+#ifndef POWER_H
+#define	POWER_H
+
+#include <stdint.h>
+
+#define PM_WTIME            216     //Wait of (256 - 216) x 2.4 ms = 96 ms between standby integrations
+#define PM_GAPPOLLMS        100     //Sample anyway this long after arming
+
+extern volatile uint8_t pm_woke;    //Sensor INT since the last pm_arm()
+extern uint8_t pm_gap;              //Run idling between bottles
+
+void pm_init(void);
+void pm_resume(void);               //pm_init() and pm_run(1) after a watchdog reset
+void pm_idle(void);
+void pm_run(uint8_t on);            //Sensor back to back with INT, or in its wait state
+void pm_arm(uint16_t above);        //Interrupt on a clear count above this
+uint8_t pm_gap_over(void);          //Time to sample again
+void pm_sensor_isr(void);
+
+#endif	/* POWER_H */
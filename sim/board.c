@@ -0,0 +1,83 @@
+/*
+ * File:   board.c
+ *
+ * Shared setup and run loop of the simulator programs. The firmware's
+ * main() never returns, so sim_finish() leaves it with a long jump; a
+ * 1s wall clock alarm catches loops that never touch a register and runs
+ * simulated time on under them, see sim_spin(). A WDT reset jumps back
+ * with sim_restart() and starts main() again.
+ */
+
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include "board.h"
+
+extern void fw_main(void);
+extern char __start_fwbss[], __stop_fwbss[];    //Firmware RAM but persistent, see the Makefile
+
+static sigjmp_buf finish_jmp;
+static const char *finish_why;
+static volatile uint64_t watched_cycles;
+
+void sim_finish(const char *why){
+    finish_why = why;
+    siglongjmp(finish_jmp, 1);
+}
+
+void sim_restart(void){
+    siglongjmp(finish_jmp, 2);
+}
+
+static void stall_check(int sig){
+    (void)sig;
+    if(sim_cycles == watched_cycles){
+        sim_spin();
+        sim_finish("firmware stalled (no SFR access for 1s)");
+    }
+    watched_cycles = sim_cycles;
+    alarm(1);
+}
+
+void board_init(board_t *b, scenario_t *sc){
+    sim_init();
+    memset(sim_eeprom, 0xFF, sizeof(sim_eeprom));
+
+    tcs34725_init(&b->tcs, "tcs34725", scenario_light, sc);
+    tcs34725_wire_int(&b->tcs, 1, 0);       //RB0/INT0
+    ds1307_init(&b->rtc, "ds1307");
+    eeprom24_init(&b->ext, "24lc256");
+    mssp_attach(&b->ext.dev);
+    mssp_attach(&b->rtc.dev);
+    mssp_attach(&b->tcs.dev);
+    b->dual = sc->dual;
+    if(b->dual){
+        //Only the top sensor's INT is wired, see power.h
+        tcs34725_init(&b->tcsb, "tcs34725b", scenario_light_bottom, sc);
+        tca9548a_init(&b->mux, "tca9548a");
+        tca9548a_connect(&b->mux, &b->tcs.dev, 0);
+        tca9548a_connect(&b->mux, &b->tcsb.dev, 1);
+        mssp_attach(&b->tcsb.dev);
+        mssp_attach(&b->mux.dev);
+    }
+    if(sc->rtc_set){
+        int *t = sc->rtc;
+        ds1307_set(&b->rtc, t[0], t[1], t[2], t[3], t[4], t[5]);
+    }
+    scenario_start(sc);
+}
+
+const char *board_run(void){
+    if(sigsetjmp(finish_jmp, 1) != 1){
+        //XC8's start up code clears RAM that isn't persistent
+        memset(__start_fwbss, 0, __stop_fwbss - __start_fwbss);
+        signal(SIGALRM, stall_check);
+        watched_cycles = sim_cycles - 1;
+        alarm(1);
+        fw_main();
+        finish_why = "main() returned";
+    }
+    alarm(0);
+    return finish_why;
+}
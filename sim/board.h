@@ -0,0 +1,34 @@
+/*
+ * File:   board.h
+ *
+ * The sorter board as the simulator programs see it: the PIC model with
+ * the TCS34725, DS1307 and 24LC256 on the I2C bus, driven by a scenario.
+ * Scenarios with a bottom sensor add the TCA9548A with the two TCS34725s
+ * on its channels 0 (top) and 1 (bottom).
+ */
+
+#ifndef BOARD_H
+#define BOARD_H
+
+#include "pic18.h"
+#include "tcs34725.h"
+#include "tca9548a.h"
+#include "ds1307.h"
+#include "eeprom24.h"
+#include "scenario.h"
+
+typedef struct {
+    tcs34725_t tcs;             //Top sensor when there are two
+    tcs34725_t tcsb;
+    tca9548a_t mux;
+    int dual;
+    ds1307_t rtc;
+    eeprom24_t ext;
+} board_t;
+
+//Sets up the simulator, the devices and the scenario's stimulus
+void board_init(board_t *b, scenario_t *sc);
+//Runs the firmware until the scenario ends or it stalls, returns why it stopped
+const char *board_run(void);
+
+#endif
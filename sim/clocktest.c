@@ -0,0 +1,153 @@
+/*
+ * File:   clocktest.c
+ *
+ * Checks clock.c against the C library on the host. rtc_to_epoch() is
+ * compared with timegm() for every day from 2000 to 2099 at the first and
+ * last second, which covers the leap days and each month and year
+ * boundary, and with the fallbacks for an unset DS1307. clk_tick_isr()
+ * is run for a second's and a day's worth of ticks, CLK_TICK_US each,
+ * to check that the counters keep the real tick length and carry.
+ *
+ *   clocktest
+ *
+ * Prints the first mismatches and exits 1 if there were any.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "configBits.h"
+#include "timers.h"
+#include "keypad.h"
+#include "clock.h"
+
+#undef printf                   //xc.h sends it to the LCD
+
+static int failures;
+
+static uint8_t bcd(int v){
+    return (uint8_t)((v / 10) << 4 | v % 10);
+}
+
+static void set_regs(uint8_t *reg, int y, int mo, int d, int h, int mi, int s){
+    reg[0] = bcd(s);
+    reg[1] = bcd(mi);
+    reg[2] = bcd(h);
+    reg[3] = 1;                         //Day of the week, not used
+    reg[4] = bcd(d);
+    reg[5] = bcd(mo);
+    reg[6] = bcd(y - CLK_YEAR0);
+}
+
+static time_t utc(int y, int mo, int d, int h, int mi, int s){
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = y - 1900;
+    tm.tm_mon = mo - 1;
+    tm.tm_mday = d;
+    tm.tm_hour = h;
+    tm.tm_min = mi;
+    tm.tm_sec = s;
+    return timegm(&tm);
+}
+
+static void check(const char *what, const uint8_t *reg, uint32_t want){
+    uint32_t got = rtc_to_epoch(reg);
+
+    if(got == want) return;
+    if(++failures <= 10){
+        printf("FAIL %s: %02x %02x %02x %02x/%02x/%02x gives %lu, want %lu\n", what,
+               reg[2], reg[1], reg[0], reg[6], reg[5], reg[4], (unsigned long)got, (unsigned long)want);
+    }
+}
+
+static void calendar(void){
+    time_t base = utc(CLK_YEAR0, 1, 1, 0, 0, 0);
+    uint8_t reg[7];
+    int days = 0;
+
+    for(int y = CLK_YEAR0; y < CLK_YEAR0 + 100; y++){
+        for(int mo = 1; mo <= 12; mo++){
+            for(int d = 1; d <= 31; d++){
+                time_t t = utc(y, mo, d, 0, 0, 0);
+                struct tm *tm = gmtime(&t);
+
+                if(tm->tm_mon != mo - 1) break;     //Past the end of the month
+                set_regs(reg, y, mo, d, 0, 0, 0);
+                check("midnight", reg, (uint32_t)(t - base));
+                set_regs(reg, y, mo, d, 23, 59, 59);
+                check("last second", reg, (uint32_t)(utc(y, mo, d, 23, 59, 59) - base));
+                days++;
+            }
+        }
+    }
+    if(days != 36525){
+        printf("FAIL calendar: %d days from 2000 to 2099, want 36525\n", days);
+        failures++;
+    }
+}
+
+static void unset(void){
+    uint8_t reg[7];
+
+    //Power up contents of a DS1307 that was never set: all zero, with
+    //or without clock halt, reads as the start of CLK_YEAR0
+    memset(reg, 0, sizeof(reg));
+    check("unset", reg, 0);
+    reg[0] = 0x80;
+    check("unset, halted", reg, 0);
+    //Month 0 or past 12 is taken as January, day 0 as the first
+    set_regs(reg, 2017, 1, 11, 13, 19, 30);
+    reg[5] = 0x00;
+    check("month 0", reg, (uint32_t)(utc(2017, 1, 11, 13, 19, 30) - utc(CLK_YEAR0, 1, 1, 0, 0, 0)));
+    reg[5] = 0x13;
+    check("month 13", reg, (uint32_t)(utc(2017, 1, 11, 13, 19, 30) - utc(CLK_YEAR0, 1, 1, 0, 0, 0)));
+    set_regs(reg, 2017, 4, 0, 13, 19, 30);
+    check("day 0", reg, (uint32_t)(utc(2017, 4, 1, 13, 19, 30) - utc(CLK_YEAR0, 1, 1, 0, 0, 0)));
+    //Century bit and day of the week are ignored
+    set_regs(reg, 2016, 2, 29, 12, 0, 0);
+    reg[3] = 7;
+    reg[5] |= 0x80;
+    check("flag bits", reg, (uint32_t)(utc(2016, 2, 29, 12, 0, 0) - utc(CLK_YEAR0, 1, 1, 0, 0, 0)));
+}
+
+static void run_ticks(uint32_t total){
+    //Ticks the counters up to total ticks from the start and checks them
+    //against the elapsed time, clk_init() left out as it needs the SFRs
+    static uint32_t done;
+    uint64_t us;
+
+    for(; done < total; done++) clk_tick_isr();
+    us = (uint64_t)done * CLK_TICK_US;
+    if(clk_millis() != us / 1000 || clk_now() != us / 1000000){
+        printf("FAIL tick: %lu ticks of %lu us give %lu ms, %lu s, want %llu ms, %llu s\n",
+               (unsigned long)done, (unsigned long)CLK_TICK_US, (unsigned long)clk_millis(),
+               (unsigned long)clk_now(), (unsigned long long)(us / 1000), (unsigned long long)(us / 1000000));
+        failures++;
+    }
+}
+
+static void ticks(void){
+    run_ticks(1000000 / CLK_TICK_US + 1);               //Just past a second
+    run_ticks(CLK_DAY * 1000000ULL / CLK_TICK_US + 1);  //And a day
+}
+
+int main(void){
+    for(int v = 0; v < 100; v++){
+        if(bcd_to_bin(bcd(v)) != v){
+            printf("FAIL bcd_to_bin: %02x gives %u\n", bcd(v), bcd_to_bin(bcd(v)));
+            failures++;
+        }
+    }
+    calendar();
+    unset();
+    ticks();
+    if(failures){
+        printf("%d clock checks failed\n", failures);
+        return 1;
+    }
+    printf("clock ok\n");
+    return 0;
+}
@@ -0,0 +1,421 @@
+/*
+ * File:   conveyor.c
+ *
+ * Monte Carlo conveyor model around the simulated firmware. Each trial
+ * generates a stream of bottles (arrival rate, gap distribution, length,
+ * brand and cap mix, sensor noise), runs the unmodified firmware against
+ * it in a forked simulator and scores every bottle end to end:
+ *
+ *   missed      no decision for the bottle
+ *   merged      touched the next bottle and was counted as one with it
+ *   miscls      decided as the wrong class
+ *   missort     right class, but the servo was not at that class's
+ *               position when the bottle reached the gate: still
+ *               travelling, or already moved on for a later bottle
+ *
+ * Servo targets come from the pulses isr() produces on RC0/RC1, so the
+ * 20ms frame and the time to travel between positions are both included.
+ *
+ * Latency is counted from the trailing edge; -2 boards decide while the
+ * bottle is still in front, so theirs are negative.
+ *
+ *   conveyor [-r from:to:step] [-t trials] [-n bottles] [options]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "board.h"
+#include "telemetry.h"
+#include "param.h"
+
+#define MAX_MOVES       4096
+#define START_S         0.2         //KP_1 press
+#define FIRST_S         1.0         //First bottle reaches the sensor
+#define TAIL_S          1.5         //Run time after the last bottle reached its gate
+
+//<editor-fold defaultstate="collapsed" desc="Configuration">
+enum { GAP_EXP, GAP_UNIFORM, GAP_FIXED };
+
+static struct {
+    double rate_from, rate_to, rate_step;   //Bottles per minute
+    int trials, bottles;
+    double belt;                //mm/s
+    double len, len_sd;         //Bottle length, mm
+    int gap_dist;
+    double gap_min;             //Singulator minimum gap, mm
+    double mix[5];              //Class weights, index as bottle_count_array
+    double noise;               //Relative sd of each channel
+    double gate[2];             //Sensor to servo 0 / servo 1 gate, mm
+    double servo_speed;         //Seconds per 60 degrees
+    double max_error;           //Percent, for the sustainable rate
+    unsigned seed;
+    int csv;
+    const char *write_dir;      //Save every trial as a labelled trace
+    int dual;                   //Top and bottom sensor behind the mux
+    int lut;                    //classifier = 1, the lut.c tables
+} cfg = {
+    10, 80, 10, 20, 10,
+    150, 70, 3, GAP_EXP, 0,
+    {0, 1, 1, 1, 1}, 0.05,
+    {300, 300}, 0.12, 1.0, 1, 0, NULL, 0, 0
+};
+
+//Counts per 2.4ms integration at 16x gain: cap/top, body, trailing edge.
+//Same signatures as scenarios/basic.txt. With two sensors the top one
+//sees the cap and the bottom one the body for the whole pass.
+static const uint16_t ambient[4] = {8, 3, 3, 2};
+static const uint16_t signature[5][3][4] = {
+    {{0}},
+    {{60, 40, 20, 15}, {50, 36, 20, 10}, {25, 10, 8, 6}},           //YOP + cap
+    {{200, 140, 140, 100}, {180, 135, 135, 100}, {25, 10, 10, 8}},  //YOP - cap
+    {{60, 12, 20, 40}, {50, 15, 20, 30}, {25, 8, 8, 10}},           //ESKA + cap
+    {{80, 30, 30, 25}, {70, 28, 28, 24}, {25, 10, 10, 9}},          //ESKA - cap
+};
+#define TOP_FRACTION    0.25
+#define TAIL_FRACTION   0.90
+
+//Servo, pulse and the class sharing the servo, from the reloads in isr()
+static const struct { int servo; double pulse_ms; int other; } route[5] = {
+    {0, 0, 0}, {0, 1.01, 2}, {0, 1.41, 1}, {1, 1.41, 4}, {1, 1.01, 3}
+};
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc="Trial">
+typedef struct {
+    int outcome[TRUTH_OUTCOMES];
+    int spurious;               //Decisions with no bottle past the sensor
+    int bottles;
+    double span;                //First leading edge to last trailing edge, s
+    int nlat;
+    float lat[TRUTH_MAX];       //Trailing edge to decision, s
+} trial_t;
+
+static scenario_t scenario;
+static board_t board;
+static trial_t result;
+
+static struct {
+    double rise;
+    int nmoves;
+    double at[MAX_MOVES], target[MAX_MOVES];  //Degrees, set at the end of each pulse
+} servo[2];
+
+static void add_light(int kind, double t, const uint16_t *crgb){
+    scenario_step_t st;
+    memset(&st, 0, sizeof(st));
+    st.kind = kind;
+    st.at = SIM_MS(t * 1000);
+    memcpy(st.crgb, crgb, sizeof(st.crgb));
+    scenario_add(&scenario, &st);
+}
+
+static void generate(double rate, unsigned seed){
+    //The stream becomes an ordinary scenario: light steps, bottle labels
+    //and a noise seed, so any trial can be saved and replayed (-w)
+    double t = FIRST_S, mean_dur = cfg.len / cfg.belt;
+    double gap_mean = 60.0 / rate - mean_dur;          //s
+    double gap_min = cfg.gap_min / cfg.belt, total = 0, pick, gate;
+    scenario_step_t key;
+    rng_t rng;
+
+    memset(&scenario, 0, sizeof(scenario));
+    rng_seed(&rng, seed);
+    scenario.noise = cfg.noise;
+    scenario.seed = (uint64_t)seed << 32 | 1;         //Own stream for the noise
+
+    memset(&key, 0, sizeof(key));
+    key.kind = SC_KEY;
+    key.key = 0;                                        //KP_1, start
+    key.at = SIM_MS(START_S * 1000);
+    key.hold = SIM_MS(100);
+    scenario_add(&scenario, &key);
+    if(cfg.lut){
+        //TLM_CMD_SET before the start key, as tlmctl would send it
+        static const uint8_t set[] = {TLM_SYNC, TLM_CMD_SET, 3, P_CLASSIFIER, 1, 0,
+                                      (uint8_t)-(TLM_CMD_SET + 3 + P_CLASSIFIER + 1)};
+        scenario_step_t rx;
+        memset(&rx, 0, sizeof(rx));
+        rx.kind = SC_RX;
+        rx.at = SIM_MS(START_S * 500);
+        memcpy(rx.data, set, sizeof(set));
+        rx.len = sizeof(set);
+        scenario_add(&scenario, &rx);
+    }
+    add_light(SC_TCS, 0, ambient);
+    if(cfg.dual) add_light(SC_TCSB, 0, ambient);
+
+    for(int k = 1; k < 5; k++) total += cfg.mix[k];
+    for(int n = 0; n < cfg.bottles; n++){
+        double len = cfg.len + cfg.len_sd * rng_gauss(&rng), gap, dur;
+        int cls;
+
+        pick = rng_uniform(&rng) * total;
+        for(cls = 1; cls < 4 && pick >= cfg.mix[cls]; cls++) pick -= cfg.mix[cls];
+        dur = (len > 1 ? len : 1) / cfg.belt;
+        truth_add(&scenario.truth, t, t + dur, cls);
+        add_light(SC_TCS, t, signature[cls][0]);
+        if(cfg.dual){
+            add_light(SC_TCSB, t, signature[cls][1]);
+            add_light(SC_TCSB, t + dur * TAIL_FRACTION, signature[cls][2]);
+            add_light(SC_TCSB, t + dur, ambient);
+        }
+        else add_light(SC_TCS, t + dur * TOP_FRACTION, signature[cls][1]);
+        add_light(SC_TCS, t + dur * TAIL_FRACTION, signature[cls][2]);
+        add_light(SC_TCS, t + dur, ambient);
+
+        if(gap_mean <= gap_min) gap = gap_min;         //Belt is full
+        else if(cfg.gap_dist == GAP_EXP) gap = gap_min + rng_exp(&rng, gap_mean - gap_min);
+        else if(cfg.gap_dist == GAP_UNIFORM) gap = gap_min + 2 * (gap_mean - gap_min) * rng_uniform(&rng);
+        else gap = gap_mean;
+        t += dur + gap;
+    }
+    gate = cfg.gate[0] > cfg.gate[1] ? cfg.gate[0] : cfg.gate[1];
+    scenario.end = SIM_MS((scenario.truth.bottle[scenario.truth.n - 1].in + gate / cfg.belt + TAIL_S) * 1000);
+}
+
+static void servo_pins(void *ctx, uint8_t old, uint8_t now){
+    double t = sim_seconds();
+    (void)ctx;
+    for(int s = 0; s < 2; s++){
+        uint8_t bit = 1u << s;
+        if(!(old & bit) && (now & bit)) servo[s].rise = t;
+        else if((old & bit) && !(now & bit) && servo[s].nmoves < MAX_MOVES){
+            double width_ms = (t - servo[s].rise) * 1000;
+            int m = servo[s].nmoves;
+            servo[s].at[m] = t;
+            servo[s].target[m] = (width_ms - 0.5) * 90;  //0.5..2.5ms over 180 degrees
+            if(!m || fabs(servo[s].target[m] - servo[s].target[m - 1]) > 1) servo[s].nmoves++;
+        }
+    }
+}
+
+static double servo_angle(int s, double t){
+    //Slews toward the latest commanded target at a constant rate
+    double rate = 60.0 / cfg.servo_speed, pos;
+    int m;
+
+    if(!servo[s].nmoves || t < servo[s].at[0]) return NAN;
+    pos = servo[s].target[0];
+    for(m = 1; m <= servo[s].nmoves; m++){
+        double until = m < servo[s].nmoves && servo[s].at[m] <= t ? servo[s].at[m] : t;
+        double step = rate * (until - servo[s].at[m - 1]), goal = servo[s].target[m - 1];
+        if(fabs(goal - pos) <= step) pos = goal;
+        else pos += goal > pos ? step : -step;
+        if(until == t) break;
+    }
+    return pos;
+}
+
+static void score(void){
+    truth_t *tr = &scenario.truth;
+
+    truth_finish(tr);
+    memset(&result, 0, sizeof(result));
+    result.bottles = tr->n;
+    result.spurious = tr->spurious;
+    result.span = tr->bottle[tr->n - 1].out - tr->bottle[0].in;
+    for(int n = 0; n < tr->n; n++){
+        truth_bottle_t *b = &tr->bottle[n];
+        if(b->outcome == TRUTH_OK){
+            int s = route[b->cls].servo;
+            double want = (route[b->cls].pulse_ms - 0.5) * 90;
+            double alt = (route[route[b->cls].other].pulse_ms - 0.5) * 90;
+            double pos = servo_angle(s, b->in + cfg.gate[s] / cfg.belt);
+            if(isnan(pos) || fabs(pos - want) >= fabs(pos - alt)) b->outcome = TRUTH_MISSORT;
+        }
+        if(b->got) result.lat[result.nlat++] = (float)b->latency;
+        result.outcome[b->outcome]++;
+    }
+}
+
+static void run_trial(void){
+    board_init(&board, &scenario);
+    sim_watch_lat(2, servo_pins, NULL);
+    truth_watch(&scenario.truth);
+    board_run();
+    score();
+}
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc="Sweep">
+typedef struct {
+    int outcome[TRUTH_OUTCOMES];
+    int spurious, bottles, nlat;
+    double correct_per_min;     //Sum over trials
+    float *lat;
+} point_t;
+
+static int cmp_float(const void *a, const void *b){
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const float *v, int n, double p){
+    if(!n) return NAN;
+    return v[(int)(p * (n - 1) + 0.5)];
+}
+
+static int fork_trial(double rate, unsigned seed, int n, trial_t *out){
+    //The firmware never returns and keeps its state in globals, so each
+    //trial runs in a fresh child process
+    int fd[2], status;
+    ssize_t got = 0, r;
+    pid_t pid;
+
+    if(pipe(fd)) return -1;
+    fflush(stdout);
+    pid = fork();
+    if(pid < 0) return -1;
+    if(!pid){
+        close(fd[0]);
+        generate(rate, seed);
+        if(cfg.write_dir){
+            char path[512];
+            snprintf(path, sizeof(path), "%s/r%03.0f_%03d.txt", cfg.write_dir, rate, n);
+            if(scenario_save(&scenario, path)) _exit(1);
+        }
+        run_trial();
+        if(write(fd[1], &result, sizeof(result)) != sizeof(result)) _exit(1);
+        _exit(0);
+    }
+    close(fd[1]);
+    while(got < (ssize_t)sizeof(*out) && (r = read(fd[0], (char *)out + got, sizeof(*out) - got)) > 0) got += r;
+    close(fd[0]);
+    waitpid(pid, &status, 0);
+    return got == sizeof(*out) && WIFEXITED(status) && !WEXITSTATUS(status) ? 0 : -1;
+}
+
+static void usage(const char *prog){
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -r from:to:step   arrival rates, bottles/min (10:80:10)\n"
+        "  -t trials         trials per rate (20)\n"
+        "  -n bottles        bottles per trial (10, the default batch_size ends a run)\n"
+        "  -b mm/s           belt speed (150)\n"
+        "  -l mm[:sd]        bottle length (70:3)\n"
+        "  -d exp|uniform|fixed  gap distribution (exp)\n"
+        "  -g mm             minimum gap from the singulator (0)\n"
+        "  -m a:b:c:d        yop+cap:yop-cap:eska+cap:eska-cap mix (1:1:1:1)\n"
+        "  -N fraction       sensor noise, relative sd per channel (0.05)\n"
+        "  -G mm[:mm]        sensor to servo 0 and servo 1 gates (300)\n"
+        "  -S s              servo travel time per 60 degrees (0.12)\n"
+        "  -e percent        error rate still counted as sustainable (1)\n"
+        "  -s seed           random seed (1)\n"
+        "  -2                top and bottom sensor behind the mux\n"
+        "  -L                classify with the lut.c tables\n"
+        "  -c                CSV output\n"
+        "  -w dir            save each trial as a labelled trace for tracecheck\n", prog);
+    exit(2);
+}
+
+static void parse(int argc, char **argv){
+    int opt;
+    char d[16];
+
+    while((opt = getopt(argc, argv, "r:t:n:b:l:d:g:m:N:G:S:e:s:cw:2L")) != -1){
+        switch(opt){
+            case 'r':
+                if(sscanf(optarg, "%lf:%lf:%lf", &cfg.rate_from, &cfg.rate_to, &cfg.rate_step) != 3) usage(argv[0]);
+                break;
+            case 't': cfg.trials = atoi(optarg); break;
+            case 'n': cfg.bottles = atoi(optarg); break;
+            case 'b': cfg.belt = atof(optarg); break;
+            case 'l':
+                if(sscanf(optarg, "%lf:%lf", &cfg.len, &cfg.len_sd) < 1) usage(argv[0]);
+                break;
+            case 'd':
+                snprintf(d, sizeof(d), "%s", optarg);
+                if(!strcmp(d, "exp")) cfg.gap_dist = GAP_EXP;
+                else if(!strcmp(d, "uniform")) cfg.gap_dist = GAP_UNIFORM;
+                else if(!strcmp(d, "fixed")) cfg.gap_dist = GAP_FIXED;
+                else usage(argv[0]);
+                break;
+            case 'g': cfg.gap_min = atof(optarg); break;
+            case 'm':
+                if(sscanf(optarg, "%lf:%lf:%lf:%lf", &cfg.mix[1], &cfg.mix[2], &cfg.mix[3], &cfg.mix[4]) != 4) usage(argv[0]);
+                break;
+            case 'N': cfg.noise = atof(optarg); break;
+            case 'G':
+                if(sscanf(optarg, "%lf:%lf", &cfg.gate[0], &cfg.gate[1]) == 1) cfg.gate[1] = cfg.gate[0];
+                break;
+            case 'S': cfg.servo_speed = atof(optarg); break;
+            case 'e': cfg.max_error = atof(optarg); break;
+            case 's': cfg.seed = (unsigned)strtoul(optarg, NULL, 0); break;
+            case 'c': cfg.csv = 1; break;
+            case 'w': cfg.write_dir = optarg; break;
+            case '2': cfg.dual = 1; break;
+            case 'L': cfg.lut = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if(cfg.trials < 1 || cfg.bottles < 1 || cfg.bottles > TRUTH_MAX || cfg.belt <= 0 ||
+       cfg.rate_from <= 0 || cfg.rate_step <= 0 || cfg.rate_to < cfg.rate_from ||
+       cfg.mix[1] + cfg.mix[2] + cfg.mix[3] + cfg.mix[4] <= 0) usage(argv[0]);
+}
+
+int main(int argc, char **argv){
+    double sustainable = 0;
+    int failed = 0, index = 0, holding = 1;
+
+    parse(argc, argv);
+
+    if(cfg.csv) printf("rate,bottles,throughput,miscls,missed,merged,missort,spurious,lat_p50_ms,lat_p95_ms,lat_max_ms\n");
+    else{
+        printf("belt %.0f mm/s, bottles %.0f mm, %d trials x %d bottles, noise %.0f%%, gates %.0f/%.0f mm%s%s\n",
+               cfg.belt, cfg.len, cfg.trials, cfg.bottles, cfg.noise * 100, cfg.gate[0], cfg.gate[1],
+               cfg.dual ? ", two sensors" : "", cfg.lut ? ", lut classifier" : "");
+        printf(" rate/min  thru/min  miscls%%  missed%%  merged%% missort%%  spurious  lat p50/p95/max ms\n");
+    }
+
+    for(double rate = cfg.rate_from; rate <= cfg.rate_to + 1e-9; rate += cfg.rate_step, index++){
+        point_t pt;
+        trial_t tr;
+        double errors;
+
+        memset(&pt, 0, sizeof(pt));
+        pt.lat = malloc(sizeof(float) * TRUTH_MAX * cfg.trials);
+        for(int n = 0; n < cfg.trials; n++){
+            if(fork_trial(rate, cfg.seed + index * 100003u + n, n, &tr)){
+                fprintf(stderr, "trial %d at %.1f/min failed\n", n, rate);
+                failed++;
+                continue;
+            }
+            for(int k = 0; k < TRUTH_OUTCOMES; k++) pt.outcome[k] += tr.outcome[k];
+            pt.spurious += tr.spurious;
+            pt.bottles += tr.bottles;
+            pt.correct_per_min += tr.span > 0 ? tr.outcome[TRUTH_OK] * 60.0 / tr.span : 0;
+            memcpy(pt.lat + pt.nlat, tr.lat, tr.nlat * sizeof(float));
+            pt.nlat += tr.nlat;
+        }
+        qsort(pt.lat, pt.nlat, sizeof(float), cmp_float);
+
+        #define PCT(k)  (pt.bottles ? 100.0 * pt.outcome[k] / pt.bottles : 0)
+        errors = pt.bottles ? 100.0 * (pt.bottles - pt.outcome[TRUTH_OK] + pt.spurious) / pt.bottles : 100;
+        if(cfg.csv){
+            printf("%.1f,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%d,%.1f,%.1f,%.1f\n", rate, pt.bottles,
+                   pt.correct_per_min / cfg.trials, PCT(TRUTH_MISCLS), PCT(TRUTH_MISSED), PCT(TRUTH_MERGED), PCT(TRUTH_MISSORT),
+                   pt.spurious, percentile(pt.lat, pt.nlat, 0.5) * 1000,
+                   percentile(pt.lat, pt.nlat, 0.95) * 1000, percentile(pt.lat, pt.nlat, 1.0) * 1000);
+        }
+        else{
+            printf("%9.1f %9.1f %8.2f %8.2f %8.2f %8.2f %9d   %5.0f/%.0f/%.0f\n", rate,
+                   pt.correct_per_min / cfg.trials, PCT(TRUTH_MISCLS), PCT(TRUTH_MISSED), PCT(TRUTH_MERGED), PCT(TRUTH_MISSORT),
+                   pt.spurious, percentile(pt.lat, pt.nlat, 0.5) * 1000,
+                   percentile(pt.lat, pt.nlat, 0.95) * 1000, percentile(pt.lat, pt.nlat, 1.0) * 1000);
+        }
+        #undef PCT
+        if(errors > cfg.max_error) holding = 0;
+        else if(holding) sustainable = rate;             //Every lower rate held as well
+        free(pt.lat);
+    }
+    if(!cfg.csv){
+        if(sustainable > 0) printf("sustainable: %.1f bottles/min at <= %.1f%% errors\n", sustainable, cfg.max_error);
+        else printf("sustainable: none of the rates stay under %.1f%% errors\n", cfg.max_error);
+    }
+    return failed ? 1 : 0;
+}
+//</editor-fold>
@@ -0,0 +1,122 @@
+/*
+ * File:   ds1307.c
+ *
+ * DS1307 model: BCD time registers 0..6, control register 7 and 56 bytes
+ * of RAM, register pointer wrapping at 0x3F. The time registers are
+ * copied from the running clock when a transaction starts and written
+ * back to it on STOP. The day of the week follows the date (1 = Monday).
+ */
+
+#include <string.h>
+#include "pic18.h"
+#include "ds1307.h"
+
+static uint8_t bcd(int v){
+    return (uint8_t)(((v / 10) << 4) | (v % 10));
+}
+
+static int unbcd(uint8_t v){
+    return (v >> 4) * 10 + (v & 0x0F);
+}
+
+static int64_t days_from_civil(int y, int m, int d){
+    //Days since 2000-01-01
+    int64_t era, yoe, doy, doe;
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 730425;
+}
+
+static void civil_from_days(int64_t z, int *y, int *m, int *d){
+    int64_t era, doe, yoe, doy, mp;
+    z += 730425;
+    era = (z >= 0 ? z : z - 146096) / 146097;
+    doe = z - era * 146097;
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    *d = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *m = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *y = (int)(yoe + era * 400 + (*m <= 2));
+}
+
+static int64_t now(ds1307_t *r){
+    if(r->halted) return r->base;
+    return r->base + (int64_t)((sim_cycles - r->base_cycles) / SIM_FCY);
+}
+
+static void snapshot(ds1307_t *r){
+    int64_t t = now(r), days = t / 86400;
+    int secs = (int)(t % 86400), y, m, d;
+
+    civil_from_days(days, &y, &m, &d);
+    r->reg[0] = bcd(secs % 60) | (r->halted ? 0x80 : 0);
+    r->reg[1] = bcd(secs / 60 % 60);
+    r->reg[2] = bcd(secs / 3600);
+    r->reg[3] = (uint8_t)((days + 5) % 7 + 1);      //2000-01-01 was a Saturday
+    r->reg[4] = bcd(d);
+    r->reg[5] = bcd(m);
+    r->reg[6] = bcd(y % 100);
+}
+
+static void apply(ds1307_t *r){
+    int64_t days = days_from_civil(2000 + unbcd(r->reg[6]), unbcd(r->reg[5] & 0x1F),
+                                   unbcd(r->reg[4] & 0x3F));
+    r->base = days * 86400 + unbcd(r->reg[2] & 0x3F) * 3600
+            + unbcd(r->reg[1] & 0x7F) * 60 + unbcd(r->reg[0] & 0x7F);
+    r->base_cycles = sim_cycles;
+    r->halted = (r->reg[0] & 0x80) != 0;
+}
+
+static int rtc_start(i2c_device_t *dev, int read){
+    ds1307_t *r = (ds1307_t *)dev;
+    r->expect_ptr = !read;
+    if(!r->time_written) snapshot(r);
+    return 1;
+}
+
+static int rtc_write(i2c_device_t *dev, uint8_t data){
+    ds1307_t *r = (ds1307_t *)dev;
+    if(r->expect_ptr){
+        r->expect_ptr = 0;
+        r->ptr = data & 0x3F;
+        return 1;
+    }
+    r->reg[r->ptr] = data;
+    if(r->ptr < 7) r->time_written = 1;
+    r->ptr = (r->ptr + 1) & 0x3F;
+    return 1;
+}
+
+static uint8_t rtc_read(i2c_device_t *dev){
+    ds1307_t *r = (ds1307_t *)dev;
+    uint8_t v = r->reg[r->ptr];
+    r->ptr = (r->ptr + 1) & 0x3F;
+    return v;
+}
+
+static void rtc_stop(i2c_device_t *dev){
+    ds1307_t *r = (ds1307_t *)dev;
+    if(r->time_written) apply(r);
+    r->time_written = 0;
+}
+
+void ds1307_init(ds1307_t *r, const char *name){
+    memset(r, 0, sizeof(*r));
+    r->dev.name = name;
+    r->dev.addr = DS1307_ADDR;
+    r->dev.start = rtc_start;
+    r->dev.write = rtc_write;
+    r->dev.read = rtc_read;
+    r->dev.stop = rtc_stop;
+    ds1307_set(r, 2017, 4, 11, 13, 19, 30);     //timeset[] in main.h
+}
+
+void ds1307_set(ds1307_t *r, int year, int mon, int day, int hour, int min, int sec){
+    r->base = days_from_civil(year, mon, day) * 86400 + hour * 3600 + min * 60 + sec;
+    r->base_cycles = sim_cycles;
+    r->halted = 0;
+}
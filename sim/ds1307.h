@@ -0,0 +1,30 @@
+/*
+ * File:   ds1307.h
+ *
+ * DS1307 real time clock model, 24 hour mode. The clock runs from
+ * simulated time, so a run always reads the same times.
+ */
+
+#ifndef DS1307_H
+#define DS1307_H
+
+#include <stdint.h>
+#include "mssp.h"
+
+#define DS1307_ADDR     0x68
+
+typedef struct {
+    i2c_device_t dev;
+    uint8_t reg[0x40];          //Time registers are a snapshot taken at START
+    uint8_t ptr;
+    int expect_ptr;
+    int time_written;           //Time registers changed, applied at STOP
+    int64_t base;               //Clock seconds at sim_cycles == base_cycles
+    uint64_t base_cycles;
+    int halted;                 //CH bit
+} ds1307_t;
+
+void ds1307_init(ds1307_t *rtc, const char *name);
+void ds1307_set(ds1307_t *rtc, int year, int mon, int day, int hour, int min, int sec);
+
+#endif
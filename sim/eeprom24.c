@@ -0,0 +1,63 @@
+/*
+ * File:   eeprom24.c
+ *
+ * 24LC256 model. Written bytes are latched into the page buffer, rolling
+ * over within the page, and programmed on STOP. Reads are sequential
+ * across the whole array.
+ */
+
+#include <string.h>
+#include "pic18.h"
+#include "eeprom24.h"
+
+static int ee_start(i2c_device_t *dev, int read){
+    eeprom24_t *e = (eeprom24_t *)dev;
+    if(sim_cycles < e->busy_until) return 0;       //Write cycle in progress
+    e->addr_bytes = read ? 0 : 2;
+    e->loaded = 0;
+    memset(e->page_set, 0, sizeof(e->page_set));
+    return 1;
+}
+
+static int ee_write(i2c_device_t *dev, uint8_t data){
+    eeprom24_t *e = (eeprom24_t *)dev;
+    if(e->addr_bytes){
+        if(e->addr_bytes-- == 2) e->ptr = (uint16_t)((data & 0x7F) << 8);
+        else e->ptr |= data;
+        return 1;
+    }
+    e->page[e->ptr % EEPROM24_PAGE] = data;
+    e->page_set[e->ptr % EEPROM24_PAGE] = 1;
+    e->ptr = (uint16_t)((e->ptr & ~(EEPROM24_PAGE - 1)) | ((e->ptr + 1) & (EEPROM24_PAGE - 1)));
+    e->loaded++;
+    return 1;
+}
+
+static uint8_t ee_read(i2c_device_t *dev){
+    eeprom24_t *e = (eeprom24_t *)dev;
+    uint8_t v = e->mem[e->ptr];
+    e->ptr = (e->ptr + 1) % EEPROM24_SIZE;
+    return v;
+}
+
+static void ee_stop(i2c_device_t *dev){
+    eeprom24_t *e = (eeprom24_t *)dev;
+    uint16_t base = e->ptr & ~(EEPROM24_PAGE - 1);
+
+    if(!e->loaded) return;
+    for(int n = 0; n < EEPROM24_PAGE; n++) if(e->page_set[n]) e->mem[base + n] = e->page[n];
+    e->loaded = 0;
+    e->page_writes++;
+    e->busy_until = sim_cycles + SIM_MS(EEPROM24_WRITE_MS);
+}
+
+void eeprom24_init(eeprom24_t *e, const char *name){
+    memset(e, 0, sizeof(*e));
+    memset(e->mem, 0xFF, sizeof(e->mem));
+    e->dev.name = name;
+    e->dev.addr = EEPROM24_ADDR;
+    e->dev.start = ee_start;
+    e->dev.write = ee_write;
+    e->dev.read = ee_read;
+    e->dev.stop = ee_stop;
+}
@@ -0,0 +1,33 @@
+/*
+ * File:   eeprom24.h
+ *
+ * 24LC256 serial EEPROM model: 32KB, 64 byte pages, 5ms write cycle
+ * during which the device does not acknowledge its address.
+ */
+
+#ifndef EEPROM24_H
+#define EEPROM24_H
+
+#include <stdint.h>
+#include "mssp.h"
+
+#define EEPROM24_ADDR       0x50
+#define EEPROM24_SIZE       32768
+#define EEPROM24_PAGE       64
+#define EEPROM24_WRITE_MS   5
+
+typedef struct {
+    i2c_device_t dev;
+    uint8_t mem[EEPROM24_SIZE];
+    uint8_t page[EEPROM24_PAGE];
+    uint8_t page_set[EEPROM24_PAGE];    //Bytes loaded for the pending page write
+    uint16_t ptr;
+    int addr_bytes;             //Address bytes still expected
+    int loaded;                 //Data bytes latched since the address
+    uint64_t busy_until;
+    uint64_t page_writes;
+} eeprom24_t;
+
+void eeprom24_init(eeprom24_t *ee, const char *name);
+
+#endif
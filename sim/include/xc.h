@@ -0,0 +1,283 @@
+/*
+ * File:   xc.h (simulator)
+ *
+ * Stand-in for the XC8 device header when the firmware is compiled for
+ * the Linux simulator. Every SFR name expands to an accessor call, so a
+ * register access costs one instruction cycle of simulated time and lets
+ * the peripheral models (pic18.c, mssp.c) react to what was written.
+ *
+ * Bit names are available as REGbits.NAME and, for the registers the
+ * firmware uses that way, as a standalone NAME. A bit with a standalone
+ * name can't also be written as REGbits.NAME (the macro would expand
+ * inside the member access), so firmware must pick one form per bit.
+ */
+
+#ifndef SIM_XC_H
+#define SIM_XC_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum {
+    SFR_PORTA, SFR_PORTB, SFR_PORTC, SFR_PORTD, SFR_PORTE,
+    SFR_LATA, SFR_LATB, SFR_LATC, SFR_LATD, SFR_LATE,
+    SFR_TRISA, SFR_TRISB, SFR_TRISC, SFR_TRISD, SFR_TRISE,
+    SFR_INTCON, SFR_INTCON2, SFR_INTCON3,
+    SFR_PIR1, SFR_PIE1, SFR_IPR1, SFR_PIR2, SFR_PIE2, SFR_IPR2,
+    SFR_RCON, SFR_OSCCON, SFR_OSCTUNE, SFR_WDTCON, SFR_HLVDCON,
+    SFR_T0CON, SFR_T1CON, SFR_T2CON, SFR_T3CON, SFR_TMR2, SFR_PR2,
+    SFR_CCP1CON, SFR_CCPR1L, SFR_CCP2CON, SFR_CCPR2L,
+    SFR_SSPSTAT, SFR_SSPCON1, SFR_SSPCON2, SFR_SSPADD,
+    SFR_EECON1, SFR_EECON2, SFR_EEADR, SFR_EEADRH, SFR_EEDATA,
+    SFR_TXSTA, SFR_RCSTA, SFR_BAUDCON, SFR_SPBRG, SFR_SPBRGH, SFR_RCREG,
+    SFR_ADCON0, SFR_ADCON1, SFR_ADCON2,
+    SFR_COUNT
+};
+enum { SFR16_TMR0, SFR16_TMR1, SFR16_TMR3, SFR16_COUNT };
+enum { SLOT_SSPBUF, SLOT_TXREG, SLOT_COUNT };
+
+volatile uint8_t *sim_sfr(int id);
+volatile uint16_t *sim_sfr16(int id);
+volatile uint16_t *sim_slot(int id);
+void sim_delay_us(unsigned long us);
+void sim_sleep(void);
+void sim_clrwdt(void);
+void sim_reset(void);
+void putch(char c);
+int sim_printf(const char *fmt, ...);
+
+//Bit layouts, LSB first
+typedef struct { uint8_t RA0:1, RA1:1, RA2:1, RA3:1, RA4:1, RA5:1, RA6:1, RA7:1; } PORTAbits_t;
+typedef struct { uint8_t RB0:1, RB1:1, RB2:1, RB3:1, RB4:1, RB5:1, RB6:1, RB7:1; } PORTBbits_t;
+typedef struct { uint8_t RC0:1, RC1:1, RC2:1, RC3:1, RC4:1, RC5:1, RC6:1, RC7:1; } PORTCbits_t;
+typedef struct { uint8_t RD0:1, RD1:1, RD2:1, RD3:1, RD4:1, RD5:1, RD6:1, RD7:1; } PORTDbits_t;
+typedef struct { uint8_t RE0:1, RE1:1, RE2:1, RE3:1, :4; } PORTEbits_t;
+typedef struct { uint8_t LATA0:1, LATA1:1, LATA2:1, LATA3:1, LATA4:1, LATA5:1, LATA6:1, LATA7:1; } LATAbits_t;
+typedef struct { uint8_t LATB0:1, LATB1:1, LATB2:1, LATB3:1, LATB4:1, LATB5:1, LATB6:1, LATB7:1; } LATBbits_t;
+typedef struct { uint8_t LATC0:1, LATC1:1, LATC2:1, LATC3:1, LATC4:1, LATC5:1, LATC6:1, LATC7:1; } LATCbits_t;
+typedef struct { uint8_t LATD0:1, LATD1:1, LATD2:1, LATD3:1, LATD4:1, LATD5:1, LATD6:1, LATD7:1; } LATDbits_t;
+typedef struct { uint8_t LATE0:1, LATE1:1, LATE2:1, :5; } LATEbits_t;
+typedef struct { uint8_t TRISA0:1, TRISA1:1, TRISA2:1, TRISA3:1, TRISA4:1, TRISA5:1, TRISA6:1, TRISA7:1; } TRISAbits_t;
+typedef struct { uint8_t TRISB0:1, TRISB1:1, TRISB2:1, TRISB3:1, TRISB4:1, TRISB5:1, TRISB6:1, TRISB7:1; } TRISBbits_t;
+typedef struct { uint8_t TRISC0:1, TRISC1:1, TRISC2:1, TRISC3:1, TRISC4:1, TRISC5:1, TRISC6:1, TRISC7:1; } TRISCbits_t;
+typedef struct { uint8_t TRISD0:1, TRISD1:1, TRISD2:1, TRISD3:1, TRISD4:1, TRISD5:1, TRISD6:1, TRISD7:1; } TRISDbits_t;
+typedef struct { uint8_t TRISE0:1, TRISE1:1, TRISE2:1, :5; } TRISEbits_t;
+typedef struct { uint8_t RBIF:1, INT0IF:1, TMR0IF:1, RBIE:1, INT0IE:1, TMR0IE:1, PEIE:1, GIE:1; } INTCONbits_t;
+typedef struct { uint8_t RBIP:1, :1, TMR0IP:1, :1, INTEDG2:1, INTEDG1:1, INTEDG0:1, nRBPU:1; } INTCON2bits_t;
+typedef struct { uint8_t INT1IF:1, INT2IF:1, :1, INT1IE:1, INT2IE:1, :1, INT1IP:1, INT2IP:1; } INTCON3bits_t;
+typedef struct { uint8_t TMR1IF:1, TMR2IF:1, CCP1IF:1, SSPIF:1, TXIF:1, RCIF:1, ADIF:1, PSPIF:1; } PIR1bits_t;
+typedef struct { uint8_t TMR1IE:1, TMR2IE:1, CCP1IE:1, SSPIE:1, TXIE:1, RCIE:1, ADIE:1, PSPIE:1; } PIE1bits_t;
+typedef struct { uint8_t TMR1IP:1, TMR2IP:1, CCP1IP:1, SSPIP:1, TXIP:1, RCIP:1, ADIP:1, PSPIP:1; } IPR1bits_t;
+typedef struct { uint8_t CCP2IF:1, TMR3IF:1, HLVDIF:1, BCLIF:1, EEIF:1, :1, CMIF:1, OSCFIF:1; } PIR2bits_t;
+typedef struct { uint8_t CCP2IE:1, TMR3IE:1, HLVDIE:1, BCLIE:1, EEIE:1, :1, CMIE:1, OSCFIE:1; } PIE2bits_t;
+typedef struct { uint8_t CCP2IP:1, TMR3IP:1, HLVDIP:1, BCLIP:1, EEIP:1, :1, CMIP:1, OSCFIP:1; } IPR2bits_t;
+typedef struct { uint8_t nBOR:1, nPOR:1, nPD:1, nTO:1, nRI:1, :1, SBOREN:1, IPEN:1; } RCONbits_t;
+typedef struct { uint8_t SCS0:1, SCS1:1, IOFS:1, OSTS:1, IRCF0:1, IRCF1:1, IRCF2:1, IDLEN:1; } OSCCONbits_t;
+typedef struct { uint8_t TUN:5, :1, PLLEN:1, INTSRC:1; } OSCTUNEbits_t;
+typedef struct { uint8_t SWDTEN:1, :7; } WDTCONbits_t;
+typedef struct { uint8_t T0PS0:1, T0PS1:1, T0PS2:1, PSA:1, T0SE:1, T0CS:1, T08BIT:1, TMR0ON:1; } T0CONbits_t;
+typedef struct { uint8_t TMR1ON:1, TMR1CS:1, nT1SYNC:1, T1OSCEN:1, T1CKPS0:1, T1CKPS1:1, T1RUN:1, T1RD16:1; } T1CONbits_t;
+typedef struct { uint8_t T2CKPS0:1, T2CKPS1:1, TMR2ON:1, T2OUTPS0:1, T2OUTPS1:1, T2OUTPS2:1, T2OUTPS3:1, :1; } T2CONbits_t;
+typedef struct { uint8_t TMR3ON:1, TMR3CS:1, nT3SYNC:1, T3CCP1:1, T3CKPS0:1, T3CKPS1:1, T3CCP2:1, T3RD16:1; } T3CONbits_t;
+typedef struct { uint8_t CCP1M0:1, CCP1M1:1, CCP1M2:1, CCP1M3:1, DC1B0:1, DC1B1:1, P1M0:1, P1M1:1; } CCP1CONbits_t;
+typedef struct { uint8_t CCP2M0:1, CCP2M1:1, CCP2M2:1, CCP2M3:1, DC2B0:1, DC2B1:1, :2; } CCP2CONbits_t;
+typedef struct { uint8_t BF:1, UA:1, R_nW:1, S:1, P:1, D_nA:1, CKE:1, SMP:1; } SSPSTATbits_t;
+typedef struct { uint8_t SSPM:4, CKP:1, SSPEN:1, SSPOV:1, WCOL:1; } SSPCON1bits_t;
+typedef struct { uint8_t SEN:1, RSEN:1, PEN:1, RCEN:1, ACKEN:1, ACKDT:1, ACKSTAT:1, GCEN:1; } SSPCON2bits_t;
+typedef struct { uint8_t RD:1, WR:1, WREN:1, WRERR:1, FREE:1, :1, CFGS:1, EEPGD:1; } EECON1bits_t;
+typedef struct { uint8_t TX9D:1, TRMT:1, BRGH:1, SENDB:1, SYNC:1, TXEN:1, TX9:1, CSRC:1; } TXSTAbits_t;
+typedef struct { uint8_t RX9D:1, OERR:1, FERR:1, ADDEN:1, CREN:1, SREN:1, RX9:1, SPEN:1; } RCSTAbits_t;
+typedef struct { uint8_t ABDEN:1, WUE:1, :1, BRG16:1, TXCKP:1, RXDTP:1, RCIDL:1, ABDOVF:1; } BAUDCONbits_t;
+
+#ifndef SIM_CORE    //The simulator itself uses the raw storage in pic18.h
+
+#define _SFR(name)      (*sim_sfr(SFR_##name))
+#define _BITS(name)     (*(volatile name##bits_t *)sim_sfr(SFR_##name))
+
+//Byte registers
+#define PORTA       _SFR(PORTA)
+#define PORTB       _SFR(PORTB)
+#define PORTC       _SFR(PORTC)
+#define PORTD       _SFR(PORTD)
+#define PORTE       _SFR(PORTE)
+#define LATA        _SFR(LATA)
+#define LATB        _SFR(LATB)
+#define LATC        _SFR(LATC)
+#define LATD        _SFR(LATD)
+#define LATE        _SFR(LATE)
+#define TRISA       _SFR(TRISA)
+#define TRISB       _SFR(TRISB)
+#define TRISC       _SFR(TRISC)
+#define TRISD       _SFR(TRISD)
+#define TRISE       _SFR(TRISE)
+#define INTCON      _SFR(INTCON)
+#define INTCON2     _SFR(INTCON2)
+#define INTCON3     _SFR(INTCON3)
+#define PIR1        _SFR(PIR1)
+#define PIE1        _SFR(PIE1)
+#define IPR1        _SFR(IPR1)
+#define PIR2        _SFR(PIR2)
+#define PIE2        _SFR(PIE2)
+#define IPR2        _SFR(IPR2)
+#define RCON        _SFR(RCON)
+#define OSCCON      _SFR(OSCCON)
+#define OSCTUNE     _SFR(OSCTUNE)
+#define WDTCON      _SFR(WDTCON)
+#define HLVDCON     _SFR(HLVDCON)
+#define T0CON       _SFR(T0CON)
+#define T1CON       _SFR(T1CON)
+#define T2CON       _SFR(T2CON)
+#define T3CON       _SFR(T3CON)
+#define TMR2        _SFR(TMR2)
+#define PR2         _SFR(PR2)
+#define CCP1CON     _SFR(CCP1CON)
+#define CCPR1L      _SFR(CCPR1L)
+#define CCP2CON     _SFR(CCP2CON)
+#define CCPR2L      _SFR(CCPR2L)
+#define SSPSTAT     _SFR(SSPSTAT)
+#define SSPCON1     _SFR(SSPCON1)
+#define SSPCON2     _SFR(SSPCON2)
+#define SSPADD      _SFR(SSPADD)
+#define EECON1      _SFR(EECON1)
+#define EECON2      _SFR(EECON2)
+#define EEADR       _SFR(EEADR)
+#define EEADRH      _SFR(EEADRH)
+#define EEDATA      _SFR(EEDATA)
+#define TXSTA       _SFR(TXSTA)
+#define RCSTA       _SFR(RCSTA)
+#define BAUDCON     _SFR(BAUDCON)
+#define SPBRG       _SFR(SPBRG)
+#define SPBRGH      _SFR(SPBRGH)
+#define RCREG       _SFR(RCREG)
+#define ADCON0      _SFR(ADCON0)
+#define ADCON1      _SFR(ADCON1)
+#define ADCON2      _SFR(ADCON2)
+
+//16-bit timer pairs and registers whose writes the simulator must see
+#define TMR0        (*sim_sfr16(SFR16_TMR0))
+#define TMR1        (*sim_sfr16(SFR16_TMR1))
+#define TMR3        (*sim_sfr16(SFR16_TMR3))
+#define SSPBUF      (*sim_slot(SLOT_SSPBUF))
+#define TXREG       (*sim_slot(SLOT_TXREG))
+
+#define PORTAbits   _BITS(PORTA)
+#define PORTBbits   _BITS(PORTB)
+#define PORTCbits   _BITS(PORTC)
+#define PORTDbits   _BITS(PORTD)
+#define PORTEbits   _BITS(PORTE)
+#define LATAbits    _BITS(LATA)
+#define LATBbits    _BITS(LATB)
+#define LATCbits    _BITS(LATC)
+#define LATDbits    _BITS(LATD)
+#define LATEbits    _BITS(LATE)
+#define TRISAbits   _BITS(TRISA)
+#define TRISBbits   _BITS(TRISB)
+#define TRISCbits   _BITS(TRISC)
+#define TRISDbits   _BITS(TRISD)
+#define TRISEbits   _BITS(TRISE)
+#define INTCONbits  _BITS(INTCON)
+#define INTCON2bits _BITS(INTCON2)
+#define INTCON3bits _BITS(INTCON3)
+#define PIR1bits    _BITS(PIR1)
+#define PIE1bits    _BITS(PIE1)
+#define IPR1bits    _BITS(IPR1)
+#define PIR2bits    _BITS(PIR2)
+#define PIE2bits    _BITS(PIE2)
+#define IPR2bits    _BITS(IPR2)
+#define RCONbits    _BITS(RCON)
+#define OSCCONbits  _BITS(OSCCON)
+#define OSCTUNEbits _BITS(OSCTUNE)
+#define WDTCONbits  _BITS(WDTCON)
+#define T0CONbits   _BITS(T0CON)
+#define T1CONbits   _BITS(T1CON)
+#define T2CONbits   _BITS(T2CON)
+#define T3CONbits   _BITS(T3CON)
+#define CCP1CONbits _BITS(CCP1CON)
+#define CCP2CONbits _BITS(CCP2CON)
+#define SSPSTATbits _BITS(SSPSTAT)
+#define SSPCON1bits _BITS(SSPCON1)
+#define SSPCON2bits _BITS(SSPCON2)
+#define EECON1bits  _BITS(EECON1)
+#define TXSTAbits   _BITS(TXSTA)
+#define RCSTAbits   _BITS(RCSTA)
+#define BAUDCONbits _BITS(BAUDCON)
+
+//Standalone bit names
+#define GIE         INTCONbits.GIE
+#define PEIE        INTCONbits.PEIE
+#define TMR0IE      INTCONbits.TMR0IE
+#define INT0IE      INTCONbits.INT0IE
+#define RBIE        INTCONbits.RBIE
+#define TMR0IF      INTCONbits.TMR0IF
+#define INT0IF      INTCONbits.INT0IF
+#define RBIF        INTCONbits.RBIF
+#define nRBPU       INTCON2bits.nRBPU
+#define INTEDG0     INTCON2bits.INTEDG0
+#define INTEDG1     INTCON2bits.INTEDG1
+#define INTEDG2     INTCON2bits.INTEDG2
+#define INT1IF      INTCON3bits.INT1IF
+#define INT2IF      INTCON3bits.INT2IF
+#define INT1IE      INTCON3bits.INT1IE
+#define INT2IE      INTCON3bits.INT2IE
+#define TMR1IF      PIR1bits.TMR1IF
+#define TMR2IF      PIR1bits.TMR2IF
+#define TMR1IE      PIE1bits.TMR1IE
+#define TMR2IE      PIE1bits.TMR2IE
+#define TMR3IF      PIR2bits.TMR3IF
+#define TMR3IE      PIE2bits.TMR3IE
+#define T0PS0       T0CONbits.T0PS0
+#define T0PS1       T0CONbits.T0PS1
+#define T0PS2       T0CONbits.T0PS2
+#define PSA         T0CONbits.PSA
+#define T0CS        T0CONbits.T0CS
+#define T08BIT      T0CONbits.T08BIT
+#define TMR0ON      T0CONbits.TMR0ON
+#define TMR1ON      T1CONbits.TMR1ON
+#define TMR1CS      T1CONbits.TMR1CS
+#define T1CKPS0     T1CONbits.T1CKPS0
+#define T1CKPS1     T1CONbits.T1CKPS1
+#define T2CKPS0     T2CONbits.T2CKPS0
+#define T2CKPS1     T2CONbits.T2CKPS1
+#define TMR2ON      T2CONbits.TMR2ON
+#define TMR3ON      T3CONbits.TMR3ON
+#define TMR3CS      T3CONbits.TMR3CS
+#define T3CKPS0     T3CONbits.T3CKPS0
+#define T3CKPS1     T3CONbits.T3CKPS1
+#define CCP1M0      CCP1CONbits.CCP1M0
+#define CCP1M1      CCP1CONbits.CCP1M1
+#define CCP1M2      CCP1CONbits.CCP1M2
+#define CCP1M3      CCP1CONbits.CCP1M3
+#define CCP2M0      CCP2CONbits.CCP2M0
+#define CCP2M1      CCP2CONbits.CCP2M1
+#define CCP2M2      CCP2CONbits.CCP2M2
+#define CCP2M3      CCP2CONbits.CCP2M3
+#define SEN         SSPCON2bits.SEN
+#define RSEN        SSPCON2bits.RSEN
+#define PEN         SSPCON2bits.PEN
+#define RCEN        SSPCON2bits.RCEN
+#define ACKEN       SSPCON2bits.ACKEN
+#define ACKDT       SSPCON2bits.ACKDT
+#define ACKSTAT     SSPCON2bits.ACKSTAT
+#define TRISC3      TRISCbits.TRISC3
+#define TRISC4      TRISCbits.TRISC4
+
+//Compiler intrinsics and qualifiers. The rest of the firmware's RAM is
+//renamed fwbss (Makefile) and cleared by a reset, like XC8's start up
+//code does; persistent variables go where that doesn't reach
+#define interrupt
+#define persistent      __attribute__((section("fwkeep")))
+#define near
+#define __delay_us(x)   sim_delay_us(x)
+#define __delay_ms(x)   sim_delay_us((unsigned long)(x) * 1000UL)
+#define di()            (GIE = 0)
+#define ei()            (GIE = 1)
+#define SLEEP()         sim_sleep()
+#define CLRWDT()        sim_clrwdt()
+#define RESET()         sim_reset()
+#define NOP()           sim_delay_us(0)
+
+//XC8's printf writes through putch(), so LCD output reaches lcd.c
+#define printf(...)     sim_printf(__VA_ARGS__)
+
+#endif  /* SIM_CORE */
+#endif
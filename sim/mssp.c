@@ -0,0 +1,175 @@
+/*
+ * File:   mssp.c
+ *
+ * MSSP I2C master. Each operation the firmware starts (SEN, RSEN, PEN,
+ * RCEN, ACKEN or a write to SSPBUF) keeps the module busy for its length
+ * in bit times, one bit time being SSPADD + 1 instruction cycles, and
+ * takes effect on the bus when it completes. SSPIF, ACKSTAT and the
+ * received byte appear at that point, like on the real module.
+ */
+
+#include <stdio.h>
+#include "pic18.h"
+#include "mssp.h"
+
+#define CMD_BITS    0x1F        //SEN | RSEN | PEN | RCEN | ACKEN
+#define SSPSTAT_RW  0x04        //Transmit in progress in master mode
+
+enum { OP_NONE, OP_START, OP_RESTART, OP_STOP, OP_READ, OP_ACK, OP_WRITE };
+
+static i2c_device_t *devices;
+static i2c_device_t *selected;          //Device that acknowledged its address
+static int addressing;                  //Next byte written is an address
+static int reading;
+static int op;
+static uint8_t op_data;
+static uint64_t op_end;
+static int op_event = -1;
+static uint64_t bus_cycles;
+static uint64_t hold_until;             //SCL held low by a device until then
+
+void mssp_attach(i2c_device_t *dev){
+    dev->next = devices;
+    devices = dev;
+}
+
+i2c_device_t *mssp_devices(void){
+    return devices;
+}
+
+uint64_t mssp_bus_cycles(void){
+    return bus_cycles;
+}
+
+int mssp_busy(void){
+    return op != OP_NONE;
+}
+
+uint64_t mssp_busy_until(void){
+    //Nothing to skip while SCL is held, the firmware's wait runs its course
+    return hold_until > sim_cycles ? sim_cycles : op_end;
+}
+
+void mssp_hold(uint64_t until){
+    hold_until = until;
+}
+
+void mssp_reset(void){
+    if(op != OP_NONE) sim_cancel(op_event);
+    op = OP_NONE;
+    selected = NULL;
+    addressing = 0;
+    reading = 0;
+}
+
+static void release(void){
+    if(selected && selected->stop) selected->stop(selected);
+    selected = NULL;
+}
+
+static int byte_written(uint8_t data){
+    int ack;
+
+    if(addressing){
+        addressing = 0;
+        release();
+        reading = data & 1;
+        for(i2c_device_t *d = devices; d; d = d->next){
+            if(d->addr != data >> 1 || (d->gate && !(*d->gate & d->gate_mask))) continue;
+            ack = d->start ? d->start(d, reading) : 1;
+            if(ack){
+                selected = d;
+                d->stats.transactions++;
+            }
+            else d->stats.nacks++;
+            return ack;
+        }
+        return 0;
+    }
+    if(!selected || reading) return 0;
+    ack = selected->write ? selected->write(selected, data) : 1;
+    selected->stats.writes++;
+    if(!ack) selected->stats.nacks++;
+    return ack;
+}
+
+static void complete(void *ctx){
+    (void)ctx;
+    switch(op){
+        case OP_START:
+        case OP_RESTART:
+            BITS(SSPCON2).SEN = 0;
+            BITS(SSPCON2).RSEN = 0;
+            BITS(SSPSTAT).S = 1;
+            BITS(SSPSTAT).P = 0;
+            addressing = 1;
+            break;
+        case OP_STOP:
+            BITS(SSPCON2).PEN = 0;
+            BITS(SSPSTAT).S = 0;
+            BITS(SSPSTAT).P = 1;
+            release();
+            addressing = 0;
+            break;
+        case OP_READ:
+            BITS(SSPCON2).RCEN = 0;
+            if(selected && reading){
+                sim_slots[SLOT_SSPBUF] = SLOT_EMPTY | (selected->read ? selected->read(selected) : 0xFF);
+                selected->stats.reads++;
+            }
+            else sim_slots[SLOT_SSPBUF] = SLOT_EMPTY | 0xFF;     //Nobody drives SDA
+            BITS(SSPSTAT).BF = 1;
+            break;
+        case OP_ACK:
+            BITS(SSPCON2).ACKEN = 0;
+            break;
+        case OP_WRITE:
+            REG(SSPSTAT) &= ~SSPSTAT_RW;
+            BITS(SSPSTAT).BF = 0;
+            BITS(SSPCON2).ACKSTAT = !byte_written(op_data);
+            break;
+    }
+    op = OP_NONE;
+    BITS(PIR1).SSPIF = 1;
+}
+
+static void begin(int what, uint32_t bits){
+    uint64_t len = (uint64_t)bits * (REG(SSPADD) + 1u);
+    op = what;
+    op_end = (hold_until > sim_cycles ? hold_until : sim_cycles) + len;
+    bus_cycles += len;
+    op_event = sim_schedule(op_end, complete, NULL);
+}
+
+void mssp_sync(void){
+    uint16_t w = sim_slots[SLOT_SSPBUF];
+    uint8_t cmd = REG(SSPCON2) & CMD_BITS;
+
+    if(!(w & SLOT_EMPTY)) sim_slots[SLOT_SSPBUF] = SLOT_EMPTY | (w & 0xFF);
+    if(!BITS(SSPCON1).SSPEN){
+        //Disabling the module aborts whatever it was doing. The STOP that
+        //I2C_Recover() clocks out by hand ends the device's transaction
+        if(op != OP_NONE || selected){
+            release();
+            mssp_reset();
+        }
+        return;
+    }
+    if((BITS(SSPCON1).SSPM & 0x0F) != 0x08) return;
+
+    if(op != OP_NONE){
+        if(!(w & SLOT_EMPTY)) BITS(SSPCON1).WCOL = 1;  //Write ignored
+        return;
+    }
+    if(!(w & SLOT_EMPTY)){
+        op_data = (uint8_t)w;
+        REG(SSPSTAT) |= SSPSTAT_RW;
+        BITS(SSPSTAT).BF = 1;
+        begin(OP_WRITE, 9);
+    }
+    else if(cmd & 0x01) begin(OP_START, 1);
+    else if(cmd & 0x02) begin(OP_RESTART, 1);
+    else if(cmd & 0x04) begin(OP_STOP, 1);
+    else if(cmd & 0x08) begin(OP_READ, 8);
+    else if(cmd & 0x10) begin(OP_ACK, 1);
+}
@@ -0,0 +1,40 @@
+/*
+ * File:   mssp.h
+ *
+ * MSSP in I2C master mode and the bus it drives. Device models embed an
+ * i2c_device_t and are attached with mssp_attach(); the MSSP addresses
+ * them by their 7 bit address. A device behind a mux sets gate to the
+ * mux's control register and only answers while its channel bit is set.
+ */
+
+#ifndef MSSP_H
+#define MSSP_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint64_t transactions;      //Address bytes acknowledged
+    uint64_t writes;            //Data bytes written to the device
+    uint64_t reads;             //Data bytes read from the device
+    uint64_t nacks;             //Address or data bytes not acknowledged
+} i2c_stats_t;
+
+typedef struct i2c_device {
+    const char *name;
+    uint8_t addr;                                       //7 bit address
+    int (*start)(struct i2c_device *dev, int read);     //Addressed, 1 = ACK
+    int (*write)(struct i2c_device *dev, uint8_t data); //1 = ACK
+    uint8_t (*read)(struct i2c_device *dev);
+    void (*stop)(struct i2c_device *dev);
+    i2c_stats_t stats;
+    const uint8_t *gate;                                //NULL on the main bus
+    uint8_t gate_mask;
+    struct i2c_device *next;
+} i2c_device_t;
+
+void mssp_attach(i2c_device_t *dev);
+i2c_device_t *mssp_devices(void);
+uint64_t mssp_bus_cycles(void);         //Instruction cycles the bus was busy
+void mssp_hold(uint64_t until);         //A device stretches SCL, nothing moves until then
+
+#endif
@@ -0,0 +1,702 @@
+/*
+ * File:   pic18.c
+ *
+ * PIC18F4620 core model. Time only moves when the firmware touches an SFR
+ * (one instruction cycle), calls a delay or waits on a peripheral, so
+ * plain C computation between register accesses is free. Everything that
+ * matters for the sorter's timing (delays, I2C transfers, timer reloads,
+ * EEPROM write cycles) is modelled explicitly.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pic18.h"
+
+extern void isr(void);
+extern void sim_finish(const char *why);
+
+uint8_t sim_mem[SFR_COUNT];
+uint16_t sim_mem16[SFR16_COUNT];
+uint16_t sim_slots[SLOT_COUNT];
+uint64_t sim_cycles;
+uint8_t sim_eeprom[SIM_EEPROM_SIZE];
+sim_stats_t sim_stats;
+uint64_t sim_lcd_updates;
+
+static uint64_t end_cycles = UINT64_MAX;
+static int in_isr;
+
+//<editor-fold defaultstate="collapsed" desc="Events">
+#define MAX_EVENTS  64
+
+static struct {
+    uint64_t at;
+    sim_event_fn fn;
+    void *ctx;
+} events[MAX_EVENTS];
+
+int sim_schedule(uint64_t at, sim_event_fn fn, void *ctx){
+    for(int n = 0; n < MAX_EVENTS; n++){
+        if(events[n].fn) continue;
+        events[n].at = at;
+        events[n].fn = fn;
+        events[n].ctx = ctx;
+        return n;
+    }
+    fprintf(stderr, "sim: event table full\n");
+    exit(1);
+}
+
+void sim_cancel(int handle){
+    if(handle >= 0 && handle < MAX_EVENTS) events[handle].fn = NULL;
+}
+
+static uint64_t next_event(void){
+    uint64_t at = UINT64_MAX;
+    for(int n = 0; n < MAX_EVENTS; n++) if(events[n].fn && events[n].at < at) at = events[n].at;
+    return at;
+}
+
+static void run_events(void){
+    int ran;
+    do{
+        ran = 0;
+        for(int n = 0; n < MAX_EVENTS; n++){
+            if(!events[n].fn || events[n].at > sim_cycles) continue;
+            sim_event_fn fn = events[n].fn;
+            events[n].fn = NULL;
+            fn(events[n].ctx);
+            ran = 1;
+        }
+    }while(ran);
+}
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc="Timers">
+static uint32_t t0_acc, t1_acc, t2_acc, t3_acc;    //Prescaler remainders
+static uint8_t t2_post;
+
+static uint32_t t0_prescale(void){
+    return BITS(T0CON).PSA ? 1 : 2u << (REG(T0CON) & 0x07);
+}
+
+static uint32_t t1_prescale(void){
+    return 1u << ((REG(T1CON) >> 4) & 0x03);
+}
+
+static uint32_t t3_prescale(void){
+    return 1u << ((REG(T3CON) >> 4) & 0x03);
+}
+
+static uint32_t t2_prescale(void){
+    static const uint32_t pre[4] = {1, 4, 16, 16};
+    return pre[REG(T2CON) & 0x03];
+}
+
+static uint64_t until_overflow(uint32_t count, uint32_t top, uint32_t pre, uint32_t acc){
+    return (uint64_t)(top + 1 - count) * pre - acc;
+}
+
+static uint64_t timers_next(void){
+    uint64_t step = UINT64_MAX, s;
+    if(BITS(T0CON).TMR0ON && !BITS(T0CON).T0CS){
+        uint32_t top = BITS(T0CON).T08BIT ? 0xFF : 0xFFFF;
+        s = until_overflow(sim_mem16[SFR16_TMR0] & top, top, t0_prescale(), t0_acc);
+        if(s < step) step = s;
+    }
+    if(BITS(T1CON).TMR1ON && !BITS(T1CON).TMR1CS){
+        s = until_overflow(sim_mem16[SFR16_TMR1], 0xFFFF, t1_prescale(), t1_acc);
+        if(s < step) step = s;
+    }
+    if(BITS(T3CON).TMR3ON && !BITS(T3CON).TMR3CS){
+        s = until_overflow(sim_mem16[SFR16_TMR3], 0xFFFF, t3_prescale(), t3_acc);
+        if(s < step) step = s;
+    }
+    if(BITS(T2CON).TMR2ON){
+        uint32_t pr = REG(PR2);
+        uint32_t cnt = REG(TMR2) <= pr ? REG(TMR2) : 0;
+        s = until_overflow(cnt, pr, t2_prescale(), t2_acc);
+        if(s < step) step = s;
+    }
+    return step;
+}
+
+static void timer16_add(uint16_t *count, uint32_t top, uint32_t pre, uint32_t *acc,
+                        uint64_t step, int *overflow){
+    uint64_t ticks = (*acc + step) / pre;
+    uint64_t total;
+    *acc = (uint32_t)((*acc + step) % pre);
+    total = (*count & top) + ticks;
+    if(total > top) *overflow = 1;
+    *count = (uint16_t)((*count & ~top) | (total & top));
+}
+
+static void timers_add(uint64_t step){
+    int ov;
+    if(BITS(T0CON).TMR0ON && !BITS(T0CON).T0CS){
+        ov = 0;
+        timer16_add(&sim_mem16[SFR16_TMR0], BITS(T0CON).T08BIT ? 0xFF : 0xFFFF,
+                    t0_prescale(), &t0_acc, step, &ov);
+        if(ov) BITS(INTCON).TMR0IF = 1;
+    }
+    if(BITS(T1CON).TMR1ON && !BITS(T1CON).TMR1CS){
+        ov = 0;
+        timer16_add(&sim_mem16[SFR16_TMR1], 0xFFFF, t1_prescale(), &t1_acc, step, &ov);
+        if(ov) BITS(PIR1).TMR1IF = 1;
+    }
+    if(BITS(T3CON).TMR3ON && !BITS(T3CON).TMR3CS){
+        ov = 0;
+        timer16_add(&sim_mem16[SFR16_TMR3], 0xFFFF, t3_prescale(), &t3_acc, step, &ov);
+        if(ov) BITS(PIR2).TMR3IF = 1;
+    }
+    if(BITS(T2CON).TMR2ON){
+        uint64_t ticks = (t2_acc + step) / t2_prescale();
+        t2_acc = (uint32_t)((t2_acc + step) % t2_prescale());
+        while(ticks--){
+            if(REG(TMR2) == REG(PR2)){
+                REG(TMR2) = 0;
+                if(++t2_post > ((REG(T2CON) >> 3) & 0x0F)){
+                    t2_post = 0;
+                    BITS(PIR1).TMR2IF = 1;
+                }
+            }
+            else REG(TMR2)++;
+        }
+    }
+}
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc="Interrupts">
+static int irq_pending(void){
+    if(BITS(INTCON).TMR0IE && BITS(INTCON).TMR0IF) return 1;
+    if(BITS(INTCON).INT0IE && BITS(INTCON).INT0IF) return 1;
+    if(BITS(INTCON).RBIE && BITS(INTCON).RBIF) return 1;
+    if(BITS(INTCON3).INT1IE && BITS(INTCON3).INT1IF) return 1;
+    if(BITS(INTCON3).INT2IE && BITS(INTCON3).INT2IF) return 1;
+    if(!BITS(INTCON).PEIE) return 0;
+    return (REG(PIE1) & REG(PIR1)) || (REG(PIE2) & REG(PIR2));
+}
+
+static void sync(void);
+
+static void dispatch(void){
+    //One priority level (IPEN = 0): GIE is cleared on entry and set by RETFIE.
+    //Writes the ISR left unsynced (TXREG clears TXIF) count before the check.
+    while(!in_isr && BITS(INTCON).GIE && (sync(), irq_pending())){
+        uint64_t start = sim_cycles;
+        in_isr = 1;
+        BITS(INTCON).GIE = 0;
+        sim_stats.isr_calls++;
+        isr();
+        BITS(INTCON).GIE = 1;
+        in_isr = 0;
+        sim_stats.isr_cycles += sim_cycles - start;
+    }
+}
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc="Data EEPROM">
+static int ee_writing;
+static uint16_t ee_addr;
+static uint8_t ee_value;
+
+static void ee_done(void *ctx){
+    (void)ctx;
+    sim_eeprom[ee_addr % SIM_EEPROM_SIZE] = ee_value;
+    BITS(EECON1).WR = 0;
+    BITS(PIR2).EEIF = 1;
+    ee_writing = 0;
+    sim_stats.eeprom_writes++;
+}
+
+static void ee_sync(void){
+    uint16_t addr = (uint16_t)((REG(EEADRH) << 8) | REG(EEADR));
+    if(BITS(EECON1).RD){
+        REG(EEDATA) = sim_eeprom[addr % SIM_EEPROM_SIZE];
+        BITS(EECON1).RD = 0;
+    }
+    if(BITS(EECON1).WR && !ee_writing){
+        if(!BITS(EECON1).WREN){
+            BITS(EECON1).WR = 0;
+            return;
+        }
+        ee_writing = 1;
+        ee_addr = addr;
+        ee_value = REG(EEDATA);
+        sim_schedule(sim_cycles + SIM_MS(4), ee_done, NULL);
+    }
+}
+
+//The queue producers of eeprom.c, linked with --wrap (Makefile). eeprom.h
+//keeps them to the main loop, a call from isr() ends the run
+void __real_eeprom_writebyte(uint16_t address, uint8_t data);
+void __real_eeprom_write_record(uint16_t address, const uint8_t *data, uint8_t len);
+void __real_eeprom_invalidate_record(uint16_t address);
+
+void __wrap_eeprom_writebyte(uint16_t address, uint8_t data){
+    if(in_isr) sim_finish("eeprom_writebyte() from isr()");
+    __real_eeprom_writebyte(address, data);
+}
+
+void __wrap_eeprom_write_record(uint16_t address, const uint8_t *data, uint8_t len){
+    if(in_isr) sim_finish("eeprom_write_record() from isr()");
+    __real_eeprom_write_record(address, data, len);
+}
+
+void __wrap_eeprom_invalidate_record(uint16_t address){
+    if(in_isr) sim_finish("eeprom_invalidate_record() from isr()");
+    __real_eeprom_invalidate_record(address);
+}
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc="EUSART">
+#define RX_FIFO 256
+
+static FILE *uart_out;
+static int tsr_busy, txreg_full;
+static uint8_t txreg_hold;
+static uint8_t rx_fifo[RX_FIFO];
+static int rx_head, rx_tail, rcreg_read;
+static int hw_rx_count;                 //Bytes in the 2 deep hardware FIFO
+static uint8_t hw_rx[2];
+static int rx_event = -1;
+
+static uint64_t uart_byte_cycles(void){
+    uint32_t brg = ((uint32_t)REG(SPBRGH) << 8) | REG(SPBRG);
+    uint32_t div;
+    if(!BITS(BAUDCON).BRG16) brg &= 0xFF;
+    if(BITS(BAUDCON).BRG16 && BITS(TXSTA).BRGH) div = 4;
+    else if(BITS(BAUDCON).BRG16 || BITS(TXSTA).BRGH) div = 16;
+    else div = 64;
+    //10 bits at Fosc / (div * (brg + 1)), in instruction cycles (Fosc / 4)
+    return (uint64_t)10 * div * (brg + 1) / 4;
+}
+
+void sim_uart_set_output(FILE *f){
+    uart_out = f;
+}
+
+static void tx_start(uint8_t c);
+
+static void tx_done(void *ctx){
+    uint8_t c = (uint8_t)(uintptr_t)ctx;
+    if(uart_out) fputc(c, uart_out);
+    sim_stats.uart_tx_bytes++;
+    tsr_busy = 0;
+    if(txreg_full){
+        txreg_full = 0;
+        tx_start(txreg_hold);
+    }
+    else BITS(TXSTA).TRMT = 1;
+}
+
+static void tx_start(uint8_t c){
+    tsr_busy = 1;
+    BITS(TXSTA).TRMT = 0;
+    BITS(PIR1).TXIF = 1;
+    sim_schedule(sim_cycles + uart_byte_cycles(), tx_done, (void *)(uintptr_t)c);
+}
+
+static void rx_update(void){
+    BITS(PIR1).RCIF = hw_rx_count > 0;
+    if(hw_rx_count) REG(RCREG) = hw_rx[0];
+}
+
+static void rx_deliver(void *ctx){
+    (void)ctx;
+    rx_event = -1;
+    if(rx_head == rx_tail) return;
+    if(BITS(RCSTA).SPEN && BITS(RCSTA).CREN){
+        if(BITS(RCSTA).OERR) ;                      //Receiver stalled until CREN toggles
+        else if(hw_rx_count == 2) BITS(RCSTA).OERR = 1;
+        else hw_rx[hw_rx_count++] = rx_fifo[rx_tail];
+        rx_update();
+    }
+    rx_tail = (rx_tail + 1) % RX_FIFO;
+    if(rx_head != rx_tail) rx_event = sim_schedule(sim_cycles + uart_byte_cycles(), rx_deliver, NULL);
+}
+
+void sim_uart_rx(const uint8_t *p, int len){
+    for(int n = 0; n < len; n++){
+        rx_fifo[rx_head] = p[n];
+        rx_head = (rx_head + 1) % RX_FIFO;
+    }
+    if(rx_event < 0) rx_event = sim_schedule(sim_cycles + uart_byte_cycles(), rx_deliver, NULL);
+}
+
+static void uart_sync(void){
+    uint16_t w = sim_slots[SLOT_TXREG];
+    static int cren_prev;
+
+    if(!(w & SLOT_EMPTY)){
+        sim_slots[SLOT_TXREG] = SLOT_EMPTY;
+        if(BITS(RCSTA).SPEN && BITS(TXSTA).TXEN){
+            if(!tsr_busy) tx_start((uint8_t)w);
+            else{
+                txreg_full = 1;
+                txreg_hold = (uint8_t)w;
+                BITS(PIR1).TXIF = 0;
+            }
+        }
+    }
+    if(rcreg_read){
+        rcreg_read = 0;
+        if(hw_rx_count){
+            hw_rx[0] = hw_rx[1];
+            hw_rx_count--;
+        }
+        rx_update();
+    }
+    if(!BITS(RCSTA).CREN && cren_prev) BITS(RCSTA).OERR = 0;
+    cren_prev = BITS(RCSTA).CREN;
+}
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc="HD44780 LCD on LATD">
+static char ddram[0x68];
+static uint8_t lcd_addr, lcd_prev_latd, lcd_high, lcd_half;
+static int lcd_4bit;
+static char lcd_lines[2][17];
+
+static void lcd_instruction(uint8_t c){
+    if(c == 0x01){
+        memset(ddram, ' ', sizeof(ddram));
+        lcd_addr = 0;
+        sim_lcd_updates++;
+    }
+    else if((c & 0xFE) == 0x02) lcd_addr = 0;
+    else if(c & 0x80) lcd_addr = c & 0x7F;
+    else if((c & 0xE0) == 0x20){
+        lcd_4bit = !(c & 0x10);
+        lcd_half = 0;
+    }
+}
+
+static void lcd_data(uint8_t c){
+    if(lcd_addr < sizeof(ddram)) ddram[lcd_addr] = (char)c;
+    lcd_addr++;
+    if(lcd_addr == 0x28) lcd_addr = 0x40;
+    else if(lcd_addr >= 0x68) lcd_addr = 0;
+    sim_lcd_updates++;
+}
+
+static void lcd_sync(void){
+    uint8_t latd = REG(LATD);
+    //E (RD3) falling edge latches the upper nibble, RS is RD2
+    if((lcd_prev_latd & 0x08) && !(latd & 0x08)){
+        uint8_t nibble = latd & 0xF0;
+        int rs = (latd & 0x04) != 0;
+        if(!lcd_4bit){
+            if(rs) lcd_data(nibble);
+            else lcd_instruction(nibble);
+        }
+        else if(!lcd_half){
+            lcd_high = nibble;
+            lcd_half = 1;
+        }
+        else{
+            uint8_t c = lcd_high | (nibble >> 4);
+            lcd_half = 0;
+            if(rs) lcd_data(c);
+            else lcd_instruction(c);
+        }
+    }
+    lcd_prev_latd = latd;
+}
+
+const char *sim_lcd_line(int line){
+    const char *src = ddram + (line ? 0x40 : 0);
+    for(int n = 0; n < 16; n++){
+        char c = src[n];
+        lcd_lines[line][n] = (c >= 0x20 && c < 0x7F) ? c : '?';
+    }
+    lcd_lines[line][16] = 0;
+    return lcd_lines[line];
+}
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc="Pins and keypad">
+static struct {
+    sim_lat_fn fn;
+    void *ctx;
+    uint8_t prev;
+} lat_watch[5];
+
+void sim_watch_lat(int port, sim_lat_fn fn, void *ctx){
+    lat_watch[port].fn = fn;
+    lat_watch[port].ctx = ctx;
+    lat_watch[port].prev = sim_mem[SFR_LATA + port];
+}
+
+static void lat_sync(void){
+    for(int port = 0; port < 5; port++){
+        uint8_t now = sim_mem[SFR_LATA + port];
+        if(!lat_watch[port].fn || now == lat_watch[port].prev) continue;
+        lat_watch[port].fn(lat_watch[port].ctx, lat_watch[port].prev, now);
+        lat_watch[port].prev = now;
+    }
+}
+
+void sim_set_pin(int port, int bit, int level){
+    uint8_t *p = &sim_mem[SFR_PORTA + port];
+    int old = (*p >> bit) & 1;
+    if(level) *p |= (uint8_t)(1u << bit);
+    else *p &= (uint8_t)~(1u << bit);
+    if(port != 1 || old == level) return;
+
+    //INT0..2 on RB0..RB2, edge selected by INTEDGx (1 = rising)
+    if(bit == 0 && level == BITS(INTCON2).INTEDG0) BITS(INTCON).INT0IF = 1;
+    if(bit == 1 && level == BITS(INTCON2).INTEDG1) BITS(INTCON3).INT1IF = 1;
+    if(bit == 2 && level == BITS(INTCON2).INTEDG2) BITS(INTCON3).INT2IF = 1;
+}
+
+static void key_release(void *ctx){
+    (void)ctx;
+    //Encoder data lines float high (pull ups) once DA drops
+    REG(PORTB) |= 0xF0;
+    sim_set_pin(1, 1, 0);
+}
+
+void sim_key_press(uint8_t code, uint64_t hold){
+    //74C922 style encoder: key code on RB7:RB4, data available on RB1/INT1
+    REG(PORTB) = (uint8_t)((REG(PORTB) & 0x0F) | (code << 4));
+    sim_set_pin(1, 1, 1);
+    sim_schedule(sim_cycles + hold, key_release, NULL);
+}
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc="Watchdog">
+static uint64_t wdt_cleared;            //Last CLRWDT, SLEEP or enable
+static int wdt_on, sleeping, wdt_woke, wdt_forced;
+static uint64_t reset_at;               //Power up or the last WDT reset
+static int booted;                      //CLRWDT seen since then
+
+extern void sim_restart(void);
+static void sfr_reset(void);
+
+static void wdt_sync(void){
+    int on = BITS(WDTCON).SWDTEN;
+    if(on && !wdt_on) wdt_cleared = sim_cycles;
+    wdt_on = on;
+}
+
+static uint64_t wdt_next(void){
+    uint64_t at = wdt_cleared + SIM_MS(WDT_PERIOD_MS);
+    if(!wdt_on) return UINT64_MAX;
+    if(wdt_forced) return 0;
+    return at > sim_cycles ? at - sim_cycles : 0;
+}
+
+static void wdt_clear(void){
+    if(wdt_on && sim_cycles - wdt_cleared > sim_stats.wdt_gap_max) sim_stats.wdt_gap_max = sim_cycles - wdt_cleared;
+    wdt_cleared = sim_cycles;
+}
+
+static void wdt_timeout(void){
+    uint8_t pins[5], lat[5], rcon;
+
+    if(sleeping && !wdt_forced){
+        //Wakes the core, which carries on after the SLEEP
+        BITS(RCON).nTO = 0;
+        wdt_cleared = sim_cycles;
+        wdt_woke = 1;
+        sim_stats.wdt_wakes++;
+        return;
+    }
+    //Device reset: SFRs go back to their reset values but the LATs keep
+    //theirs, pins stay where the outside world holds them and RCON only
+    //drops nTO. RAM is the board's business, see sim_restart()
+    memcpy(pins, &sim_mem[SFR_PORTA], sizeof(pins));
+    memcpy(lat, &sim_mem[SFR_LATA], sizeof(lat));
+    rcon = REG(RCON);
+    sfr_reset();
+    memcpy(&sim_mem[SFR_PORTA], pins, sizeof(pins));
+    memcpy(&sim_mem[SFR_LATA], lat, sizeof(lat));
+    REG(RCON) = rcon;
+    BITS(RCON).nTO = 0;
+    wdt_on = 0;
+    wdt_forced = 0;
+    sleeping = 0;                       //A reset out of sim_sleep() never returns to it
+    reset_at = sim_cycles;
+    booted = 0;
+    sim_stats.wdt_resets++;
+    sim_restart();
+}
+
+void sim_wdt_force(void){
+    //Picked up by sim_advance_to() after the events, a reset even in SLEEP
+    if(wdt_on) wdt_forced = 1;
+}
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc="Time">
+static void sync(void){
+    wdt_sync();
+    mssp_sync();
+    ee_sync();
+    uart_sync();
+    lcd_sync();
+    lat_sync();
+}
+
+void sim_set_end(uint64_t at){
+    end_cycles = at;
+}
+
+
+void sim_advance_to(uint64_t target){
+    while(sim_cycles < target){
+        uint64_t step = target - sim_cycles, s;
+        s = timers_next();
+        if(s < step) step = s;
+        s = next_event();
+        if(s != UINT64_MAX && s > sim_cycles && s - sim_cycles < step) step = s - sim_cycles;
+        s = wdt_next();
+        if(s < step) step = s;
+        if(step == 0) step = 1;
+        if(sim_cycles + step > end_cycles) step = end_cycles > sim_cycles ? end_cycles - sim_cycles : 1;
+
+        timers_add(step);
+        sim_cycles += step;
+        run_events();
+        sync();
+        if(wdt_next() == 0) wdt_timeout();
+        dispatch();
+        if(sim_cycles >= end_cycles) sim_finish("end of scenario");
+    }
+}
+
+void sim_spin(void){
+    //The core still runs a loop that never touches a register, so time
+    //goes on: interrupts are serviced and the WDT runs out unless it is
+    //off. Returns if nothing would ever end the loop
+    if(end_cycles == UINT64_MAX && !wdt_on) return;
+    if(!sim_stats.spin_at) sim_stats.spin_at = sim_cycles;
+    sim_advance_to(end_cycles == UINT64_MAX ? sim_cycles + wdt_next() + 1 : end_cycles);
+}
+
+void sim_advance(uint64_t cycles){
+    sim_advance_to(sim_cycles + cycles);
+}
+
+double sim_seconds(void){
+    return (double)sim_cycles / SIM_FCY;
+}
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc="Firmware entry points (include/xc.h)">
+volatile uint8_t *sim_sfr(int id){
+    sim_stats.sfr_accesses++;
+    sync();
+    //Polling a busy MSSP only burns time, skip straight to the end of it
+    if((id == SFR_SSPSTAT || id == SFR_SSPCON2) && mssp_busy()) sim_advance_to(mssp_busy_until());
+    sim_advance(1);
+    if(id == SFR_RCREG) rcreg_read = 1;
+    return &sim_mem[id];
+}
+
+volatile uint16_t *sim_sfr16(int id){
+    sim_stats.sfr_accesses++;
+    sync();
+    sim_advance(1);
+    return &sim_mem16[id];
+}
+
+volatile uint16_t *sim_slot(int id){
+    sim_stats.sfr_accesses++;
+    sync();
+    if(id == SLOT_SSPBUF && mssp_busy()) sim_advance_to(mssp_busy_until());
+    sim_advance(1);
+    return &sim_slots[id];
+}
+
+void sim_delay_us(unsigned long us){
+    sync();
+    sim_advance(us ? SIM_US(us) : 1);
+}
+
+void sim_sleep(void){
+    //Wakes on any enabled interrupt flag, whether or not GIE is set. With
+    //GIE set the flag is serviced inside sim_advance(), so a dispatched
+    //interrupt is a wake as well. SLEEP clears the WDT, which then wakes
+    //the core rather than resetting it
+    uint64_t start = sim_cycles, calls = sim_stats.isr_calls;
+    sync();
+    wdt_clear();
+    BITS(RCON).nTO = 1;
+    BITS(RCON).nPD = 0;
+    sleeping = 1;
+    wdt_woke = 0;
+    while(!irq_pending() && sim_stats.isr_calls == calls && !wdt_woke){
+        uint64_t s = timers_next(), e = next_event();
+        if(e != UINT64_MAX) e = e > sim_cycles ? e - sim_cycles : 1;
+        if(e < s) s = e;
+        e = wdt_next();
+        if(e < s) s = e ? e : 1;
+        if(s == UINT64_MAX) sim_finish("SLEEP with no wake source");
+        sim_advance(s);
+    }
+    sleeping = 0;
+    sim_stats.sleep_cycles += sim_cycles - start;
+}
+
+void sim_clrwdt(void){
+    sync();
+    wdt_clear();
+    if(!booted){
+        sim_stats.boot_cycles = sim_cycles - reset_at;
+        booted = 1;
+    }
+    BITS(RCON).nTO = 1;
+    BITS(RCON).nPD = 1;
+    sim_advance(1);
+}
+
+void sim_reset(void){
+    sim_finish("RESET instruction");
+}
+
+int sim_printf(const char *fmt, ...){
+    char buf[128];
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    for(int n = 0; buf[n]; n++) putch(buf[n]);
+    return len;
+}
+//</editor-fold>
+
+static void sfr_reset(void){
+    //Reset values that the firmware relies on, the core's own state with
+    //them. Whatever the EUSART and EEPROM had under way still finishes
+    memset(sim_mem, 0, sizeof(sim_mem));
+    memset(sim_mem16, 0, sizeof(sim_mem16));
+    sim_slots[SLOT_SSPBUF] = SLOT_EMPTY;
+    sim_slots[SLOT_TXREG] = SLOT_EMPTY;
+    REG(TRISA) = REG(TRISB) = REG(TRISC) = REG(TRISD) = 0xFF;
+    REG(TRISE) = 0x07;
+    REG(INTCON2) = 0xF5;
+    REG(T0CON) = 0xFF;
+    REG(PR2) = 0xFF;
+    REG(TXSTA) = 0x02;
+    REG(RCON) = 0x1C;
+    BITS(PIR1).TXIF = 1;
+    t0_acc = t1_acc = t2_acc = t3_acc = 0;
+    t2_post = 0;
+    txreg_full = 0;
+    hw_rx_count = 0;
+    rcreg_read = 0;
+    in_isr = 0;
+    mssp_reset();
+}
+
+void sim_init(void){
+    sfr_reset();
+    memset(ddram, ' ', sizeof(ddram));
+    REG(PORTB) = 0xF0;
+}
@@ -0,0 +1,79 @@
+/*
+ * File:   pic18.h
+ *
+ * PIC18F4620 core model used by the Linux simulator: SFR storage,
+ * simulated time, timers, interrupts, data EEPROM, EUSART, LCD and
+ * keypad. The firmware reaches it through the accessors in include/xc.h;
+ * peripheral and device models use the raw storage below.
+ */
+
+#ifndef PIC18_H
+#define PIC18_H
+
+#define SIM_CORE
+#include <stdint.h>
+#include "include/xc.h"
+#include "../configBits.h"
+
+#define SIM_FCY             (_XTAL_FREQ / 4)            //Instruction cycles per second
+#define SIM_US(us)          ((uint64_t)((us) * (SIM_FCY / 1000000.0) + 0.5))
+#define SIM_MS(ms)          SIM_US((ms) * 1000.0)
+#define SIM_EEPROM_SIZE     1024
+
+extern uint8_t sim_mem[SFR_COUNT];
+extern uint16_t sim_mem16[SFR16_COUNT];
+extern uint16_t sim_slots[SLOT_COUNT];
+#define REG(name)           sim_mem[SFR_##name]
+#define BITS(name)          (*(name##bits_t *)&sim_mem[SFR_##name])
+#define SLOT_EMPTY          0x8000      //Set while the firmware hasn't written the slot
+
+extern uint64_t sim_cycles;             //Instruction cycles since power up
+extern uint8_t sim_eeprom[SIM_EEPROM_SIZE];
+
+typedef struct {
+    uint64_t isr_calls;
+    uint64_t isr_cycles;
+    uint64_t sfr_accesses;
+    uint64_t eeprom_writes;
+    uint64_t uart_tx_bytes;
+    uint64_t sleep_cycles;
+    uint64_t wdt_resets;
+    uint64_t wdt_wakes;
+    uint64_t wdt_gap_max;       //Longest the WDT ran without a clear
+    uint64_t boot_cycles;       //Reset to the first CLRWDT, the last time
+    uint64_t spin_at;           //Firmware looped without touching a register from here, 0 = never
+} sim_stats_t;
+extern sim_stats_t sim_stats;
+
+//Time and events
+typedef void (*sim_event_fn)(void *ctx);
+void sim_advance(uint64_t cycles);
+void sim_advance_to(uint64_t at);
+int sim_schedule(uint64_t at, sim_event_fn fn, void *ctx);
+void sim_cancel(int handle);
+double sim_seconds(void);
+void sim_set_end(uint64_t at);
+void sim_spin(void);                //Firmware loops without touching a register, see board.c
+void sim_wdt_force(void);           //WDT runs out now, as if the firmware had hung
+
+//Pins and inputs
+void sim_set_pin(int port, int bit, int level);     //port 0 = A ... 4 = E
+void sim_key_press(uint8_t code, uint64_t hold);
+void sim_uart_rx(const uint8_t *p, int len);
+void sim_uart_set_output(FILE *f);
+typedef void (*sim_lat_fn)(void *ctx, uint8_t old, uint8_t now);
+void sim_watch_lat(int port, sim_lat_fn fn, void *ctx);  //Called when LATx changes
+
+//LCD contents, 2 lines of 16 characters
+const char *sim_lcd_line(int line);
+extern uint64_t sim_lcd_updates;
+
+//Hooks for the MSSP model (mssp.c)
+void mssp_reset(void);
+void mssp_sync(void);
+int mssp_busy(void);
+uint64_t mssp_busy_until(void);
+
+void sim_init(void);
+
+#endif
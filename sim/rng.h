@@ -0,0 +1,38 @@
+/*
+ * File:   rng.h
+ *
+ * Small seeded generator for the simulator, so a seed always gives the
+ * same bottle stream and sensor noise on every host.
+ */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <math.h>
+#include <stdint.h>
+
+typedef uint64_t rng_t;
+
+static inline void rng_seed(rng_t *r, uint64_t seed){
+    *r = 0x9E3779B97F4A7C15ULL ^ (seed * 0xD1B54A32D192ED03ULL);
+    if(!*r) *r = 1;
+}
+
+static inline double rng_uniform(rng_t *r){
+    //xorshift64*, [0, 1)
+    *r ^= *r >> 12;
+    *r ^= *r << 25;
+    *r ^= *r >> 27;
+    return ((*r * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline double rng_gauss(rng_t *r){
+    double u = rng_uniform(r);
+    return sqrt(-2.0 * log(u > 0 ? u : 1e-300)) * cos(2 * M_PI * rng_uniform(r));
+}
+
+static inline double rng_exp(rng_t *r, double mean){
+    return -mean * log(1.0 - rng_uniform(r));
+}
+
+#endif
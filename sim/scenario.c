@@ -0,0 +1,237 @@
+/*
+ * File:   scenario.c
+ *
+ * Scenario file parser and player. Steps are kept sorted by time and
+ * played one at a time from a single scheduled event.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pic18.h"
+#include "mssp.h"
+#include "scenario.h"
+
+static const char keys[] = "123A456B789C*0#D";     //Same codes as keypad.h
+
+static int by_time(const void *a, const void *b){
+    const scenario_step_t *x = a, *y = b;
+    if(x->at != y->at) return x->at < y->at ? -1 : 1;
+    return x->seq - y->seq;             //Same time, file order
+}
+
+int scenario_add(scenario_t *sc, const scenario_step_t *step){
+    if(step->kind == SC_TCSB) sc->dual = 1;
+    if(sc->count == sc->cap){
+        int cap = sc->cap ? sc->cap * 2 : 64;
+        scenario_step_t *p = realloc(sc->steps, cap * sizeof(*p));
+        if(!p) return -1;
+        sc->steps = p;
+        sc->cap = cap;
+    }
+    sc->steps[sc->count] = *step;
+    sc->steps[sc->count].seq = sc->count;
+    sc->count++;
+    return 0;
+}
+
+static int parse_line(scenario_t *sc, char *line){
+    scenario_step_t st;
+    char cmd[8], arg[16];
+    double ms, hold;
+    unsigned c, r, g, b;
+    int n, off;
+
+    memset(&st, 0, sizeof(st));
+    if(sscanf(line, "%7s%n", cmd, &off) != 1 || cmd[0] == '#') return 0;
+    line += off;
+
+    if(!strcmp(cmd, "noise")){
+        unsigned long long seed;
+        if(sscanf(line, "%lf %llu", &sc->noise, &seed) != 2 || sc->noise < 0) return -1;
+        sc->seed = seed;
+        return 0;
+    }
+    if(!strcmp(cmd, "unit") || !strcmp(cmd, "unitb")){
+        double *u = sc->unit[cmd[4] ? 1 : 0];
+        if(sscanf(line, "%lf %lf %lf %lf", &u[0], &u[1], &u[2], &u[3]) != 4) return -1;
+        for(n = 0; n < 4; n++) if(u[n] <= 0) return -1;
+        return 0;
+    }
+    if(!strcmp(cmd, "rtc")){
+        int *t = sc->rtc;
+        if(sscanf(line, "%d-%d-%d %d:%d:%d", &t[0], &t[1], &t[2], &t[3], &t[4], &t[5]) != 6) return -1;
+        sc->rtc_set = 1;
+        return 0;
+    }
+    if(sscanf(line, "%lf%n", &ms, &off) != 1 || ms < 0) return -1;
+    line += off;
+    st.at = SIM_MS(ms);
+
+    if(!strcmp(cmd, "end")){
+        sc->end = st.at;
+        return 0;
+    }
+    if(!strcmp(cmd, "bottle")){
+        double out;
+        int cls;
+        if(sscanf(line, "%lf %d", &out, &cls) != 2) return -1;
+        return truth_add(&sc->truth, ms / 1000, out / 1000, cls);
+    }
+    if(!strcmp(cmd, "tcs") || !strcmp(cmd, "tcsb")){
+        if(sscanf(line, "%u %u %u %u", &c, &r, &g, &b) != 4) return -1;
+        st.kind = cmd[3] ? SC_TCSB : SC_TCS;
+        st.crgb[0] = c; st.crgb[1] = r; st.crgb[2] = g; st.crgb[3] = b;
+    }
+    else if(!strcmp(cmd, "key")){
+        const char *k;
+        n = sscanf(line, "%15s %lf", arg, &hold);
+        if(n < 1 || strlen(arg) != 1 || !(k = strchr(keys, arg[0]))) return -1;
+        st.kind = SC_KEY;
+        st.key = (uint8_t)(k - keys);
+        st.hold = SIM_MS(n == 2 ? hold : 100);
+    }
+    else if(!strcmp(cmd, "rx")){
+        unsigned v;
+        st.kind = SC_RX;
+        while(st.len < (int)sizeof(st.data) && sscanf(line, "%x%n", &v, &off) == 1){
+            st.data[st.len++] = (uint8_t)v;
+            line += off;
+        }
+        if(!st.len) return -1;
+    }
+    else if(!strcmp(cmd, "i2chang")){
+        if(sscanf(line, "%lf", &hold) != 1 || hold < 0) return -1;
+        st.kind = SC_HANG;
+        st.hold = SIM_MS(hold);
+    }
+    else if(!strcmp(cmd, "wdt")) st.kind = SC_WDT;
+    else return -1;
+    return scenario_add(sc, &st);
+}
+
+int scenario_load(scenario_t *sc, const char *path){
+    char line[256];
+    int lineno = 0;
+    FILE *f = fopen(path, "r");
+
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f)){
+        lineno++;
+        if(parse_line(sc, line)){
+            fprintf(stderr, "%s:%d: bad line: %s", path, lineno, line);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+int scenario_save(const scenario_t *sc, const char *path){
+    FILE *f = fopen(path, "w");
+
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    if(sc->rtc_set){
+        const int *t = sc->rtc;
+        fprintf(f, "rtc %04d-%02d-%02d %02d:%02d:%02d\n", t[0], t[1], t[2], t[3], t[4], t[5]);
+    }
+    if(sc->noise > 0) fprintf(f, "noise %g %llu\n", sc->noise, (unsigned long long)sc->seed);
+    for(int s = 0; s < 2; s++){
+        const double *u = sc->unit[s];
+        if(u[0] > 0) fprintf(f, "%s %g %g %g %g\n", s ? "unitb" : "unit", u[0], u[1], u[2], u[3]);
+    }
+    for(int n = 0; n < sc->count; n++){
+        const scenario_step_t *st = &sc->steps[n];
+        double ms = (double)st->at * 1000 / SIM_FCY;
+        switch(st->kind){
+            case SC_TCS:
+            case SC_TCSB:
+                fprintf(f, "%s %.1f %u %u %u %u\n", st->kind == SC_TCSB ? "tcsb" : "tcs", ms,
+                        st->crgb[0], st->crgb[1], st->crgb[2], st->crgb[3]);
+                break;
+            case SC_KEY:
+                fprintf(f, "key %.1f %c %.1f\n", ms, keys[st->key], (double)st->hold * 1000 / SIM_FCY);
+                break;
+            case SC_RX:
+                fprintf(f, "rx %.1f", ms);
+                for(int k = 0; k < st->len; k++) fprintf(f, " %02x", st->data[k]);
+                fputc('\n', f);
+                break;
+            case SC_HANG:
+                fprintf(f, "i2chang %.1f %.1f\n", ms, (double)st->hold * 1000 / SIM_FCY);
+                break;
+            case SC_WDT:
+                fprintf(f, "wdt %.1f\n", ms);
+                break;
+        }
+    }
+    for(int n = 0; n < sc->truth.n; n++){
+        const truth_bottle_t *b = &sc->truth.bottle[n];
+        fprintf(f, "bottle %.1f %.1f %d\n", b->in * 1000, b->out * 1000, b->cls);
+    }
+    if(sc->end) fprintf(f, "end %.1f\n", (double)sc->end * 1000 / SIM_FCY);
+    return fclose(f);
+}
+
+static void play(void *ctx){
+    scenario_t *sc = ctx;
+
+    while(sc->next < sc->count && sc->steps[sc->next].at <= sim_cycles){
+        scenario_step_t *st = &sc->steps[sc->next++];
+        switch(st->kind){
+            case SC_TCS:
+                memcpy(sc->light, st->crgb, sizeof(sc->light));
+                break;
+            case SC_TCSB:
+                memcpy(sc->lightb, st->crgb, sizeof(sc->lightb));
+                break;
+            case SC_KEY:
+                sim_key_press(st->key, st->hold);
+                break;
+            case SC_RX:
+                sim_uart_rx(st->data, st->len);
+                break;
+            case SC_HANG:
+                mssp_hold(sim_cycles + st->hold);
+                break;
+            case SC_WDT:
+                sim_wdt_force();
+                break;
+        }
+    }
+    if(sc->next < sc->count) sim_schedule(sc->steps[sc->next].at, play, sc);
+}
+
+void scenario_start(scenario_t *sc){
+    qsort(sc->steps, sc->count, sizeof(*sc->steps), by_time);
+    sc->next = 0;
+    rng_seed(&sc->rng, sc->seed);
+    sc->truth.early = sc->dual;
+    if(sc->end) sim_set_end(sc->end);
+    if(sc->count) sim_schedule(sc->steps[0].at, play, sc);
+}
+
+static void light(scenario_t *sc, const uint16_t *in, const double *unit, uint16_t crgb[4]){
+    for(int n = 0; n < 4; n++){
+        double v = unit[n] > 0 ? in[n] * unit[n] / 100 : in[n];
+        if(sc->noise > 0) v = v * (1 + sc->noise * rng_gauss(&sc->rng)) + rng_gauss(&sc->rng);
+        crgb[n] = v < 0 ? 0 : v > 65535 ? 65535 : (uint16_t)(v + 0.5);
+    }
+}
+
+void scenario_light(void *ctx, uint16_t crgb[4]){
+    scenario_t *sc = ctx;
+    light(sc, sc->light, sc->unit[0], crgb);
+}
+
+void scenario_light_bottom(void *ctx, uint16_t crgb[4]){
+    scenario_t *sc = ctx;
+    light(sc, sc->lightb, sc->unit[1], crgb);
+}
@@ -0,0 +1,74 @@
+/*
+ * File:   scenario.h
+ *
+ * Timed stimulus for the simulator, read from a text file:
+ *
+ *   # comment
+ *   rtc  2017-04-11 13:19:30       RTC time at power up
+ *   tcs  <ms> <C> <R> <G> <B>      Light at the sensor from <ms> on, counts
+ *                                  per 2.4ms integration at 16x gain
+ *   tcsb <ms> <C> <R> <G> <B>      Light at the bottom (body) sensor. Any
+ *                                  tcsb line fits the TCA9548A and a second
+ *                                  TCS34725, tcs is then the top one
+ *   unit <C> <R> <G> <B>           This unit's sensitivity per channel in
+ *                                  percent of nominal, unitb for the bottom
+ *                                  sensor. Applies to every tcs/tcsb line
+ *   key  <ms> <key> [hold ms]      Keypad press, key is one of 123A456B789C*0#D
+ *   rx   <ms> <hex bytes...>       Bytes arriving on the EUSART
+ *   i2chang <ms> <hold ms>         A device holds SCL low, every I2C
+ *                                  operation waits until it lets go
+ *   wdt  <ms>                      The WDT runs out, as if the firmware
+ *                                  had hung long enough. Nothing without
+ *                                  SWDTEN set
+ *   end  <ms>                      Stop the simulation
+ *   noise <fraction> <seed>        Gaussian noise on every integration,
+ *                                  relative sd plus 1 count absolute
+ *   bottle <in ms> <out ms> <class>  Label: a bottle of class 1..4
+ *                                  (bottle_count_array index) in front of
+ *                                  the sensor, used to score the run
+ */
+
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <stdint.h>
+#include "rng.h"
+#include "truth.h"
+
+enum { SC_TCS, SC_KEY, SC_RX, SC_TCSB, SC_HANG, SC_WDT };
+
+typedef struct {
+    uint64_t at;                //Instruction cycles
+    int kind;
+    uint16_t crgb[4];
+    uint8_t key;
+    uint64_t hold;
+    uint8_t data[32];
+    int len;
+    int seq;                    //Order of insertion, set by scenario_add()
+} scenario_step_t;
+
+typedef struct {
+    scenario_step_t *steps;
+    int count, cap, next;
+    uint16_t light[4];          //Current sensor input
+    uint16_t lightb[4];         //Bottom sensor
+    int dual;                   //Two sensors behind the mux
+    double unit[2][4];          //Sensitivity, top and bottom, 0 = nominal
+    uint64_t end;               //0 if the file has no end line
+    int rtc_set;
+    int rtc[6];                 //Year, month, day, hour, minute, second
+    double noise;
+    uint64_t seed;
+    rng_t rng;
+    truth_t truth;              //bottle labels
+} scenario_t;
+
+int scenario_load(scenario_t *sc, const char *path);
+int scenario_save(const scenario_t *sc, const char *path);
+int scenario_add(scenario_t *sc, const scenario_step_t *step);
+void scenario_start(scenario_t *sc);
+void scenario_light(void *ctx, uint16_t crgb[4]);  //tcs34725_source_fn
+void scenario_light_bottom(void *ctx, uint16_t crgb[4]);
+
+#endif
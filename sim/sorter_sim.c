@@ -0,0 +1,142 @@
+/*
+ * File:   sorter_sim.c
+ *
+ * Runs the unmodified sorter firmware on Linux against the simulated
+ * PIC18F4620, TCS34725, DS1307 and 24LC256, driven by a scenario file.
+ * A scenario with tcsb lines runs the two sensor board, see board.h.
+ *
+ *   sorter_sim [-t tlm.bin] [-e eeprom.bin] [-x ext.bin] scenario.txt
+ *
+ * -t writes the EUSART output (telemetry frames, see tools/tlmdecode),
+ * -e and -x load and save the internal and external EEPROM contents so
+ * consecutive runs see each other's history.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "board.h"
+
+#define DEFAULT_TAIL_MS     2000        //Run time after the last step without an end line
+
+extern unsigned long bottle_count_array[5];
+
+static scenario_t scenario;
+static board_t board;
+
+static int load(const char *path, uint8_t *p, size_t len){
+    FILE *f;
+    if(!path || !(f = fopen(path, "rb"))) return 0;
+    if(fread(p, 1, len, f) != len) fprintf(stderr, "%s: short file\n", path);
+    fclose(f);
+    return 1;
+}
+
+static void save(const char *path, const uint8_t *p, size_t len){
+    FILE *f;
+    if(!path) return;
+    if(!(f = fopen(path, "wb")) || fwrite(p, 1, len, f) != len) perror(path);
+    if(f) fclose(f);
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-t tlm.bin] [-e eeprom.bin] [-x ext.bin] scenario.txt\n", prog);
+    exit(2);
+}
+
+static void report(const char *why){
+    double secs = sim_seconds();
+
+    printf("finished: %s at %.3f s\n", why, secs);
+    printf("lcd: |%s|\n", sim_lcd_line(0));
+    printf("     |%s|\n", sim_lcd_line(1));
+    printf("bottles: total %lu, yop+cap %lu, yop-cap %lu, eska+cap %lu, eska-cap %lu\n",
+           bottle_count_array[0], bottle_count_array[1], bottle_count_array[2],
+           bottle_count_array[3], bottle_count_array[4]);
+    printf("i2c: bus busy %.1f%%\n", secs > 0 ? 100.0 * mssp_bus_cycles() / sim_cycles : 0.0);
+    for(i2c_device_t *d = mssp_devices(); d; d = d->next){
+        printf("  %-10s 0x%02x: %llu transactions, %llu written, %llu read, %llu nacks\n",
+               d->name, d->addr, (unsigned long long)d->stats.transactions,
+               (unsigned long long)d->stats.writes, (unsigned long long)d->stats.reads,
+               (unsigned long long)d->stats.nacks);
+    }
+    printf("tcs34725: %llu integrations, 24lc256: %llu page writes\n",
+           (unsigned long long)board.tcs.cycles, (unsigned long long)board.ext.page_writes);
+    if(board.dual){
+        printf("tcs34725b: %llu integrations, tca9548a: %llu channel selects\n",
+               (unsigned long long)board.tcsb.cycles, (unsigned long long)board.mux.selects);
+    }
+    if(board.tcs.gaps){
+        printf("tcs34725: %llu samples, %.2f ms apart when back to back, %.2f ms of each reading it\n",
+               (unsigned long long)board.tcs.samples,
+               board.tcs.gap_sum / (double)board.tcs.gaps / SIM_US(1000),
+               board.tcs.read_sum / (double)board.tcs.samples / SIM_US(1000));
+    }
+    if(board.tcs.wakes){
+        printf("tcs34725: %llu wakes, INT to first read %.2f ms mean, %.2f ms max\n",
+               (unsigned long long)board.tcs.wakes,
+               board.tcs.wake_sum / (double)board.tcs.wakes / SIM_US(1000),
+               board.tcs.wake_max / (double)SIM_US(1000));
+    }
+    if(board.tcs.kept){
+        printf("tcs34725: INT to first kept sample %.2f ms mean, %.2f ms max\n",
+               board.tcs.kept_sum / (double)board.tcs.kept / SIM_US(1000),
+               board.tcs.kept_max / (double)SIM_US(1000));
+    }
+    printf("isr: %llu calls, %.2f%% of cycles\n", (unsigned long long)sim_stats.isr_calls,
+           sim_cycles ? 100.0 * sim_stats.isr_cycles / sim_cycles : 0.0);
+    printf("cpu: idle %.1f%% of cycles\n", sim_cycles ? 100.0 * sim_stats.sleep_cycles / sim_cycles : 0.0);
+    if(sim_stats.boot_cycles){
+        printf("watchdog: %llu resets, start up %.1f ms to the first clear, longest %.1f ms without one of %d\n",
+               (unsigned long long)sim_stats.wdt_resets, sim_stats.boot_cycles / (double)SIM_US(1000),
+               sim_stats.wdt_gap_max / (double)SIM_US(1000), WDT_PERIOD_MS);
+    }
+    if(sim_stats.spin_at) printf("spin: the firmware looped without a register access from %.3f s\n", sim_stats.spin_at / (double)SIM_FCY);
+    printf("eeprom: %llu writes, uart: %llu bytes sent, lcd: %llu writes\n",
+           (unsigned long long)sim_stats.eeprom_writes, (unsigned long long)sim_stats.uart_tx_bytes,
+           (unsigned long long)sim_lcd_updates);
+}
+
+int main(int argc, char **argv){
+    const char *tlm_path = NULL, *ee_path = NULL, *ext_path = NULL;
+    const char *why;
+    FILE *tlm = NULL;
+    int opt;
+
+    while((opt = getopt(argc, argv, "t:e:x:")) != -1){
+        switch(opt){
+            case 't': tlm_path = optarg; break;
+            case 'e': ee_path = optarg; break;
+            case 'x': ext_path = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind != argc - 1) usage(argv[0]);
+    if(scenario_load(&scenario, argv[optind])) return 1;
+
+    if(!scenario.end){
+        uint64_t last = 0;
+        for(int n = 0; n < scenario.count; n++) if(scenario.steps[n].at > last) last = scenario.steps[n].at;
+        scenario.end = last + SIM_MS(DEFAULT_TAIL_MS);
+    }
+    board_init(&board, &scenario);
+    load(ee_path, sim_eeprom, sizeof(sim_eeprom));
+    load(ext_path, board.ext.mem, sizeof(board.ext.mem));
+
+    if(tlm_path){
+        if(!(tlm = fopen(tlm_path, "wb"))){
+            perror(tlm_path);
+            return 1;
+        }
+        sim_uart_set_output(tlm);
+    }
+
+    why = board_run();
+
+    report(why);
+    save(ee_path, sim_eeprom, sizeof(sim_eeprom));
+    save(ext_path, board.ext.mem, sizeof(board.ext.mem));
+    if(tlm) fclose(tlm);
+    return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * File:   tca9548a.c
+ *
+ * TCA9548A model: every byte written is the new control register, a
+ * read returns it.
+ */
+
+#include <string.h>
+#include "tca9548a.h"
+
+static int mux_write(i2c_device_t *dev, uint8_t data){
+    tca9548a_t *m = (tca9548a_t *)dev;
+    m->reg = data;
+    m->selects++;
+    return 1;
+}
+
+static uint8_t mux_read(i2c_device_t *dev){
+    return ((tca9548a_t *)dev)->reg;
+}
+
+void tca9548a_init(tca9548a_t *m, const char *name){
+    memset(m, 0, sizeof(*m));
+    m->dev.name = name;
+    m->dev.addr = TCA9548A_ADDR;
+    m->dev.write = mux_write;
+    m->dev.read = mux_read;
+}
+
+void tca9548a_connect(tca9548a_t *m, i2c_device_t *dev, int channel){
+    dev->gate = &m->reg;
+    dev->gate_mask = (uint8_t)(1u << channel);
+}
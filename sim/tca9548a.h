@@ -0,0 +1,26 @@
+/*
+ * File:   tca9548a.h
+ *
+ * TCA9548A 8 channel I2C mux model. The one control register selects
+ * the downstream channels; devices behind it point their gate at reg
+ * (see mssp.h) with the channel bit as the mask.
+ */
+
+#ifndef TCA9548A_H
+#define TCA9548A_H
+
+#include <stdint.h>
+#include "mssp.h"
+
+#define TCA9548A_ADDR       0x70
+
+typedef struct {
+    i2c_device_t dev;
+    uint8_t reg;                //Channel enables, 0 at power up
+    uint64_t selects;           //Control register writes
+} tca9548a_t;
+
+void tca9548a_init(tca9548a_t *mux, const char *name);
+void tca9548a_connect(tca9548a_t *mux, i2c_device_t *dev, int channel);
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ * File:   tcs34725.c
+ *
+ * TCS34725 register model: command register addressing (repeated byte,
+ * auto-increment and special function), ENABLE state machine with the
+ * optional wait state, RGBC thresholds with persistence, INT output and
+ * the high byte shadow register of the data channels.
+ */
+
+#include <string.h>
+#include "pic18.h"
+#include "tcs34725.h"
+
+#define R_ENABLE    0x00
+#define R_ATIME     0x01
+#define R_WTIME     0x03
+#define R_AILTL     0x04
+#define R_PERS      0x0C
+#define R_CONFIG    0x0D
+#define R_CONTROL   0x0F
+#define R_ID        0x12
+#define R_STATUS    0x13
+#define R_CDATAL    0x14
+
+#define EN_PON      0x01
+#define EN_AEN      0x02
+#define EN_WEN      0x08
+#define EN_AIEN     0x10
+#define ST_AVALID   0x01
+#define ST_AINT     0x10
+#define CFG_WLONG   0x02
+
+#define CMD_BIT     0x80
+#define CMD_TYPE    0x60
+#define CMD_AUTOINC 0x20
+#define CMD_SPECIAL 0x60
+#define CMD_ADDR    0x1F
+#define SF_CLEARINT 0x06
+
+static void update_int(tcs34725_t *t){
+    int active = (t->reg[R_ENABLE] & EN_AIEN) && (t->reg[R_STATUS] & ST_AINT);
+    if(active && !t->int_active) t->int_at = sim_cycles;
+    t->int_active = active;
+    if(t->int_port >= 0) sim_set_pin(t->int_port, t->int_bit, !active);
+}
+
+static uint32_t pers_cycles(uint8_t apers){
+    //0 = every cycle, 1..3 = that many, then 5, 10, ... 60
+    apers &= 0x0F;
+    return apers < 4 ? apers : (apers - 3) * 5u;
+}
+
+static void schedule(tcs34725_t *t, uint64_t extra);
+
+static void integration_done(void *ctx){
+    tcs34725_t *t = ctx;
+    static const uint8_t gain[4] = {1, 4, 16, 60};
+    uint16_t in[4];
+    uint32_t steps = 256u - t->reg[R_ATIME];
+    uint32_t full = steps >= 64 ? 65535u : steps * 1024u;
+    uint16_t clear, low, high;
+
+    t->event = -1;
+    if((t->reg[R_ENABLE] & (EN_PON | EN_AEN)) != (EN_PON | EN_AEN)) return;
+
+    t->source(t->ctx, in);
+    for(int n = 0; n < 4; n++){
+        uint64_t v = (uint64_t)in[n] * gain[t->reg[R_CONTROL] & 0x03] * steps / 16;
+        if(v > full) v = full;
+        t->reg[R_CDATAL + 2*n] = (uint8_t)v;
+        t->reg[R_CDATAL + 2*n + 1] = (uint8_t)(v >> 8);
+    }
+    t->reg[R_STATUS] |= ST_AVALID;
+    t->cycles++;
+
+    clear = t->reg[R_CDATAL] | (t->reg[R_CDATAL + 1] << 8);
+    low = t->reg[R_AILTL] | (t->reg[R_AILTL + 1] << 8);
+    high = t->reg[R_AILTL + 2] | (t->reg[R_AILTL + 3] << 8);
+    if(clear < low || clear > high){
+        if(t->pers_count < 255) t->pers_count++;
+        if(t->pers_count >= pers_cycles(t->reg[R_PERS])) t->reg[R_STATUS] |= ST_AINT;
+    }
+    else t->pers_count = 0;
+    update_int(t);
+    if(t->reg[R_ENABLE] & EN_WEN){
+        uint64_t wait = (uint64_t)(256u - t->reg[R_WTIME]) * SIM_US(TCS34725_CYCLE_US);
+        if(t->reg[R_CONFIG] & CFG_WLONG) wait *= 12;
+        schedule(t, wait);
+    }
+    else schedule(t, 0);
+}
+
+static void schedule(tcs34725_t *t, uint64_t extra){
+    uint64_t len = extra + (uint64_t)(256u - t->reg[R_ATIME]) * SIM_US(TCS34725_CYCLE_US);
+    t->event = sim_schedule(sim_cycles + len, integration_done, t);
+}
+
+static void enable_written(tcs34725_t *t, uint8_t old){
+    uint8_t now = t->reg[R_ENABLE];
+    int running = (now & (EN_PON | EN_AEN)) == (EN_PON | EN_AEN);
+    int was = (old & (EN_PON | EN_AEN)) == (EN_PON | EN_AEN);
+
+    if(running && !was && t->event < 0){
+        //Oscillator warm up unless PON was already set on its own
+        schedule(t, (old & EN_PON) ? 0 : SIM_US(TCS34725_CYCLE_US));
+    }
+    else if(!running && t->event >= 0){
+        sim_cancel(t->event);
+        t->event = -1;
+    }
+    if(!(now & EN_PON)) t->reg[R_STATUS] &= ~ST_AVALID;
+    update_int(t);
+}
+
+static int tcs_start(i2c_device_t *dev, int read){
+    tcs34725_t *t = (tcs34725_t *)dev;
+    t->expect_cmd = !read;
+    t->ptr = t->cmd & CMD_ADDR;         //Reads start again at the command address
+    t->xfer_at = sim_cycles;
+    return 1;
+}
+
+static int tcs_write(i2c_device_t *dev, uint8_t data){
+    tcs34725_t *t = (tcs34725_t *)dev;
+    uint8_t old;
+
+    if(t->expect_cmd){
+        t->expect_cmd = 0;
+        if(!(data & CMD_BIT)) return 1;
+        if((data & CMD_TYPE) == CMD_SPECIAL){
+            if((data & CMD_ADDR) == SF_CLEARINT){
+                t->reg[R_STATUS] &= ~ST_AINT;
+                t->pers_count = 0;
+                update_int(t);
+            }
+            return 1;
+        }
+        t->cmd = data;
+        t->ptr = data & CMD_ADDR;
+        return 1;
+    }
+    if(t->ptr < R_ID){
+        old = t->reg[t->ptr];
+        t->reg[t->ptr] = data;
+        if(t->ptr == R_ENABLE) enable_written(t, old);
+    }
+    if(t->cmd & CMD_AUTOINC) t->ptr = (t->ptr + 1) & CMD_ADDR;
+    return 1;
+}
+
+static uint8_t tcs_read(i2c_device_t *dev){
+    tcs34725_t *t = (tcs34725_t *)dev;
+    uint8_t p = t->ptr, v;
+
+    if(p == R_CDATAL && t->kept_at){
+        //The firmware drops the first read after a wake (power.h), the
+        //sample it uses starts here
+        uint64_t d = sim_cycles - t->kept_at;
+        t->kept++;
+        t->kept_sum += d;
+        if(d > t->kept_max) t->kept_max = d;
+        t->kept_at = 0;
+    }
+    if(p == R_CDATAL && t->int_at){
+        //Wake latency, INT to the first read of the data that raised it
+        uint64_t d = sim_cycles - t->int_at;
+        t->wakes++;
+        t->wake_sum += d;
+        if(d > t->wake_max) t->wake_max = d;
+        t->kept_at = t->int_at;
+        t->int_at = 0;
+    }
+    if(p == R_CDATAL + 7){
+        t->samples++;
+        t->read_sum += sim_cycles - t->xfer_at;
+        if(t->sample_at && sim_cycles - t->sample_at < SIM_US(TCS34725_RUN_US)){
+            t->gaps++;
+            t->gap_sum += sim_cycles - t->sample_at;
+        }
+        t->sample_at = sim_cycles;
+    }
+    if(p >= R_CDATAL && p <= R_CDATAL + 7){
+        if(!((p - R_CDATAL) & 1)){
+            v = t->reg[p];
+            t->shadow = t->reg[p + 1];
+        }
+        else v = t->shadow;
+    }
+    else v = t->reg[p];
+    if(t->cmd & CMD_AUTOINC) t->ptr = (t->ptr + 1) & CMD_ADDR;
+    return v;
+}
+
+void tcs34725_init(tcs34725_t *t, const char *name, tcs34725_source_fn source, void *ctx){
+    memset(t, 0, sizeof(*t));
+    t->dev.name = name;
+    t->dev.addr = TCS34725_ADDR;
+    t->dev.start = tcs_start;
+    t->dev.write = tcs_write;
+    t->dev.read = tcs_read;
+    t->source = source;
+    t->ctx = ctx;
+    t->event = -1;
+    t->int_port = -1;
+    t->reg[R_ATIME] = 0xFF;
+    t->reg[R_WTIME] = 0xFF;
+    t->reg[R_ID] = TCS34725_ID;
+}
+
+void tcs34725_wire_int(tcs34725_t *t, int port, int bit){
+    t->int_port = port;
+    t->int_bit = bit;
+    update_int(t);
+}
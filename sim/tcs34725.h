@@ -0,0 +1,53 @@
+/*
+ * File:   tcs34725.h
+ *
+ * TCS34725 colour sensor model. The light in front of the sensor comes
+ * from a source callback in counts per 2.4ms integration cycle at 16x
+ * gain; the model scales them by the programmed gain and integration
+ * time and saturates like the real ADCs.
+ */
+
+#ifndef TCS34725_H
+#define TCS34725_H
+
+#include <stdint.h>
+#include "mssp.h"
+
+#define TCS34725_ADDR       0x29
+#define TCS34725_ID         0x44
+#define TCS34725_CYCLE_US   2400        //One integration or wait step
+#define TCS34725_RUN_US     50000       //Samples closer than this are one stretch of sampling
+
+typedef void (*tcs34725_source_fn)(void *ctx, uint16_t crgb[4]);
+
+typedef struct {
+    i2c_device_t dev;
+    uint8_t reg[0x20];
+    uint8_t shadow;             //High byte latched by the last low byte read
+    uint8_t cmd;                //Last command byte
+    uint8_t ptr;                //Register pointer within the transaction
+    int expect_cmd;             //First byte of a write transaction
+    int event;                  //Pending integration event or -1
+    uint8_t pers_count;         //Consecutive out of threshold cycles
+    int int_port, int_bit;      //Open drain INT output, int_port < 0 if unwired
+    tcs34725_source_fn source;
+    void *ctx;
+    uint64_t cycles;            //Completed integrations
+    int int_active;
+    uint64_t int_at;            //sim_cycles when INT asserted, 0 once the data has been read
+    uint64_t wakes;             //INT assertions followed by a data read
+    uint64_t wake_sum, wake_max;    //INT to the start of that read, cycles
+    uint64_t kept_at;           //int_at of the last wake until the read after it
+    uint64_t kept;              //Wakes followed by a second read
+    uint64_t kept_sum, kept_max;    //INT to the start of the second read, the first the firmware keeps
+    uint64_t xfer_at;           //sim_cycles at the last address match
+    uint64_t sample_at;         //End of the last read of all four channels
+    uint64_t samples;           //Reads through to the blue high byte
+    uint64_t read_sum;          //Address to the blue high byte, cycles
+    uint64_t gaps, gap_sum;     //Samples read within TCS34725_RUN_US of the one before
+} tcs34725_t;
+
+void tcs34725_init(tcs34725_t *tcs, const char *name, tcs34725_source_fn source, void *ctx);
+void tcs34725_wire_int(tcs34725_t *tcs, int port, int bit);
+
+#endif
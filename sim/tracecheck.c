@@ -0,0 +1,244 @@
+/*
+ * File:   tracecheck.c
+ *
+ * Replays labelled traces (scenario files with bottle lines, see
+ * scenario.h) through the simulated firmware and compares the results
+ * with the golden file next to each trace, trace.txt -> trace.golden:
+ *
+ *   count.*        bottle_count_array at the end of the trace
+ *   state          the screen the firmware ends on (enum state, main.h)
+ *   wdt.resets     watchdog resets during the trace
+ *   history.runs   committed run history records in the data EEPROM
+ *   tcs.enable     ENABLE register each TCS34725 ends with, tcsb.enable
+ *                  for the bottom one when the board has the mux
+ *   outcome.*      per bottle result against the labels (truth.h)
+ *   class<k>.*     the same split per labelled class
+ *   latency.*      trailing edge to decision, 50th/95th percentile and max
+ *
+ *   tracecheck [-r] [-c counts] [-l ms] trace.txt...
+ *
+ * -r records the golden files instead of comparing. Counts may drift by
+ * -c (default 0) and latencies by -l milliseconds (default 2) before a
+ * trace fails. Exits 1 if any trace failed.
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "board.h"
+
+#define MAX_METRICS     48
+
+//Run history layout, main.h and eeprom.h
+#define FW_HISTORYBASE      96
+#define FW_HISTORYSLOTS     6
+#define FW_HISTORYRECLEN    16
+#define FW_MARKER_VALID     0xA5
+
+extern unsigned long bottle_count_array[5];
+extern int curr_state;                  //enum state, int sized
+
+typedef struct {
+    char key[32];
+    double value;
+    int latency;                //Compared with the latency tolerance
+} metric_t;
+
+typedef struct {
+    int n;
+    metric_t m[MAX_METRICS];
+    char why[64];
+} metrics_t;
+
+static const char *const count_name[5] = {"total", "yop+cap", "yop-cap", "eska+cap", "eska-cap"};
+static const char *const outcome_name[TRUTH_OUTCOMES] = {"ok", "missed", "merged", "miscls", "missort"};
+
+static scenario_t scenario;
+static board_t board;
+
+static void put(metrics_t *ms, int latency, double value, const char *fmt, ...){
+    va_list ap;
+    metric_t *m;
+
+    if(ms->n == MAX_METRICS) return;
+    m = &ms->m[ms->n++];
+    va_start(ap, fmt);
+    vsnprintf(m->key, sizeof(m->key), fmt, ap);
+    va_end(ap);
+    m->value = value;
+    m->latency = latency;
+}
+
+static int cmp_double(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void measure(metrics_t *ms){
+    truth_t *tr = &scenario.truth;
+    double lat[TRUTH_MAX];
+    int nlat = 0, k, o, runs = 0;
+
+    truth_finish(tr);
+    for(k = 0; k < 5; k++) put(ms, 0, bottle_count_array[k], "count.%s", count_name[k]);
+    put(ms, 0, curr_state, "state");
+    put(ms, 0, sim_stats.wdt_resets, "wdt.resets");
+    for(k = 0; k < FW_HISTORYSLOTS; k++) runs += sim_eeprom[FW_HISTORYBASE + k * FW_HISTORYRECLEN] == FW_MARKER_VALID;
+    put(ms, 0, runs, "history.runs");
+    put(ms, 0, board.tcs.reg[0], "tcs.enable");
+    if(board.dual) put(ms, 0, board.tcsb.reg[0], "tcsb.enable");
+    for(o = 0; o < TRUTH_OUTCOMES; o++){
+        int c = 0;
+        for(int n = 0; n < tr->n; n++) c += tr->bottle[n].outcome == o;
+        put(ms, 0, c, "outcome.%s", outcome_name[o]);
+    }
+    put(ms, 0, tr->spurious, "outcome.spurious");
+    for(k = 1; k < 5; k++){
+        int labelled = 0, ok = 0;
+        for(int n = 0; n < tr->n; n++){
+            if(tr->bottle[n].cls != k) continue;
+            labelled++;
+            ok += tr->bottle[n].outcome == TRUTH_OK;
+        }
+        if(!labelled) continue;
+        put(ms, 0, labelled, "class%d.labelled", k);
+        put(ms, 0, ok, "class%d.ok", k);
+    }
+    for(int n = 0; n < tr->n; n++) if(tr->bottle[n].got) lat[nlat++] = tr->bottle[n].latency * 1000;
+    if(nlat){
+        qsort(lat, nlat, sizeof(double), cmp_double);
+        put(ms, 1, lat[(int)(0.50 * (nlat - 1) + 0.5)], "latency.p50_ms");
+        put(ms, 1, lat[(int)(0.95 * (nlat - 1) + 0.5)], "latency.p95_ms");
+        put(ms, 1, lat[nlat - 1], "latency.max_ms");
+    }
+}
+
+static int replay(const char *path, metrics_t *out){
+    //Fresh process per trace, the firmware keeps its state in globals
+    int fd[2], status;
+    ssize_t got = 0, r;
+    pid_t pid;
+
+    if(pipe(fd)) return -1;
+    fflush(stdout);
+    pid = fork();
+    if(pid < 0) return -1;
+    if(!pid){
+        metrics_t ms;
+        close(fd[0]);
+        memset(&ms, 0, sizeof(ms));
+        if(scenario_load(&scenario, path)) _exit(1);
+        if(!scenario.end){
+            fprintf(stderr, "%s: needs an end line\n", path);
+            _exit(1);
+        }
+        board_init(&board, &scenario);
+        truth_watch(&scenario.truth);
+        snprintf(ms.why, sizeof(ms.why), "%s", board_run());
+        measure(&ms);
+        if(write(fd[1], &ms, sizeof(ms)) != sizeof(ms)) _exit(1);
+        _exit(0);
+    }
+    close(fd[1]);
+    while(got < (ssize_t)sizeof(*out) && (r = read(fd[0], (char *)out + got, sizeof(*out) - got)) > 0) got += r;
+    close(fd[0]);
+    waitpid(pid, &status, 0);
+    return got == sizeof(*out) && WIFEXITED(status) && !WEXITSTATUS(status) ? 0 : -1;
+}
+
+static void golden_path(const char *trace, char *path, size_t len){
+    const char *dot = strrchr(trace, '.'), *slash = strrchr(trace, '/');
+    if(dot && (!slash || dot > slash)) snprintf(path, len, "%.*s.golden", (int)(dot - trace), trace);
+    else snprintf(path, len, "%s.golden", trace);
+}
+
+static int record(const char *path, const metrics_t *ms){
+    FILE *f = fopen(path, "w");
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    for(int n = 0; n < ms->n; n++){
+        if(ms->m[n].latency) fprintf(f, "%s %.1f\n", ms->m[n].key, ms->m[n].value);
+        else fprintf(f, "%s %.0f\n", ms->m[n].key, ms->m[n].value);
+    }
+    return fclose(f);
+}
+
+static int compare(const char *trace, const char *path, const metrics_t *ms, int count_tol, double lat_tol){
+    char key[64], line[128];
+    double want;
+    int fails = 0, seen[MAX_METRICS] = {0};
+    FILE *f = fopen(path, "r");
+
+    if(!f){
+        printf("FAIL %s: no golden file %s (record it with -r)\n", trace, path);
+        return 1;
+    }
+    while(fgets(line, sizeof(line), f)){
+        int n;
+        if(sscanf(line, "%63s %lf", key, &want) != 2) continue;
+        for(n = 0; n < ms->n && strcmp(ms->m[n].key, key); n++);
+        if(n == ms->n){
+            printf("FAIL %s: %s no longer measured (golden %g)\n", trace, key, want);
+            fails++;
+            continue;
+        }
+        seen[n] = 1;
+        if(fabs(ms->m[n].value - want) > (ms->m[n].latency ? lat_tol : count_tol) + 1e-9){
+            printf("FAIL %s: %s %g, golden %g\n", trace, key, ms->m[n].value, want);
+            fails++;
+        }
+    }
+    fclose(f);
+    for(int n = 0; n < ms->n; n++){
+        if(seen[n]) continue;
+        printf("FAIL %s: %s %g not in the golden file\n", trace, ms->m[n].key, ms->m[n].value);
+        fails++;
+    }
+    return fails;
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-r] [-c counts] [-l ms] trace.txt...\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    int opt, rec = 0, count_tol = 0, failed = 0;
+    double lat_tol = 2.0;
+
+    while((opt = getopt(argc, argv, "rc:l:")) != -1){
+        switch(opt){
+            case 'r': rec = 1; break;
+            case 'c': count_tol = atoi(optarg); break;
+            case 'l': lat_tol = atof(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind == argc) usage(argv[0]);
+
+    for(int a = optind; a < argc; a++){
+        metrics_t ms;
+        char path[512];
+
+        golden_path(argv[a], path, sizeof(path));
+        if(replay(argv[a], &ms)){
+            printf("FAIL %s: replay failed\n", argv[a]);
+            failed++;
+            continue;
+        }
+        if(rec){
+            if(record(path, &ms)) failed++;
+            else printf("recorded %s (%s)\n", path, ms.why);
+        }
+        else if(compare(argv[a], path, &ms, count_tol, lat_tol)) failed++;
+        else printf("ok   %s\n", argv[a]);
+    }
+    if(!rec) printf("%d of %d traces failed\n", failed, argc - optind);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * File:   truth.c
+ *
+ * Decision attribution, see truth.h. bottle_count_array is polled from a
+ * simulator event, fast enough that latencies are exact to POLL_US.
+ */
+
+#include <string.h>
+#include "pic18.h"
+#include "truth.h"
+
+#define POLL_US     500
+#define TOUCH_S     0.0005          //Gaps shorter than this are no gap
+
+#define FW_OPERATION    2               //enum state, main.h
+
+extern unsigned long bottle_count_array[5];
+extern int curr_state;                  //enum state, int sized
+
+int truth_add(truth_t *t, double in, double out, int cls){
+    truth_bottle_t *b;
+
+    if(t->n == TRUTH_MAX || cls < 1 || cls > 4 || out <= in) return -1;
+    b = &t->bottle[t->n];
+    memset(b, 0, sizeof(*b));
+    b->in = in;
+    b->out = out;
+    b->cls = cls;
+    if(t->n && in - t->bottle[t->n - 1].out < TOUCH_S) t->bottle[t->n - 1].touches_next = 1;
+    t->n++;
+    return 0;
+}
+
+static void decide(truth_t *t, int cls, double now){
+    int last = -1;
+
+    for(int n = 0; n < t->n && (t->early ? t->bottle[n].in : t->bottle[n].out) <= now; n++){
+        if(!t->bottle[n].decided) last = n;
+    }
+    if(last < 0){
+        t->spurious++;
+        return;
+    }
+    for(int n = 0; n < last; n++){
+        if(t->bottle[n].decided) continue;
+        t->bottle[n].decided = 1;
+        t->bottle[n].outcome = t->bottle[n].touches_next ? TRUTH_MERGED : TRUTH_MISSED;
+    }
+    t->bottle[last].decided = 1;
+    t->bottle[last].got = cls;
+    t->bottle[last].latency = now - t->bottle[last].out;
+    t->bottle[last].outcome = cls == t->bottle[last].cls ? TRUTH_OK : TRUTH_MISCLS;
+}
+
+static void poll(void *ctx){
+    truth_t *t = ctx;
+    for(int k = 1; k < 5; k++){
+        if(curr_state != FW_OPERATION){
+            //Decisions only come from a run, the count screens load
+            //earlier runs into the array piece by piece
+            t->seen[k] = bottle_count_array[k];
+            continue;
+        }
+        //A new run clears the counts
+        if(bottle_count_array[k] < t->seen[k]) t->seen[k] = 0;
+        while(t->seen[k] < bottle_count_array[k]){
+            t->seen[k]++;
+            decide(t, k, sim_seconds());
+        }
+    }
+    sim_schedule(sim_cycles + SIM_US(POLL_US), poll, t);
+}
+
+void truth_watch(truth_t *t){
+    memset(t->seen, 0, sizeof(t->seen));
+    t->spurious = 0;
+    sim_schedule(sim_cycles + SIM_US(POLL_US), poll, t);
+}
+
+void truth_finish(truth_t *t){
+    for(int n = 0; n < t->n; n++){
+        if(t->bottle[n].decided) continue;
+        t->bottle[n].decided = 1;
+        t->bottle[n].outcome = TRUTH_MISSED;
+    }
+}
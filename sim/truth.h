@@ -0,0 +1,40 @@
+/*
+ * File:   truth.h
+ *
+ * Ground truth for a bottle stream and the attribution of the firmware's
+ * decisions to it. A decision (an increment of bottle_count_array[1..4])
+ * belongs to the latest undecided bottle whose trailing edge has passed
+ * the sensor; undecided bottles before it were missed, or merged if no
+ * ambient gap separated them from the next bottle. With early set (two
+ * sensor boards) the firmware decides while the bottle is still in
+ * front, so its leading edge is what counts and latencies go negative.
+ */
+
+#ifndef TRUTH_H
+#define TRUTH_H
+
+#define TRUTH_MAX       256
+
+enum { TRUTH_OK, TRUTH_MISSED, TRUTH_MERGED, TRUTH_MISCLS, TRUTH_MISSORT, TRUTH_OUTCOMES };
+
+typedef struct {
+    double in, out;             //Leading and trailing edge at the sensor, s
+    int cls;                    //bottle_count_array index, 1..4
+    int touches_next;           //No ambient gap before the next bottle
+    int decided, got, outcome;
+    double latency;             //Trailing edge to decision, s, negative if decided before it
+} truth_bottle_t;
+
+typedef struct {
+    truth_bottle_t bottle[TRUTH_MAX];
+    int n;
+    int spurious;               //Decisions with no bottle past the sensor
+    int early;                  //Decisions may come before the trailing edge
+    unsigned long seen[5];      //bottle_count_array at the last poll
+} truth_t;
+
+int truth_add(truth_t *t, double in, double out, int cls);
+void truth_watch(truth_t *t);   //Start following bottle_count_array
+void truth_finish(truth_t *t);  //Bottles still undecided were missed
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * File:   telemetry.c
+ * Author: Administrator
+ *
+ * Frame encoding for the EUSART telemetry channel. Frames are queued whole
+ * or dropped, the sorting loop never waits on the line.
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include "configBits.h"
+#include "uart.h"
+#include "telemetry.h"
+#include "param.h"
+
+static uint8_t rx_frame[TLM_MAXPAYLOAD + 4];
+static uint8_t rx_fill;
+
+static void put16(uint8_t *p, uint16_t v){
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v){
+    put16(p, (uint16_t)v);
+    put16(p + 2, (uint16_t)(v >> 16));
+}
+
+void tlm_send(uint8_t type, const void *payload, uint8_t len){
+    uint8_t frame[TLM_MAXPAYLOAD + 4];
+    const uint8_t *p = (const uint8_t *)payload;
+    uint8_t n, sum;
+
+    if(len > TLM_MAXPAYLOAD) return;
+    frame[0] = TLM_SYNC;
+    frame[1] = type;
+    frame[2] = len;
+    sum = type + len;
+    for(n=0;n<len;n++){
+        frame[3+n] = p[n];
+        sum += p[n];
+    }
+    frame[3+len] = (uint8_t)(0 - sum);
+    uart_write(frame, len + 4);
+}
+
+void tlm_counts(const unsigned long *counts){
+    uint8_t payload[20];
+    uint8_t n;
+
+    for(n=0;n<5;n++) put32(payload + 4*n, (uint32_t)counts[n]);
+    tlm_send(TLM_COUNTS, payload, sizeof(payload));
+}
+
+void tlm_profile(uint32_t ticks, uint16_t logged){
+    uint8_t payload[8];
+
+    put32(payload, ticks);
+    put16(payload + 4, uart_tx_overflow);
+    put16(payload + 6, logged);
+    tlm_send(TLM_PROFILE, payload, sizeof(payload));
+}
+
+void tlm_state(uint8_t from, uint8_t to, uint32_t ticks){
+    uint8_t payload[6];
+
+    payload[0] = from;
+    payload[1] = to;
+    put32(payload + 2, ticks);
+    tlm_send(TLM_STATE, payload, sizeof(payload));
+}
+
+void tlm_rate(uint16_t bottles, uint16_t gap_min, uint16_t now, uint16_t avg){
+    uint8_t payload[8];
+
+    put16(payload, bottles);
+    put16(payload + 2, gap_min);
+    put16(payload + 4, now);
+    put16(payload + 6, avg);
+    tlm_send(TLM_RATE, payload, sizeof(payload));
+}
+
+void tlm_hist(uint8_t kind, uint16_t base, const uint16_t *counts){
+    //8 buckets, counts above 255 are sent as 255
+    uint8_t payload[11];
+    uint8_t n;
+
+    payload[0] = kind;
+    put16(payload + 1, base);
+    for(n=0;n<8;n++) payload[3+n] = counts[n] > 255 ? 255 : (uint8_t)counts[n];
+    tlm_send(TLM_HIST, payload, sizeof(payload));
+}
+
+void tlm_reset(uint8_t rcon, uint8_t resets, uint8_t state, uint32_t ticks){
+    //Once at start up, state is the one main() starts or resumes in
+    uint8_t payload[7];
+
+    payload[0] = rcon;
+    payload[1] = resets;
+    payload[2] = state;
+    put32(payload + 3, ticks);
+    tlm_send(TLM_RESET, payload, sizeof(payload));
+}
+
+void tlm_i2c(uint16_t timeouts, uint16_t nacks, uint16_t collisions, uint16_t recoveries){
+    //At the end of a run and after each bus recovery
+    uint8_t payload[8];
+
+    put16(payload, timeouts);
+    put16(payload + 2, nacks);
+    put16(payload + 4, collisions);
+    put16(payload + 6, recoveries);
+    tlm_send(TLM_I2C, payload, sizeof(payload));
+}
+
+void tlm_poll(void){
+    //Collects host command frames from the receive buffer, one byte at a
+    //time so a partial frame just waits for the next call
+    uint8_t c, n, sum;
+
+    while(uart_read(&c)){
+        if(rx_fill == 0 && c != TLM_SYNC) continue;
+        rx_frame[rx_fill++] = c;
+        if(rx_fill == 3 && rx_frame[2] > TLM_MAXPAYLOAD){
+            rx_fill = 0;
+            continue;
+        }
+        if(rx_fill < 3 || rx_fill < rx_frame[2] + 4) continue;
+
+        sum = 0;
+        for(n=1;n<rx_fill;n++) sum += rx_frame[n];
+        if(sum == 0) param_command(rx_frame[1], rx_frame + 3, rx_frame[2]);
+        rx_fill = 0;
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * File:   telemetry.h
+ * Author: Administrator
+ *
+ * Binary telemetry frames sent over the EUSART. Also included by the
+ * Linux decoder in tools/, so keep it free of PIC specific headers.
+ *
+ * Frame: [TLM_SYNC][type][len][payload 0..len-1][check]
+ * check makes the byte sum of type..check equal 0 (mod 256).
+ * Multi-byte payload fields are little endian.
+ * The host sends commands (TLM_CMD_*) back using the same framing.
+ */
+
+#ifndef TELEMETRY_H
+#define	TELEMETRY_H
+
+#include <stdint.h>
+
+#define TLM_SYNC            0xA5
+#define TLM_MAXPAYLOAD      20
+
+#define TLM_COUNTS          0x01    //5 x u32, bottle_count_array
+#define TLM_BOTTLE          0x02    //evlog_rec_t
+#define TLM_PROFILE         0x03    //u32 ticks, u16 tx overflows, u16 logged bottles
+#define TLM_STATE           0x04    //u8 from, u8 to, u32 ticks
+#define TLM_PARAM           0x05    //u8 id, u16 value, u8 status (param.h)
+#define TLM_RATE            0x06    //u16 bottles, u16 min gap ms, u16 now, u16 avg (bottles/min x10)
+#define TLM_HIST            0x07    //u8 kind, u16 first bucket ms, 8 x u8 counts (metrics.h)
+#define TLM_RESET           0x08    //u8 RCON at start up, u8 watchdog resets, u8 state, u32 ticks (watchdog.h)
+#define TLM_I2C             0x09    //u16 timeouts, u16 nacks, u16 collisions, u16 recoveries (I2C.h)
+
+#define TLM_HIST_GAP        0
+#define TLM_HIST_DWELL      1
+
+//Host to PIC
+#define TLM_CMD_GET         0x10    //u8 id
+#define TLM_CMD_SET         0x11    //u8 id, u16 value
+#define TLM_CMD_COMMIT      0x12    //Store the table in EEPROM, once no run is going
+#define TLM_CMD_DEFAULTS    0x13    //Restore defaults, not committed
+
+void tlm_send(uint8_t type, const void *payload, uint8_t len);
+void tlm_counts(const unsigned long *counts);
+void tlm_profile(uint32_t ticks, uint16_t logged);
+void tlm_state(uint8_t from, uint8_t to, uint32_t ticks);
+void tlm_rate(uint16_t bottles, uint16_t gap_min, uint16_t now, uint16_t avg);
+void tlm_hist(uint8_t kind, uint16_t base, const uint16_t *counts);
+void tlm_reset(uint8_t rcon, uint8_t resets, uint8_t state, uint32_t ticks);
+void tlm_i2c(uint16_t timeouts, uint16_t nacks, uint16_t collisions, uint16_t recoveries);
+void tlm_poll(void);
+
+#endif	/* TELEMETRY_H */
@@ -0,0 +1,55 @@
+/*
+ * File:   timers.h
+ * Author: Administrator
+ *
+ * Timer settings worked out by the preprocessor from _XTAL_FREQ and a
+ * period, so nothing is computed at run time and a new clock either
+ * gives the same periods or stops the build. Each user checks its own
+ * values with the _FITS macros in an #if next to where it loads them.
+ * Include after configBits.h.
+ *
+ * Periods are rounded to the nearest timer count; keep them within what
+ * unsigned long holds once multiplied by _XTAL_FREQ / 4000.
+ */
+
+#ifndef TIMERS_H
+#define	TIMERS_H
+
+#define TMR_CYCLES_US(us)       (((_XTAL_FREQ / 4000UL) * (us) + 500) / 1000)
+#define TMR_CYCLES_MS(ms)       ((_XTAL_FREQ / 4000UL) * (ms))
+
+//TMR1/TMR3, 16 bit, reloaded in the interrupt. Prescale 1, 2, 4 or 8
+#define TMR16_COUNTS(us, ps)    ((TMR_CYCLES_US(us) + (ps) / 2) / (ps))
+#define TMR16_FITS(us, ps)      (TMR16_COUNTS(us, ps) >= 1 && TMR16_COUNTS(us, ps) <= 65535)
+#define TMR16_RELOAD(us, ps)    ((unsigned int)(65536UL - TMR16_COUNTS(us, ps)))
+#define TMR16_PS(us)            (TMR16_FITS(us, 1) ? 1 : TMR16_FITS(us, 2) ? 2 : \
+                                 TMR16_FITS(us, 4) ? 4 : TMR16_FITS(us, 8) ? 8 : 0)
+#define TMR13_CKPS(ps)          ((ps) == 8 ? 3 : (ps) == 4 ? 2 : (ps) == 2 ? 1 : 0)
+
+//TMR2, PR2 match. Prescale 1, 4 or 16, postscale 1..16
+#define TMR2_COUNTS(us, pre, post)  ((TMR_CYCLES_US(us) + (pre) * (post) / 2) / ((pre) * (post)))
+#define TMR2_FITS(us, pre, post)    (TMR2_COUNTS(us, pre, post) >= 2 && TMR2_COUNTS(us, pre, post) <= 256)
+#define TMR2_PR2(us, pre, post)     ((unsigned char)(TMR2_COUNTS(us, pre, post) - 1))
+#define TMR2_T2CON(pre, post)       ((((post) - 1) << 3) | ((pre) == 16 ? 2 : (pre) == 4 ? 1 : 0))
+//Period PR2 actually gives, in us, and whether that is a whole number of them
+#define TMR2_PERIOD_CYCLES(us, pre, post)   (TMR2_COUNTS(us, pre, post) * (pre) * (post))
+#define TMR2_PERIOD_US(us, pre, post)       (TMR2_PERIOD_CYCLES(us, pre, post) * 1000UL / (_XTAL_FREQ / 4000UL))
+#define TMR2_PERIOD_EXACT(us, pre, post)    (TMR2_PERIOD_CYCLES(us, pre, post) * 1000UL % (_XTAL_FREQ / 4000UL) == 0)
+
+//TMR0, 16 bit and free running, cleared rather than reloaded: the
+//smallest prescaler whose overflow period is at least ms, 0 when 1:256
+//falls short. A prescale of 1 means PSA = 1
+#define TMR0_PS(ms)             (TMR_CYCLES_MS(ms) <= 0x10000UL ? 1 :     \
+                                 TMR_CYCLES_MS(ms) <= 0x20000UL ? 2 :     \
+                                 TMR_CYCLES_MS(ms) <= 0x40000UL ? 4 :     \
+                                 TMR_CYCLES_MS(ms) <= 0x80000UL ? 8 :     \
+                                 TMR_CYCLES_MS(ms) <= 0x100000UL ? 16 :   \
+                                 TMR_CYCLES_MS(ms) <= 0x200000UL ? 32 :   \
+                                 TMR_CYCLES_MS(ms) <= 0x400000UL ? 64 :   \
+                                 TMR_CYCLES_MS(ms) <= 0x800000UL ? 128 :  \
+                                 TMR_CYCLES_MS(ms) <= 0x1000000UL ? 256 : 0)
+#define TMR0_T0PS(ps)           ((ps) == 256 ? 7 : (ps) == 128 ? 6 : (ps) == 64 ? 5 : (ps) == 32 ? 4 : \
+                                 (ps) == 16 ? 3 : (ps) == 8 ? 2 : (ps) == 4 ? 1 : 0)
+#define TMR0_OVERFLOW_MS(ps)    (0x10000UL * (ps) / (_XTAL_FREQ / 4000UL))
+
+#endif	/* TIMERS_H */
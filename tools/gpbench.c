@@ -0,0 +1,363 @@
+/*
+ * File:   gpbench.c
+ *
+ * Cycle counts for the XC8 image, measured in gpsim. Function entry and
+ * return addresses come from the build's .sym and .lst files; gpsim runs
+ * the .hex with the keypad on PORTB and pull-ups on the I2C lines, stops
+ * at each of those addresses and prints its cycle counter. Nothing
+ * answers on the I2C bus, so the sensor reads all ones and operation()
+ * takes its bottle path on every sample. That path never arms the sensor
+ * INT, so isr.sensor only shows up in a log from a run with a bus model
+ * (-l); tools/wcet bounds it statically either way.
+ *
+ *   gpbench [-f fosc] [-t secs] [-m stops] [-b baseline] [-s script.stc | -l gpsim.log] image
+ *
+ * image is the path without extension, for example
+ * dist/default/production/AER201_PIC.X.production. The report on stdout
+ * has one "name.stat value" line per measurement, in instruction cycles,
+ * so two reports can be diffed or passed back in with -b to print what
+ * moved. -s only writes the gpsim script, -l parses a log saved from an
+ * earlier gpsim run instead of starting one.
+ *
+ * operation() runs for -t seconds (default 2) between KP_1 and KP_7, then
+ * KP_2 brings up the bottle count screen twice. -m caps the number of
+ * breakpoint stops in the script (default 6000). -f is the image's
+ * _XTAL_FREQ (default 10 MHz), it sets when the keys are pressed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "listing.h"
+
+#define CYCLES(s)       ((unsigned long long)((s) * fosc / 4))
+#define MAX_EXITS       32
+#define MAX_DEPTH       8
+#define MAX_KEYS        8
+#define MAX_STATS       64
+
+//Keypad codes as read from PORTB<7:4>, same as KP_ in keypad.h
+#define KEY_1           0
+#define KEY_2           1
+#define KEY_7           8
+
+typedef struct {
+    const char *name;           //Report prefix
+    const char *sym;            //Function in the symbol file
+    uint32_t entry, exits[MAX_EXITS];
+    int nexits, depth;
+    unsigned long long started[MAX_DEPTH];
+    uint8_t flags[MAX_DEPTH][6];  //Interrupt flags at entry, isr only
+} bench_t;
+
+typedef struct {
+    char key[48];
+    unsigned long long n, min, max, sum;
+} stat_t;
+
+typedef struct {
+    double at, hold;
+    int code;
+} keypress_t;
+
+//Registers dumped at every stop, the isr path is decided from these
+enum { R_INTCON, R_INTCON3, R_PIE1, R_PIR1, R_PIE2, R_PIR2, R_COUNT };
+static const struct { const char *name; unsigned addr; } regs[R_COUNT] = {
+    {"intcon", 0xFF2}, {"intcon3", 0xFF0}, {"pie1", 0xF9D}, {"pir1", 0xF9E},
+    {"pie2", 0xFA0}, {"pir2", 0xFA1},
+};
+
+static bench_t benches[] = {
+    {"operation",        "_operation"},
+    {"read_colorsensor", "_read_colorsensor"},
+    {"savedata",         "_savedata"},          //From run_stop(), KP_7 or the end of a run
+    {"lcd_screen",       "_bottle_counts"},
+    {"isr",              "_isr"},
+};
+#define NBENCH  (int)(sizeof(benches) / sizeof(benches[0]))
+
+static double fosc = 10000000.0;        //_XTAL_FREQ in configBits.h, -f
+static stat_t stats[MAX_STATS];
+static int nstats;
+static keypress_t keys[MAX_KEYS];
+static int nkeys;
+
+static void add_key(double at, int code){
+    keys[nkeys].at = at;
+    keys[nkeys].hold = 0.05;
+    keys[nkeys++].code = code;
+}
+
+static int resolve(const listing_t *l){
+    for(int b = 0; b < NBENCH; b++){
+        bench_t *bn = &benches[b];
+        const lst_func_t *f = listing_func(l, bn->sym);
+
+        if(!f){
+            fprintf(stderr, "%s not in the symbol file\n", bn->sym);
+            return -1;
+        }
+        bn->entry = f->start;
+        for(int n = 0; n < l->ninsn && bn->nexits < MAX_EXITS; n++){
+            const lst_insn_t *in = &l->insn[n];
+            if(in->addr < f->start || in->addr >= f->end) continue;
+            if(!strcmp(in->mnem, "return") || !strcmp(in->mnem, "retfie") || !strcmp(in->mnem, "retlw"))
+                bn->exits[bn->nexits++] = in->addr;
+        }
+        if(!bn->nexits){
+            fprintf(stderr, "%s: no return instruction between 0x%x and 0x%x\n", bn->sym, f->start, f->end);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void stimulus(FILE *f, const char *pin, int bit){
+    //One asynchronous stimulus per PORTB pin. Released, the data lines read
+    //0xF and DA is low, as in the simulator's keypad model
+    int idle = bit == 1 ? 0 : 1;
+
+    fprintf(f, "stimulus asynchronous_stimulus\ninitial_state %d\nstart_cycle 0\nperiod %llu\n{",
+            idle, CYCLES(keys[nkeys - 1].at + 10));
+    for(int k = 0; k < nkeys; k++){
+        unsigned long long press = CYCLES(keys[k].at), release = CYCLES(keys[k].at + keys[k].hold);
+        if(bit == 1) press += 10;       //DA rises once the data lines have settled
+        fprintf(f, "%s %llu, %d, %llu, %d", k ? "," : "", press,
+                bit == 1 ? 1 : (keys[k].code >> (bit - 4)) & 1, release, idle);
+    }
+    fprintf(f, " }\nname kp_%s\nend\nnode n_%s\nattach n_%s kp_%s %s\n", pin, pin, pin, pin, pin);
+}
+
+static int write_script(const char *path, double end, int max_stops){
+    static const char *const pins[] = {"portb1", "portb4", "portb5", "portb6", "portb7"};
+    static const int bits[] = {1, 4, 5, 6, 7};
+    FILE *f = fopen(path, "w");
+
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "# generated by gpbench\n");
+    fprintf(f, "module library libgpsim_modules\n");
+    fprintf(f, "module load pullup scl_pu\nmodule load pullup sda_pu\n");
+    fprintf(f, "node n_scl\nattach n_scl portc3 scl_pu.pin\n");
+    fprintf(f, "node n_sda\nattach n_sda portc4 sda_pu.pin\n");
+    for(int n = 0; n < 5; n++) stimulus(f, pins[n], bits[n]);
+
+    for(int b = 0; b < NBENCH; b++){
+        fprintf(f, "break e 0x%x\n", benches[b].entry);
+        for(int n = 0; n < benches[b].nexits; n++) fprintf(f, "break e 0x%x\n", benches[b].exits[n]);
+    }
+    fprintf(f, "break c %llu\n", CYCLES(end));
+
+    //Every stop prints the same block, "@<what>" then a line with "= value"
+    for(int n = 0; n < max_stops; n++){
+        fprintf(f, "run\necho @cycles\ncycles\necho @pc\npc\n");
+        for(int r = 0; r < R_COUNT; r++) fprintf(f, "echo @%s\nx 0x%X\n", regs[r].name, regs[r].addr);
+    }
+    fprintf(f, "quit\n");
+    return fclose(f);
+}
+
+static stat_t *stat(const char *key){
+    for(int n = 0; n < nstats; n++) if(!strcmp(stats[n].key, key)) return &stats[n];
+    if(nstats == MAX_STATS) return NULL;
+    snprintf(stats[nstats].key, sizeof(stats[nstats].key), "%s", key);
+    stats[nstats].min = ~0ULL;
+    return &stats[nstats++];
+}
+
+static void sample(const char *key, unsigned long long cycles){
+    stat_t *s = stat(key);
+    if(!s) return;
+    s->n++;
+    s->sum += cycles;
+    if(cycles < s->min) s->min = cycles;
+    if(cycles > s->max) s->max = cycles;
+}
+
+static const char *isr_path(const uint8_t *r){
+    //Same order as the else-if chain in isr()
+    if(r[R_INTCON3] & 0x01) return "isr.keypad";
+    if(r[R_PIR1] & 0x01) return "isr.servo0";
+    if(r[R_PIR2] & 0x02) return "isr.servo1";
+    if(r[R_PIR1] & 0x02) return "isr.keytick";
+    if((r[R_PIE2] & 0x10) && (r[R_PIR2] & 0x10)) return "isr.eeprom";
+    if((r[R_PIE1] & 0x10) && (r[R_PIR1] & 0x10)) return "isr.uart_tx";
+    if(r[R_PIR1] & 0x20) return "isr.uart_rx";
+    if((r[R_INTCON] & 0x10) && (r[R_INTCON] & 0x02)) return "isr.sensor";
+    if(r[R_INTCON] & 0x04) return "isr.tick";
+    return "isr.bad";
+}
+
+static void stop(unsigned long long cycles, uint32_t pc, const uint8_t *r){
+    for(int b = 0; b < NBENCH; b++){
+        bench_t *bn = &benches[b];
+
+        if(pc == bn->entry){
+            if(bn->depth < MAX_DEPTH){
+                bn->started[bn->depth] = cycles;
+                memcpy(bn->flags[bn->depth], r, R_COUNT);
+            }
+            bn->depth++;
+            continue;
+        }
+        for(int n = 0; n < bn->nexits; n++){
+            if(pc != bn->exits[n] || !bn->depth) continue;
+            if(--bn->depth < MAX_DEPTH){
+                //+2 for the return itself, the breakpoint stops before it
+                unsigned long long took = cycles - bn->started[bn->depth] + 2;
+                sample(bn->name, took);
+                if(!strcmp(bn->name, "isr")) sample(isr_path(bn->flags[bn->depth]), took);
+            }
+        }
+    }
+}
+
+static int parse(FILE *f){
+    //Values are read from the first "= " after each "@<what>" marker
+    char line[512], what[16] = "";
+    unsigned long long cycles = 0;
+    uint32_t pc = 0;
+    uint8_t r[R_COUNT] = {0};
+    int stops = 0, have = 0;
+
+    while(fgets(line, sizeof(line), f)){
+        char *eq;
+
+        if(line[0] == '@'){
+            sscanf(line + 1, "%15s", what);
+            continue;
+        }
+        if(!what[0] || !(eq = strstr(line, "= "))) continue;
+        unsigned long long v = strtoull(eq + 2, NULL, 0);
+        if(!strcmp(what, "cycles")){
+            if(have) stop(cycles, pc, r);
+            cycles = v;
+            have = 1;
+            stops++;
+        }
+        else if(!strcmp(what, "pc")) pc = (uint32_t)v;
+        else{
+            for(int n = 0; n < R_COUNT; n++) if(!strcmp(what, regs[n].name)) r[n] = (uint8_t)v;
+        }
+        what[0] = 0;
+    }
+    if(have) stop(cycles, pc, r);
+    return stops;
+}
+
+static void report(FILE *f, const char *image, double secs){
+    fprintf(f, "# gpbench %s, %.1f s simulated, instruction cycles at %.0f Hz\n", image, secs, fosc);
+    for(int n = 0; n < nstats; n++){
+        const stat_t *s = &stats[n];
+        fprintf(f, "%s.samples %llu\n", s->key, s->n);
+        fprintf(f, "%s.min %llu\n", s->key, s->min);
+        fprintf(f, "%s.mean %llu\n", s->key, (s->sum + s->n / 2) / s->n);
+        fprintf(f, "%s.max %llu\n", s->key, s->max);
+    }
+}
+
+static void compare(const char *path){
+    //Prints the lines that differ from an earlier report
+    char line[128], key[64];
+    unsigned long long old;
+    FILE *f = fopen(path, "r");
+
+    if(!f){
+        perror(path);
+        return;
+    }
+    printf("# changes against %s\n", path);
+    while(fgets(line, sizeof(line), f)){
+        char *dot;
+        stat_t *s = NULL;
+        unsigned long long now;
+
+        if(line[0] == '#' || sscanf(line, "%63s %llu", key, &old) != 2 || !(dot = strrchr(key, '.'))) continue;
+        *dot = 0;
+        for(int n = 0; n < nstats; n++) if(!strcmp(stats[n].key, key)) s = &stats[n];
+        if(!s){
+            printf("%s.%s %llu -> gone\n", key, dot + 1, old);
+            continue;
+        }
+        if(!strcmp(dot + 1, "samples")) now = s->n;
+        else if(!strcmp(dot + 1, "min")) now = s->min;
+        else if(!strcmp(dot + 1, "max")) now = s->max;
+        else now = (s->sum + s->n / 2) / s->n;
+        if(now != old){
+            printf("%s.%s %llu -> %llu (%+.1f%%)\n", key, dot + 1, old, now,
+                   old ? 100.0 * ((double)now - old) / old : 0.0);
+        }
+    }
+    fclose(f);
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-f fosc] [-t secs] [-m stops] [-b baseline] [-s script.stc | -l gpsim.log] image\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    const char *script = NULL, *log = NULL, *base = NULL, *image;
+    char sym[512], lst[512], tmp[] = "/tmp/gpbenchXXXXXX", cmd[1200];
+    double run = 2.0, end;
+    int opt, max_stops = 6000, stops;
+    listing_t l = {0};
+    FILE *f;
+
+    while((opt = getopt(argc, argv, "f:t:m:b:s:l:")) != -1){
+        switch(opt){
+            case 'f': fosc = atof(optarg); break;
+            case 't': run = atof(optarg); break;
+            case 'm': max_stops = atoi(optarg); break;
+            case 'b': base = optarg; break;
+            case 's': script = optarg; break;
+            case 'l': log = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind != argc - 1 || run <= 0 || fosc <= 0) usage(argv[0]);
+    image = argv[optind];
+
+    snprintf(sym, sizeof(sym), "%s.sym", image);
+    snprintf(lst, sizeof(lst), "%s.lst", image);
+    if(listing_load_sym(&l, sym) || listing_load_lst(&l, lst) || resolve(&l)) return 1;
+    listing_free(&l);
+
+    add_key(0.2, KEY_1);                //Start, operation() until KP_7
+    add_key(0.2 + run, KEY_7);          //Stop, savedata()
+    add_key(0.7 + run, KEY_2);          //Bottle count screen, refreshed every 300 ms
+    add_key(1.7 + run, KEY_2);          //Next page
+    end = 2.7 + run;
+
+    if(script) return write_script(script, end, max_stops) ? 1 : 0;
+    if(log){
+        if(!(f = fopen(log, "r"))){
+            perror(log);
+            return 1;
+        }
+        stops = parse(f);
+        fclose(f);
+    }
+    else{
+        int fd = mkstemp(tmp);
+        if(fd < 0 || close(fd) || write_script(tmp, end, max_stops)) return 1;
+        snprintf(cmd, sizeof(cmd), "gpsim -i -p p18f4620 -c %s %s.hex", tmp, image);
+        if(!(f = popen(cmd, "r"))){
+            perror("gpsim");
+            return 1;
+        }
+        stops = parse(f);
+        pclose(f);
+        unlink(tmp);
+    }
+    if(!stops){
+        fprintf(stderr, "no breakpoint stops in the gpsim output\n");
+        return 1;
+    }
+    report(stdout, image, end);
+    if(base) compare(base);
+    return 0;
+}
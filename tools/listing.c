@@ -0,0 +1,171 @@
+/*
+ * File:   listing.c
+ *
+ * See listing.h. Only the parts of the XC8 formats the tools need are
+ * understood; everything else in the files is skipped.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "listing.h"
+
+typedef struct {
+    char name[48];
+    uint32_t addr;
+} sym_t;
+
+static int by_start(const void *a, const void *b){
+    const lst_func_t *x = a, *y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+static int by_addr(const void *a, const void *b){
+    const lst_insn_t *x = a, *y = b;
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+static int grow(void **p, int n, int *cap, size_t size){
+    if(n < *cap) return 0;
+    int c = *cap ? *cap * 2 : 256;
+    void *q = realloc(*p, c * size);
+    if(!q) return -1;
+    *p = q;
+    *cap = c;
+    return 0;
+}
+
+int listing_load_sym(listing_t *l, const char *path){
+    //A function is a CODE symbol with a matching __end_of<name>
+    char line[256], name[128], cls[32];
+    unsigned long addr, dummy;
+    sym_t *code = NULL;
+    int ncode = 0, cap = 0, fcap = l->nfunc;
+    FILE *f = fopen(path, "r");
+
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f)){
+        if(sscanf(line, "%127s %lx %lx %31s", name, &addr, &dummy, cls) != 4) continue;
+        if(strcmp(cls, "CODE") || strlen(name) >= sizeof(code->name)) continue;
+        if(grow((void **)&code, ncode, &cap, sizeof(*code))) break;
+        strcpy(code[ncode].name, name);
+        code[ncode++].addr = addr;
+    }
+    fclose(f);
+
+    for(int n = 0; n < ncode; n++){
+        if(!strncmp(code[n].name, "__end_of", 8)) continue;
+        for(int k = 0; k < ncode; k++){
+            if(strncmp(code[k].name, "__end_of", 8) || strcmp(code[k].name + 8, code[n].name)) continue;
+            if(grow((void **)&l->func, l->nfunc, &fcap, sizeof(*l->func))) break;
+            strcpy(l->func[l->nfunc].name, code[n].name);
+            l->func[l->nfunc].start = code[n].addr;
+            l->func[l->nfunc++].end = code[k].addr;
+            break;
+        }
+    }
+    free(code);
+    qsort(l->func, l->nfunc, sizeof(*l->func), by_start);
+    return l->nfunc ? 0 : -1;
+}
+
+static int hexword(const char *p, int len){
+    for(int n = 0; n < len; n++) if(!isxdigit((unsigned char)p[n])) return 0;
+    return !p[len] || isspace((unsigned char)p[len]);
+}
+
+static int parse_insn(char *line, lst_insn_t *in){
+    //"  4665  003C38  EC7F  F02A    \tcall\t_I2C_Master_Start\t;wreg free"
+    char *p = line, *tab;
+
+    while(isspace((unsigned char)*p)) p++;
+    if(!isdigit((unsigned char)*p)) return 0;
+    while(isdigit((unsigned char)*p)) p++;
+    while(*p == ' ') p++;
+    if(!hexword(p, 6)) return 0;
+    in->addr = strtoul(p, NULL, 16);
+    p += 6;
+    in->words = 0;
+    while(1){
+        while(*p == ' ') p++;
+        if(in->words == 2 || !hexword(p, 4)) break;
+        in->op[in->words++] = (uint16_t)strtoul(p, NULL, 16);
+        p += 4;
+    }
+    if(!in->words || !(tab = strchr(p, '\t'))) return 0;
+    if(sscanf(tab + 1, "%7s", in->mnem) != 1) return 0;
+    p = tab + 1 + strlen(in->mnem);
+    while(*p == '\t' || *p == ' ') p++;
+    snprintf(in->args, sizeof(in->args), "%.*s", (int)strcspn(p, ";\r\n"), p);
+    for(int n = strlen(in->args) - 1; n >= 0 && isspace((unsigned char)in->args[n]); n--) in->args[n] = 0;
+    return 1;
+}
+
+int listing_load_lst(listing_t *l, const char *path){
+    char line[512], file[64];
+    const char *src = NULL;
+    int cap = l->ninsn, lineno;
+    FILE *f = fopen(path, "r");
+
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f)){
+        char *semi = strchr(line, ';');
+        lst_insn_t in;
+
+        //Each function is its own psect, library code has no source comments
+        if(strstr(line, "\tpsect\t")){
+            src = NULL;
+            continue;
+        }
+        //Source comments carry the C line, ";main.c: 725: I2C_Master_Start();"
+        if(semi && sscanf(semi, ";%63[^: ]: %d:", file, &lineno) == 2 && strstr(file, ".c")){
+            char *s = strdup(semi + 1);
+            if(s) s[strcspn(s, "\r\n")] = 0;
+            src = s;
+            continue;
+        }
+        memset(&in, 0, sizeof(in));
+        if(!parse_insn(line, &in)) continue;
+        in.src = src;
+        if(grow((void **)&l->insn, l->ninsn, &cap, sizeof(*l->insn))) break;
+        l->insn[l->ninsn++] = in;
+    }
+    fclose(f);
+    qsort(l->insn, l->ninsn, sizeof(*l->insn), by_addr);
+    return l->ninsn ? 0 : -1;
+}
+
+void listing_free(listing_t *l){
+    //Source strings are shared between instructions and left to exit()
+    free(l->insn);
+    free(l->func);
+    memset(l, 0, sizeof(*l));
+}
+
+const lst_func_t *listing_func(const listing_t *l, const char *name){
+    for(int n = 0; n < l->nfunc; n++) if(!strcmp(l->func[n].name, name)) return &l->func[n];
+    return NULL;
+}
+
+const lst_func_t *listing_func_at(const listing_t *l, uint32_t addr){
+    for(int n = 0; n < l->nfunc; n++) if(addr >= l->func[n].start && addr < l->func[n].end) return &l->func[n];
+    return NULL;
+}
+
+int listing_insn_at(const listing_t *l, uint32_t addr){
+    int lo = 0, hi = l->ninsn - 1;
+    while(lo <= hi){
+        int mid = (lo + hi) / 2;
+        if(l->insn[mid].addr == addr) return mid;
+        if(l->insn[mid].addr < addr) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -1;
+}
@@ -0,0 +1,44 @@
+/*
+ * File:   listing.h
+ *
+ * Reader for the XC8 build outputs in dist/<conf>/<image>/: the symbol
+ * file (function entry and end addresses) and the assembler listing
+ * (every instruction with its address, opcode words and the C source
+ * line it came from).
+ */
+
+#ifndef LISTING_H
+#define LISTING_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t addr;
+    uint16_t op[2];
+    uint8_t words;
+    char mnem[8];
+    char args[40];
+    const char *src;            //Last ";file.c: N: text" comment before it, or NULL
+} lst_insn_t;
+
+typedef struct {
+    char name[48];              //As in the symbol file, _main, i2_read_colorsensor...
+    uint32_t start, end;        //[start, end) in bytes
+} lst_func_t;
+
+typedef struct {
+    lst_insn_t *insn;           //Sorted by address
+    int ninsn;
+    lst_func_t *func;           //Sorted by start
+    int nfunc;
+} listing_t;
+
+int listing_load_sym(listing_t *l, const char *path);
+int listing_load_lst(listing_t *l, const char *path);
+void listing_free(listing_t *l);
+
+const lst_func_t *listing_func(const listing_t *l, const char *name);
+const lst_func_t *listing_func_at(const listing_t *l, uint32_t addr);
+int listing_insn_at(const listing_t *l, uint32_t addr);    //Index, -1 if none
+
+#endif /* LISTING_H */
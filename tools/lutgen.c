@@ -0,0 +1,219 @@
+/*
+ * File:   lutgen.c
+ *
+ * Writes lut_table.h, the grids of the table classifier (lut.h), from
+ * labelled traces.
+ *
+ *   lutgen [-k samples] [-N fraction] [-s seed] trace... > ../lut_table.h
+ *
+ * Traces are simulator scenarios with bottle lines, such as the ones
+ * sim/conveyor -w saves. In each labelled bottle the first tcs step is
+ * the cap and the body is the first tcsb step on two sensor traces, the
+ * second tcs step otherwise; the class of the bottle gives the class of
+ * both readings (YOP with cap 1, ESKA with cap 2, without a cap 0).
+ * Every reading is drawn -k times with the simulator's noise model, the
+ * trace's own noise unless -N is given, and binned with lut_quantize()
+ * from the firmware, so the cells are the ones the PIC will look up.
+ * A cell gets the class most of its samples have; empty cells and ties
+ * between YOP and ESKA are 0, which leaves the bottle to the no-cap
+ * tests in bottle_decide().
+ *
+ * How well each grid separates its training samples goes to stderr.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../lut.h"
+#include "../sim/rng.h"
+
+#define MAX_STEPS       4096
+#define MAX_BOTTLES     512
+
+typedef struct {
+    double t;
+    int bottom;                 //tcsb
+    unsigned int crgb[4];
+} step_t;
+
+typedef struct {
+    double in, out;
+    int cls;
+} bottle_t;
+
+static step_t steps[MAX_STEPS];
+static int nsteps;
+static bottle_t bottles[MAX_BOTTLES];
+static int nbottles;
+
+static unsigned long counts[2][LUT_N][LUT_N][3];
+static unsigned long nsamples[2];
+static int nused;               //Bottles with both readings
+static int samples = 64;
+static double noise = -1;
+static rng_t rng;
+
+static const int read_class[5] = {0, 1, 0, 2, 0};  //Bottle class to reading class
+
+static int load(const char *path, double *trace_noise){
+    char line[256], cmd[16];
+    FILE *f = fopen(path, "r");
+    int lineno = 0;
+
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    nsteps = 0;
+    nbottles = 0;
+    *trace_noise = 0;
+    while(fgets(line, sizeof(line), f)){
+        step_t *s = &steps[nsteps];
+        bottle_t *b = &bottles[nbottles];
+        int off;
+
+        lineno++;
+        if(sscanf(line, "%15s%n", cmd, &off) != 1 || cmd[0] == '#') continue;
+        if(!strcmp(cmd, "tcs") || !strcmp(cmd, "tcsb")){
+            if(nsteps == MAX_STEPS) goto full;
+            if(sscanf(line + off, "%lf %u %u %u %u", &s->t, &s->crgb[0], &s->crgb[1], &s->crgb[2], &s->crgb[3]) != 5) goto bad;
+            s->bottom = cmd[3] == 'b';
+            nsteps++;
+        }
+        else if(!strcmp(cmd, "bottle")){
+            if(nbottles == MAX_BOTTLES) goto full;
+            if(sscanf(line + off, "%lf %lf %d", &b->in, &b->out, &b->cls) != 3 || b->cls < 1 || b->cls > 4) goto bad;
+            nbottles++;
+        }
+        else if(!strcmp(cmd, "noise")){
+            if(sscanf(line + off, "%lf", trace_noise) != 1) goto bad;
+        }
+    }
+    fclose(f);
+    return 0;
+bad:
+    fprintf(stderr, "%s:%d: can't read %s line\n", path, lineno, cmd);
+    fclose(f);
+    return -1;
+full:
+    fprintf(stderr, "%s:%d: more than %d steps or %d bottles\n", path, lineno, MAX_STEPS, MAX_BOTTLES);
+    fclose(f);
+    return -1;
+}
+
+static const step_t *reading(const bottle_t *b, int bottom, int nth){
+    //nth tcs or tcsb step inside the bottle
+    for(int n = 0; n < nsteps; n++){
+        if(steps[n].t < b->in || steps[n].t >= b->out || steps[n].bottom != bottom) continue;
+        if(nth-- == 0) return &steps[n];
+    }
+    return NULL;
+}
+
+static void train(int grid, const step_t *s, int cls, double sd){
+    for(int k = 0; k < samples; k++){
+        unsigned int crgb[4];
+        uint8_t rq, bq;
+
+        for(int n = 0; n < 4; n++){
+            //As sim/scenario.c does it
+            double v = s->crgb[n];
+            if(sd > 0) v = v * (1 + sd * rng_gauss(&rng)) + rng_gauss(&rng);
+            crgb[n] = v < 0 ? 0 : v > 65535 ? 65535 : (unsigned int)(v + 0.5);
+        }
+        lut_quantize(crgb, &rq, &bq);
+        counts[grid][rq][bq][cls] += 1;
+        nsamples[grid] += 1;
+    }
+}
+
+static int cell(int grid, int r, int b){
+    const unsigned long *c = counts[grid][r][b];
+    if(c[1] > c[0] && c[1] > c[2]) return 1;
+    if(c[2] > c[0] && c[2] > c[1]) return 2;
+    return 0;
+}
+
+static void report(int grid, const char *name){
+    unsigned long hit = 0;
+    int used = 0;
+
+    for(int r = 0; r < LUT_N; r++){
+        for(int b = 0; b < LUT_N; b++){
+            const unsigned long *c = counts[grid][r][b];
+            if(c[0] + c[1] + c[2]) used++;
+            hit += c[cell(grid, r, b)];
+        }
+    }
+    fprintf(stderr, "%s: %lu samples in %d cells, %.2f%% in a cell of their class\n",
+            name, nsamples[grid], used, nsamples[grid] ? 100.0 * hit / nsamples[grid] : 0.0);
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-k samples] [-N fraction] [-s seed] trace...\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    static const char *grids[2] = {"LUT_TOP", "LUT_BOT"};
+    unsigned long seed = 1;
+    int opt, ntraces = 0;
+
+    while((opt = getopt(argc, argv, "k:N:s:")) != -1){
+        switch(opt){
+            case 'k': samples = atoi(optarg); break;
+            case 'N': noise = atof(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind == argc || samples < 1) usage(argv[0]);
+    rng_seed(&rng, seed);
+
+    for(int a = optind; a < argc; a++){
+        double trace_noise;
+        int dual = 0;
+
+        if(load(argv[a], &trace_noise)) return 1;
+        for(int n = 0; n < nsteps; n++) dual |= steps[n].bottom;
+        for(int n = 0; n < nbottles; n++){
+            const step_t *top = reading(&bottles[n], 0, 0);
+            const step_t *body = dual ? reading(&bottles[n], 1, 0) : reading(&bottles[n], 0, 1);
+            int cls = read_class[bottles[n].cls];
+
+            if(!top || !body) continue;
+            train(LUT_TOP, top, cls, noise >= 0 ? noise : trace_noise);
+            train(LUT_BOT, body, cls, noise >= 0 ? noise : trace_noise);
+            nused++;
+        }
+        ntraces++;
+    }
+    if(!nused){
+        fprintf(stderr, "no labelled bottles with a cap and a body reading\n");
+        return 1;
+    }
+    report(LUT_TOP, "cap");
+    report(LUT_BOT, "body");
+
+    printf("/*\n"
+           " * File:   lut_table.h\n"
+           " *\n"
+           " * Written by tools/lutgen from %d bottles in %d traces, %d samples\n"
+           " * per reading. Do not edit, run lutgen again. Rows are the red share\n"
+           " * of clear, columns the blue share, both in steps of 1/LUT_N.\n"
+           " * 0 = neither, 1 = YOP, 2 = ESKA.\n"
+           " */\n\n", nused, ntraces, samples);
+    printf("const uint8_t lut_class[2][LUT_N][LUT_N] = {\n");
+    for(int g = 0; g < 2; g++){
+        printf("    {   //%s\n", grids[g]);
+        for(int r = 0; r < LUT_N; r++){
+            printf("        {");
+            for(int b = 0; b < LUT_N; b++) printf(b ? ",%d" : "%d", cell(g, r, b));
+            printf(r < LUT_N - 1 ? "},\n" : "}\n");
+        }
+        printf(g ? "    }\n" : "    },\n");
+    }
+    printf("};\n");
+    return 0;
+}
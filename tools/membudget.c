@@ -0,0 +1,483 @@
+/*
+ * File:   membudget.c
+ *
+ * Flash and RAM budget of the XC8 image, per function, per variable and
+ * per module, from the build's .map and memoryfile.xml.
+ *
+ *   membudget [-b baseline] [-f bytes] [-r bytes] image
+ *
+ * image is the path without extension, for example
+ * dist/default/production/AER201_PIC.X.production; the .sdb next to it
+ * and memoryfile.xml from the same directory are read too. The report on stdout has one
+ * "name.what bytes" line per entry, like gpbench, so it can be kept as a
+ * baseline and passed back in with -b to print what each change bought.
+ * -f and -r fail the run when less than that much flash or RAM is free.
+ *
+ * Functions and constant tables are assigned to modules by the map's
+ * MODULE INFORMATION. XC8 lists the i2 copies it makes for the isr under
+ * "shared"; they are counted with the function they copy. The map does
+ * not say where a variable is defined, the .sdb debug symbols do: a
+ * definition in x.h counts for x.c, and one in a compiler source is
+ * "library". Everything comes from the build, so a baseline is only
+ * redone from the image it describes. XC8 leaves some variables out of
+ * the .sdb (unused ones, some constant tables); they are "unknown".
+ *
+ * func.<name>.ram is the function's frame in the compiled stack. Frames
+ * of functions that are never active together share addresses, so they
+ * are not added to module.<file>.ram, which is the module's variables.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_PSECTS      256
+#define MAX_SYMS        4096
+#define MAX_ITEMS       512
+#define MAX_MODULES     32
+#define MAX_LINES       1024
+
+typedef struct {
+    char name[32];
+    unsigned long link, len;
+    int ram;                    //Space 1
+} psect_t;
+
+typedef struct {
+    char name[48], psect[32];
+    unsigned long addr;
+} sym_t;
+
+typedef enum { IT_FUNC, IT_CONST, IT_VAR } kind_t;
+
+typedef struct {
+    char name[48], module[32];
+    kind_t kind;
+    unsigned long flash, ram;
+} item_t;
+
+typedef struct {
+    char name[32];
+    unsigned long flash, ram;
+} module_t;
+
+typedef struct {
+    char name[48], file[48];    //Symbol and the source file it is defined in, .sdb
+} def_t;
+
+typedef struct {
+    char key[96];
+    unsigned long val;
+} line_t;
+
+static psect_t psects[MAX_PSECTS];
+static int npsects;
+static sym_t syms[MAX_SYMS];
+static int nsyms;
+static item_t items[MAX_ITEMS];
+static int nitems;
+static module_t modules[MAX_MODULES];
+static int nmodules;
+static line_t lines[MAX_LINES];
+static int nlines;
+static def_t defs[MAX_SYMS];
+static int ndefs;
+
+//<editor-fold defaultstate="collapsed" desc=" MAP FILE ">
+static void copy(char *to, size_t size, const char *from){
+    size_t len = strlen(from);
+    if(len >= size) len = size - 1;
+    memcpy(to, from, len);
+    to[len] = 0;
+}
+
+static const sym_t *sym(const char *name){
+    for(int n = 0; n < nsyms; n++) if(!strcmp(syms[n].name, name)) return &syms[n];
+    return NULL;
+}
+
+static const psect_t *psect(const char *name){
+    for(int n = 0; n < npsects; n++) if(!strcmp(psects[n].name, name)) return &psects[n];
+    return NULL;
+}
+
+static item_t *item(const char *name){
+    for(int n = 0; n < nitems; n++) if(!strcmp(items[n].name, name)) return &items[n];
+    if(nitems == MAX_ITEMS) return NULL;
+    memset(&items[nitems], 0, sizeof(items[nitems]));
+    copy(items[nitems].name, sizeof(items[nitems].name), name);
+    return &items[nitems++];
+}
+
+static void module_of_path(char *out, size_t size, const char *path){
+    //Compiler sources come with their full install path
+    copy(out, size, strchr(path, '\\') || strchr(path, '/') ? "library" : path);
+}
+
+static int load_map(const char *path){
+    //Sections in file order: psects, symbol table, function information, modules
+    enum { S_HEAD, S_PSECTS, S_SYMS, S_FUNCS, S_MODULES } s = S_HEAD;
+    char line[512], a[128], b[64], c[64], module[32] = "";
+    unsigned long link, load, len, sel, space, scale, size;
+    item_t *fn = NULL;
+    FILE *f = fopen(path, "r");
+
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f)){
+        line[strcspn(line, "\r\n")] = 0;
+        if(strstr(line, "Name") && strstr(line, "Selector") && !npsects){
+            s = S_PSECTS;
+            continue;
+        }
+        if(strstr(line, "Symbol Table")){
+            s = S_SYMS;
+            continue;
+        }
+        if(!strncmp(line, "FUNCTION INFORMATION", 20)){
+            s = S_FUNCS;
+            continue;
+        }
+        if(!strncmp(line, "MODULE INFORMATION", 18)){
+            s = S_MODULES;
+            continue;
+        }
+        switch(s){
+            case S_HEAD:
+                break;
+            case S_PSECTS:
+                //"  text94   4B06   4B06   84   4   0" in the per object list, scale is optional
+                if(!strncmp(line, "TOTAL", 5)){
+                    s = S_HEAD;
+                    break;
+                }
+                if(npsects < MAX_PSECTS && sscanf(line, " %31s %lx %lx %lx %lx %lx %lx", a, &link, &load, &len, &sel, &space, &scale) >= 6){
+                    copy(psects[npsects].name, sizeof(psects[npsects].name), a);
+                    psects[npsects].link = link;
+                    psects[npsects].len = len;
+                    psects[npsects++].ram = space == 1;
+                }
+                break;
+            case S_SYMS:
+                //"_color_high   bssBANK1   000117"
+                if(nsyms < MAX_SYMS && sscanf(line, "%47s %31s %lx", a, b, &link) == 3){
+                    copy(syms[nsyms].name, sizeof(syms[nsyms].name), a);
+                    copy(syms[nsyms].psect, sizeof(syms[nsyms].psect), b);
+                    syms[nsyms++].addr = link;
+                }
+                break;
+            case S_FUNCS:
+                //" *** function _main ***" then "Total ram usage:  2 bytes"
+                if(sscanf(line, " %*[*] function %47s", a) == 1) fn = item(a);
+                else if(fn && sscanf(line, "Total ram usage: %lu", &size) == 1){
+                    fn->kind = IT_FUNC;
+                    fn->ram = size;
+                    fn = NULL;
+                }
+                break;
+            case S_MODULES:
+                //"main.c" then "\t\t_main \t\tCODE \t1A16\t0000\t713" lines
+                if(!line[0] || strstr(line, "estimated size") || !strncmp(line, "Module\t", 7)) break;
+                if(line[0] != '\t'){
+                    module_of_path(module, sizeof(module), line);
+                    break;
+                }
+                if(sscanf(line, " %127s %63s %63s %*s %lu", a, b, c, &size) == 4){
+                    item_t *it = item(a);
+                    if(!it) break;
+                    copy(it->module, sizeof(it->module), module);
+                    it->kind = strcmp(b, "CODE") ? IT_CONST : IT_FUNC;
+                    it->flash = size;           //Estimate, replaced from the symbols below
+                }
+                break;
+        }
+    }
+    fclose(f);
+    if(!nsyms || !nitems){
+        fprintf(stderr, "%s: no symbol table or module information\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void exact_sizes(void){
+    //Code and constants are [name, __end_of<name>)
+    char end[64];
+    for(int n = 0; n < nitems; n++){
+        const sym_t *s, *e;
+        if(items[n].kind == IT_VAR) continue;
+        snprintf(end, sizeof(end), "__end_of%.47s", items[n].name);
+        if((s = sym(items[n].name)) && (e = sym(end)) && e->addr > s->addr) items[n].flash = e->addr - s->addr;
+    }
+}
+
+static void variables(void){
+    //A variable runs up to the next symbol in its psect, or the psect's end
+    for(int n = 0; n < nsyms; n++){
+        const sym_t *s = &syms[n];
+        const psect_t *p = psect(s->psect);
+        unsigned long end;
+        item_t *it;
+
+        if(!p || !p->ram || !strncmp(p->name, "cstack", 6) || !strcmp(p->name, "temp")) continue;
+        if(!strncmp(s->name, "__", 2)) continue;
+        end = p->link + p->len;
+        for(int k = 0; k < nsyms; k++){
+            if(!strcmp(syms[k].psect, s->psect) && syms[k].addr > s->addr && syms[k].addr < end) end = syms[k].addr;
+        }
+        if(!(it = item(s->name))) return;
+        it->kind = IT_VAR;
+        it->ram = end - s->addr;
+    }
+}
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc=" SDB FILE ">
+static int load_sdb(const char *path){
+    //Debug symbols. A "<line> <file> record names the file the [v ...]
+    //records after it are defined in, a bare "<line> stays in that file
+    char line[512], file[48] = "", name[48];
+    FILE *f = fopen(path, "r");
+
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f)){
+        char *p, *base;
+
+        line[strcspn(line, "\r\n")] = 0;
+        if(line[0] == '"'){
+            if(!(p = strchr(line, ' '))) continue;
+            base = p + 1;
+            for(p = base; *p; p++) if(*p == '\\' || *p == '/') base = p + 1;
+            copy(file, sizeof(file), base);
+            continue;
+        }
+        if(strncmp(line, "[v ", 3) || sscanf(line + 3, "%47s", name) != 1 || ndefs == MAX_SYMS) continue;
+        copy(defs[ndefs].name, sizeof(defs[ndefs].name), name);
+        copy(defs[ndefs].file, sizeof(defs[ndefs].file), file);
+        ndefs++;
+    }
+    fclose(f);
+    return 0;
+}
+
+static int built(const char *module){
+    for(int n = 0; n < nitems; n++) if(!strcmp(items[n].module, module)) return 1;
+    return 0;
+}
+
+static void owner(item_t *it){
+    //The file the .sdb defines the variable in. x.h counts for x.c, and a
+    //file the map has no code from (compiler sources) is "library"
+    char module[48];
+    size_t len;
+
+    copy(it->module, sizeof(it->module), "unknown");
+    for(int n = 0; n < ndefs; n++){
+        if(strcmp(defs[n].name, it->name)) continue;
+        copy(module, sizeof(module), defs[n].file);
+        len = strlen(module);
+        if(len > 2 && !strcmp(module + len - 2, ".h")) module[len - 1] = 'c';
+        copy(it->module, sizeof(it->module), built(module) ? module : "library");
+        return;
+    }
+}
+//</editor-fold>
+
+static void assign(void){
+    char name[64];
+    for(int n = 0; n < nitems; n++){
+        item_t *it = &items[n];
+        const item_t *of = NULL;
+        char *at;
+
+        if(it->module[0] && strcmp(it->module, "shared")) continue;
+        //i2_read_colorsensor is a copy of _read_colorsensor, read_time@i belongs to _read_time
+        if(!strncmp(it->name, "i2", 2)){
+            copy(name, sizeof(name), it->name + 2);
+            of = item(name);
+        }
+        else if((at = strchr(it->name, '@'))){
+            snprintf(name, sizeof(name), "_%.*s", (int)(at - it->name), it->name);
+            of = item(name);
+        }
+        if(of && of->module[0] && strcmp(of->module, "shared")) copy(it->module, sizeof(it->module), of->module);
+        else owner(it);
+    }
+}
+
+static void totals(void){
+    for(int n = 0; n < nitems; n++){
+        const item_t *it = &items[n];
+        module_t *m = NULL;
+
+        for(int k = 0; k < nmodules; k++) if(!strcmp(modules[k].name, it->module)) m = &modules[k];
+        if(!m){
+            if(nmodules == MAX_MODULES) continue;
+            m = &modules[nmodules++];
+            copy(m->name, sizeof(m->name), it->module);
+        }
+        m->flash += it->flash;
+        if(it->kind == IT_VAR) m->ram += it->ram;
+    }
+}
+//</editor-fold>
+
+static int memoryfile(const char *path, const char *name, unsigned long *used, unsigned long *len){
+    //<memory name="program"> ... <length>65536</length> <used>22400</used>
+    char buf[4096], key[48];
+    size_t n;
+    const char *p, *q;
+    FILE *f = fopen(path, "r");
+
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    n = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[n] = 0;
+    fclose(f);
+    snprintf(key, sizeof(key), "<memory name=\"%s\">", name);
+    if(!(p = strstr(buf, key)) || !(q = strstr(p, "<length>")) || sscanf(q, "<length>%lu", len) != 1 ||
+       !(q = strstr(p, "<used>")) || sscanf(q, "<used>%lu", used) != 1){
+        fprintf(stderr, "%s: no %s memory\n", path, name);
+        return -1;
+    }
+    return 0;
+}
+
+static void put(const char *key, const char *what, unsigned long val){
+    if(nlines == MAX_LINES) return;
+    snprintf(lines[nlines].key, sizeof(lines[nlines].key), "%.79s.%.15s", key, what);
+    lines[nlines++].val = val;
+}
+
+static int by_flash(const void *a, const void *b){
+    const item_t *x = a, *y = b;
+    unsigned long u = x->flash + x->ram, v = y->flash + y->ram;
+    if(x->kind != y->kind) return x->kind - y->kind;
+    return (u < v) - (u > v);
+}
+
+static int module_by_flash(const void *a, const void *b){
+    const module_t *x = a, *y = b;
+    return (x->flash < y->flash) - (x->flash > y->flash);
+}
+
+static void report(unsigned long flash, unsigned long flash_len, unsigned long ram, unsigned long ram_len){
+    static const char *kinds[] = { "func", "const", "var" };
+    char key[80];
+    unsigned long copies = 0, stack = 0;
+
+    for(int n = 0; n < nitems; n++) if(!strncmp(items[n].name, "i2", 2)) copies += items[n].flash;
+    for(int n = 0; n < npsects; n++) if(!strncmp(psects[n].name, "cstack", 6)) stack += psects[n].len;
+
+    put("flash", "used", flash);
+    put("flash", "free", flash_len - flash);
+    put("flash", "isr_copies", copies);
+    put("ram", "used", ram);
+    put("ram", "free", ram_len - ram);
+    put("ram", "stack", stack);
+    qsort(modules, nmodules, sizeof(*modules), module_by_flash);
+    for(int n = 0; n < nmodules; n++){
+        snprintf(key, sizeof(key), "module.%.31s", modules[n].name);
+        put(key, "flash", modules[n].flash);
+        put(key, "ram", modules[n].ram);
+    }
+    qsort(items, nitems, sizeof(*items), by_flash);
+    for(int n = 0; n < nitems; n++){
+        const item_t *it = &items[n];
+        snprintf(key, sizeof(key), "%s.%.47s", kinds[it->kind], it->name);
+        if(it->kind != IT_VAR) put(key, "flash", it->flash);
+        if(it->kind != IT_CONST) put(key, "ram", it->ram);
+    }
+}
+
+static void compare(const char *path){
+    //Prints the lines that differ from an earlier report, then the new ones
+    char line[256], key[96];
+    unsigned long old;
+    unsigned char *seen = calloc(nlines, 1);
+    FILE *f = fopen(path, "r");
+
+    if(!f || !seen){
+        perror(path);
+        free(seen);
+        if(f) fclose(f);
+        return;
+    }
+    printf("# changes against %s\n", path);
+    while(fgets(line, sizeof(line), f)){
+        int n;
+
+        if(line[0] == '#' || sscanf(line, "%95s %lu", key, &old) != 2) continue;
+        for(n = 0; n < nlines && strcmp(lines[n].key, key); n++);
+        if(n == nlines){
+            printf("%s %lu -> gone\n", key, old);
+            continue;
+        }
+        seen[n] = 1;
+        if(lines[n].val != old) printf("%s %lu -> %lu (%+ld)\n", key, old, lines[n].val, (long)(lines[n].val - old));
+    }
+    fclose(f);
+    for(int n = 0; n < nlines; n++) if(!seen[n]) printf("%s new -> %lu\n", lines[n].key, lines[n].val);
+    free(seen);
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-b baseline] [-f bytes] [-r bytes] image\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    const char *base = NULL, *image;
+    char map[600], sdb[600], xml[600], dir[512];
+    unsigned long flash, flash_len, ram, ram_len;
+    long min_flash = 0, min_ram = 0;
+    int opt, ret = 0;
+    char *slash;
+
+    while((opt = getopt(argc, argv, "b:f:r:")) != -1){
+        switch(opt){
+            case 'b': base = optarg; break;
+            case 'f': min_flash = atol(optarg); break;
+            case 'r': min_ram = atol(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind != argc - 1) usage(argv[0]);
+    image = argv[optind];
+
+    snprintf(dir, sizeof(dir), "%s", image);
+    if((slash = strrchr(dir, '/'))) *slash = 0;
+    else snprintf(dir, sizeof(dir), ".");
+    snprintf(map, sizeof(map), "%.511s.map", image);
+    snprintf(sdb, sizeof(sdb), "%.511s.sdb", image);
+    snprintf(xml, sizeof(xml), "%.511s/memoryfile.xml", dir);
+    if(load_map(map) || load_sdb(sdb) || memoryfile(xml, "program", &flash, &flash_len) || memoryfile(xml, "data", &ram, &ram_len)) return 1;
+
+    exact_sizes();
+    variables();
+    assign();
+    totals();
+
+    printf("# membudget %s, bytes\n", image);
+    report(flash, flash_len, ram, ram_len);
+    for(int n = 0; n < nlines; n++) printf("%s %lu\n", lines[n].key, lines[n].val);
+    if(base) compare(base);
+
+    if((long)(flash_len - flash) < min_flash){
+        fprintf(stderr, "flash: %lu bytes free, %ld wanted\n", flash_len - flash, min_flash);
+        ret = 1;
+    }
+    if((long)(ram_len - ram) < min_ram){
+        fprintf(stderr, "ram: %lu bytes free, %ld wanted\n", ram_len - ram, min_ram);
+        ret = 1;
+    }
+    return ret;
+}
@@ -0,0 +1,164 @@
+/*
+ * File:   tlmctl.c
+ *
+ * Reads and writes the sorter's tunable parameters (param.h) over the
+ * telemetry link.
+ *
+ *   tlmctl [-b baud] /dev/ttyUSB0 list
+ *   tlmctl [-b baud] /dev/ttyUSB0 get <name>
+ *   tlmctl [-b baud] /dev/ttyUSB0 set <name> <value>
+ *   tlmctl [-b baud] /dev/ttyUSB0 commit | defaults
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "../telemetry.h"
+#include "../param.h"
+
+static const char *names[PARAM_COUNT] = PARAM_NAMES;
+static const char *status_names[] = {"ok", "no such parameter", "out of range",
+                                     "ambient_clear must stay below bottle_high",
+                                     "written when the run ends"};
+
+static speed_t baud_flag(long baud){
+    switch(baud){
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+    }
+    fprintf(stderr, "unsupported baud %ld\n", baud);
+    exit(2);
+}
+
+static void send_frame(int fd, uint8_t type, const uint8_t *p, uint8_t len){
+    uint8_t frame[TLM_MAXPAYLOAD + 4], sum = type + len;
+
+    frame[0] = TLM_SYNC;
+    frame[1] = type;
+    frame[2] = len;
+    for(uint8_t n = 0; n < len; n++){
+        frame[3 + n] = p[n];
+        sum += p[n];
+    }
+    frame[3 + len] = (uint8_t)(0 - sum);
+    if(write(fd, frame, len + 4u) != len + 4){
+        perror("write");
+        exit(1);
+    }
+}
+
+//Waits up to a second for the TLM_PARAM reply, skipping other telemetry
+static int wait_reply(int fd, uint8_t *id, uint16_t *value, uint8_t *status){
+    uint8_t frame[TLM_MAXPAYLOAD + 4], c;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    unsigned fill = 0;
+
+    while(poll(&pfd, 1, 1000) > 0){
+        if(read(fd, &c, 1) != 1) return 0;
+        if(fill == 0 && c != TLM_SYNC) continue;
+        frame[fill++] = c;
+        if(fill == 3 && frame[2] > TLM_MAXPAYLOAD) fill = 0;
+        if(fill < 3 || fill < frame[2] + 4u) continue;
+
+        uint8_t sum = 0;
+        for(unsigned n = 1; n < fill; n++) sum += frame[n];
+        if(sum == 0 && frame[1] == TLM_PARAM && frame[2] == 4){
+            *id = frame[3];
+            *value = (uint16_t)(frame[4] | (frame[5] << 8));
+            *status = frame[6];
+            return 1;
+        }
+        fill = 0;
+    }
+    return 0;
+}
+
+static int lookup(const char *name){
+    for(int n = 0; n < PARAM_COUNT; n++) if(strcmp(names[n], name) == 0) return n;
+    fprintf(stderr, "unknown parameter %s\n", name);
+    exit(2);
+}
+
+static int transact(int fd, uint8_t type, const uint8_t *p, uint8_t len){
+    uint8_t id, status;
+    uint16_t value;
+
+    send_frame(fd, type, p, len);
+    if(!wait_reply(fd, &id, &value, &status)){
+        fprintf(stderr, "no reply\n");
+        return 1;
+    }
+    if(id < PARAM_COUNT) printf("%-18s %u", names[id], value);
+    else printf("%s", type == TLM_CMD_COMMIT ? "committed" : "defaults restored");
+    if(status) printf("  (%s)", status <= PARAM_DEFERRED ? status_names[status] : "error");
+    printf("\n");
+    return status != 0 && status != PARAM_DEFERRED;
+}
+
+static void usage(const char *argv0){
+    fprintf(stderr, "usage: %s [-b baud] device list|get <name>|set <name> <value>|commit|defaults\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    struct termios tio;
+    long baud = 57600;
+    uint8_t p[3];
+    int opt, fd, rc = 0;
+
+    while((opt = getopt(argc, argv, "b:")) != -1){
+        if(opt == 'b') baud = strtol(optarg, NULL, 10);
+        else usage(argv[0]);
+    }
+    if(argc - optind < 2) usage(argv[0]);
+
+    fd = open(argv[optind], O_RDWR | O_NOCTTY);
+    if(fd < 0){
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+    if(isatty(fd)){
+        tcgetattr(fd, &tio);
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, baud_flag(baud));
+        cfsetospeed(&tio, baud_flag(baud));
+        tcsetattr(fd, TCSANOW, &tio);
+        tcflush(fd, TCIFLUSH);
+    }
+
+    const char *cmd = argv[optind + 1];
+    char **args = argv + optind + 2;
+    int nargs = argc - optind - 2;
+
+    if(strcmp(cmd, "list") == 0 && nargs == 0){
+        for(p[0] = 0; p[0] < PARAM_COUNT; p[0]++) rc |= transact(fd, TLM_CMD_GET, p, 1);
+    }
+    else if(strcmp(cmd, "get") == 0 && nargs == 1){
+        p[0] = (uint8_t)lookup(args[0]);
+        rc = transact(fd, TLM_CMD_GET, p, 1);
+    }
+    else if(strcmp(cmd, "set") == 0 && nargs == 2){
+        long v = strtol(args[1], NULL, 0);
+        if(v < 0 || v > 65535){
+            fprintf(stderr, "value out of range\n");
+            return 2;
+        }
+        p[0] = (uint8_t)lookup(args[0]);
+        p[1] = (uint8_t)v;
+        p[2] = (uint8_t)(v >> 8);
+        rc = transact(fd, TLM_CMD_SET, p, 3);
+    }
+    else if(strcmp(cmd, "commit") == 0 && nargs == 0) rc = transact(fd, TLM_CMD_COMMIT, NULL, 0);
+    else if(strcmp(cmd, "defaults") == 0 && nargs == 0) rc = transact(fd, TLM_CMD_DEFAULTS, NULL, 0);
+    else usage(argv[0]);
+    return rc;
+}
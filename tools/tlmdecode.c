@@ -0,0 +1,202 @@
+/*
+ * File:   tlmdecode.c
+ *
+ * Linux decoder for the EUSART telemetry frames in telemetry.h.
+ *
+ *   tlmdecode [-b baud] /dev/ttyUSB0     live, sets the port to raw 8N1
+ *   tlmdecode capture.bin                 captured byte stream
+ *   tlmdecode -                           stdin
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "../telemetry.h"
+
+static const char *state_names[] = {
+    "STANDBY", "EMERGENCYSTOP", "OPERATION", "OPERATIONEND", "DATETIME",
+    "BOTTLECOUNT", "BOTTLECOUNT1", "BOTTLECOUNT2", "BOTTLECOUNT3",
+    "BOTTLECOUNT4", "BOTTLETIME", "THROUGHPUT", "CALIBRATE"
+};
+static const char *class_names[] = {
+    "?", "YOP+CAP", "YOP-CAP", "ESKA+CAP", "ESKA-CAP"
+};
+
+static unsigned long frames, bad_checks, skipped;
+
+static uint16_t get16(const uint8_t *p){
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t *p){
+    return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static const char *state_name(uint8_t s){
+    return s < sizeof(state_names) / sizeof(state_names[0]) ? state_names[s] : "?";
+}
+
+static const char *reset_cause(uint8_t rcon){
+    //RCON bits, active low: nBOR 0, nPOR 1, nTO 3, nRI 4
+    if(!(rcon & 0x02)) return "power-on";
+    if(!(rcon & 0x01)) return "brown-out";
+    if(!(rcon & 0x08)) return "watchdog";
+    if(!(rcon & 0x10)) return "RESET";
+    return "MCLR";
+}
+
+static void print_frame(uint8_t type, const uint8_t *p, uint8_t len){
+    switch(type){
+        case TLM_COUNTS:
+            if(len != 20) break;
+            printf("counts total=%u yop+cap=%u yop-cap=%u eska+cap=%u eska-cap=%u\n",
+                   get32(p), get32(p + 4), get32(p + 8), get32(p + 12), get32(p + 16));
+            return;
+        case TLM_BOTTLE:
+            if(len != 16) break;
+            printf("bottle run=%u class=%s t=%u dwell=%u peak C=%u R=%u G=%u B=%u\n",
+                   p[0], class_names[p[1] < 5 ? p[1] : 0], get32(p + 4), get16(p + 2),
+                   get16(p + 8), get16(p + 10), get16(p + 12), get16(p + 14));
+            return;
+        case TLM_PROFILE:
+            if(len != 8) break;
+            printf("profile ticks=%u tx_overflow=%u logged=%u\n",
+                   get32(p), get16(p + 4), get16(p + 6));
+            return;
+        case TLM_STATE:
+            if(len != 6) break;
+            printf("state %s -> %s t=%u\n", state_name(p[0]), state_name(p[1]), get32(p + 2));
+            return;
+        case TLM_PARAM:
+            if(len != 4) break;
+            printf("param id=%u value=%u status=%u\n", p[0], get16(p + 1), p[3]);
+            return;
+        case TLM_RATE:
+            if(len != 8) break;
+            printf("rate bottles=%u min_gap=", get16(p));
+            if(get16(p + 2) == 0xFFFF) printf("-");
+            else printf("%u", get16(p + 2));
+            printf(" now=%u.%u/min avg=%u.%u/min\n",
+                   get16(p + 4) / 10, get16(p + 4) % 10, get16(p + 6) / 10, get16(p + 6) % 10);
+            return;
+        case TLM_HIST:
+            if(len != 11 || p[0] > TLM_HIST_DWELL) break;
+            printf("hist %s", p[0] == TLM_HIST_GAP ? "gap" : "dwell");
+            for(unsigned n = 0, lo = 0, hi = get16(p + 1); n < 8; n++, lo = hi, hi *= 2){
+                if(n < 7) printf(" %u-%u=%u", lo, hi, p[3 + n]);
+                else printf(" %u+=%u", lo, p[3 + n]);
+            }
+            printf("\n");
+            return;
+        case TLM_RESET:
+            if(len != 7) break;
+            printf("reset cause=%s watchdog_resets=%u state=%s t=%u\n",
+                   reset_cause(p[0]), p[1], state_name(p[2]), get32(p + 3));
+            return;
+        case TLM_I2C:
+            if(len != 8) break;
+            printf("i2c timeouts=%u nacks=%u collisions=%u recoveries=%u\n",
+                   get16(p), get16(p + 2), get16(p + 4), get16(p + 6));
+            return;
+    }
+    printf("frame type=0x%02x len=%u:", type, len);
+    for(uint8_t n = 0; n < len; n++) printf(" %02x", p[n]);
+    printf("\n");
+}
+
+static speed_t baud_flag(long baud){
+    switch(baud){
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+    }
+    fprintf(stderr, "unsupported baud %ld\n", baud);
+    exit(2);
+}
+
+static int open_input(const char *path, long baud){
+    struct termios tio;
+    int fd;
+
+    if(strcmp(path, "-") == 0) return STDIN_FILENO;
+    fd = open(path, O_RDONLY | O_NOCTTY);
+    if(fd < 0){
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    if(isatty(fd)){
+        tcgetattr(fd, &tio);
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, baud_flag(baud));
+        cfsetospeed(&tio, baud_flag(baud));
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+int main(int argc, char **argv){
+    uint8_t buf[256], frame[TLM_MAXPAYLOAD + 4];
+    unsigned fill = 0, need = 0;
+    long baud = 57600;
+    ssize_t got;
+    int opt, fd;
+
+    while((opt = getopt(argc, argv, "b:")) != -1){
+        if(opt == 'b') baud = strtol(optarg, NULL, 10);
+        else{
+            fprintf(stderr, "usage: %s [-b baud] device|file|-\n", argv[0]);
+            return 2;
+        }
+    }
+    if(optind != argc - 1){
+        fprintf(stderr, "usage: %s [-b baud] device|file|-\n", argv[0]);
+        return 2;
+    }
+    fd = open_input(argv[optind], baud);
+
+    //Byte at a time state machine: hunt for TLM_SYNC, then collect
+    //type + len + payload + check and verify before printing
+    while((got = read(fd, buf, sizeof(buf))) > 0){
+        for(ssize_t k = 0; k < got; k++){
+            uint8_t c = buf[k];
+            if(fill == 0){
+                if(c == TLM_SYNC) frame[fill++] = c;
+                else skipped++;
+                continue;
+            }
+            frame[fill++] = c;
+            if(fill == 3){
+                if(frame[2] > TLM_MAXPAYLOAD){
+                    skipped += fill;
+                    fill = 0;
+                    continue;
+                }
+                need = frame[2] + 4u;
+            }
+            if(fill < 3 || fill < need) continue;
+
+            uint8_t sum = 0;
+            for(unsigned n = 1; n < need; n++) sum += frame[n];
+            if(sum == 0){
+                frames++;
+                print_frame(frame[1], frame + 3, frame[2]);
+                fflush(stdout);
+            }
+            else bad_checks++;
+            fill = 0;
+        }
+    }
+    fprintf(stderr, "%lu frames, %lu bad checksums, %lu bytes skipped\n",
+            frames, bad_checks, skipped);
+    return 0;
+}
@@ -0,0 +1,826 @@
+/*
+ * File:   wcet.c
+ *
+ * Static worst-case execution time of the XC8 image, from the same build
+ * outputs as gpbench (.sym and .lst). Each function's instructions are
+ * decoded from their opcode words into a control-flow graph with PIC18
+ * cycle costs on the edges (skips and taken branches cost extra). Loops
+ * are collapsed innermost first, each one costing its bound times its
+ * longest iteration plus the longest way out, and calls add the callee's
+ * own bound. What is left is acyclic and the longest path through it is
+ * the bound.
+ *
+ *   wcet [-a annotations] [-f fosc] [-p us] [-F function]... image
+ *
+ * _delay() expansions (__delay_ms, __delay_us) are recognised from their
+ * source line, which the listing shows with the macro expanded, and cost
+ * exactly the cycles they ask for. Every other loop needs a bound from the
+ * annotation file (default wcet.ann next to this tool):
+ *
+ *   loop <n> <text>            loops whose C line contains text, spaces ignored
+ *   loop <n> @<function>       loops in function that no text matched (library
+ *                              code and lines XC8 lists without a comment)
+ *   cost <cycles> <function>   fixed cost, the function is not analysed
+ *
+ * A bound or cost written n@<f>MHz is a time, n cycles at f MHz, and is
+ * scaled to -f: hardware waits and polling loops get longer with the
+ * clock.
+ *
+ * A function annotation also covers the i2 copy XC8 makes for the isr.
+ *   path <name> <function> <text>
+ *                              longest path through the C line containing text
+ *
+ * The report gives every path and each interrupts-off section (bcf GIE to
+ * bsf GIE) outside the isr. A path named servo* is checked for latency:
+ * the longest other path plus the longest interrupts-off section plus the
+ * isr code ahead of it must stay within -p microseconds (default 100, a
+ * quarter of the 0.4 ms between the two gate positions).
+ */
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "listing.h"
+
+#define INF             (LLONG_MAX / 4)
+#define NEVER           (-1)            //Function with no path to a return
+#define MAX_ANN         256
+#define MAX_FUNCS       16
+
+typedef long long cyc_t;
+
+enum { OP_NEXT, OP_SKIP, OP_BRANCH, OP_JUMP, OP_CALL, OP_RETURN, OP_HALT, OP_COMPUTED };
+
+typedef struct {
+    int kind, cycles;
+    uint32_t target;
+} op_t;
+
+typedef struct {
+    int from, to;               //from < 0 once removed
+    cyc_t w;
+} edge_t;
+
+typedef struct {
+    int header, size;
+    char *in;                   //Membership over the function's nodes
+} loop_t;
+
+typedef struct {
+    const lst_func_t *f;
+    int base, m;                //Instructions [base, base + m), node m is the exit
+    edge_t *e;
+    int ne, cap;
+    char *alive, *collapsed;
+    int *rep;                   //Node -> header of the loop it was folded into
+    cyc_t *din, *dout;          //Longest path entry -> node and node -> exit
+    cyc_t wcet;
+    int state;                  //0 not done, 1 in progress, 2 done
+} fn_t;
+
+typedef struct {
+    char kind;                  //'l' loop by text, 'L' loop by function, 'c' cost, 'p' path
+    cyc_t n;
+    char name[32], func[48], text[128];
+    int used;
+} ann_t;
+
+static listing_t lst;
+static fn_t *fns;
+static ann_t ann[MAX_ANN];
+static int nann, unbounded;
+static double fosc = 10000000.0;
+
+static cyc_t add(cyc_t a, cyc_t b){
+    if(a >= INF || b >= INF) return INF;
+    return a + b >= INF ? INF : a + b;
+}
+
+static cyc_t mul(cyc_t n, cyc_t a){
+    if(!n || !a) return 0;
+    return a >= INF / n ? INF : n * a;
+}
+
+static double us(cyc_t c){
+    return c * 4e6 / fosc;
+}
+
+//<editor-fold defaultstate="collapsed" desc=" ANNOTATIONS AND SOURCE TEXT ">
+
+static void squeeze(char *d, const char *s, size_t len){
+    //Copies s without whitespace
+    size_t n = 0;
+    for(; *s && n + 1 < len; s++) if(!isspace((unsigned char)*s)) d[n++] = *s;
+    d[n] = 0;
+}
+
+static const char *code_of(const char *src){
+    //"main.c: 93: text" -> "text"
+    const char *p = src ? strchr(src, ':') : NULL;
+    if(p) p = strchr(p + 1, ':');
+    return p ? p + 1 : "";
+}
+
+static int src_has(const char *src, const char *text){
+    char a[256];
+    squeeze(a, code_of(src), sizeof(a));
+    return src && strstr(a, text) != NULL;
+}
+
+static int bound(const char *s, cyc_t *n){
+    //"3400" or "3400@10MHz", 0 if neither
+    char *end;
+    double mhz;
+
+    *n = strtoll(s, &end, 10);
+    if(end == s) return 0;
+    if(!*end) return 1;
+    if(*end != '@') return 0;
+    mhz = strtod(end + 1, &end);
+    if(mhz <= 0 || strcmp(end, "MHz")) return 0;
+    *n = (long long)(*n * fosc / (mhz * 1e6) + 0.999);
+    return 1;
+}
+
+static int load_ann(const char *path){
+    char line[256];
+    int lineno = 0;
+    FILE *f = fopen(path, "r");
+
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f)){
+        ann_t *a = &ann[nann];
+        char kind[8], num[24], rest[200];
+        int off;
+
+        lineno++;
+        line[strcspn(line, "#")] = 0;
+        if(sscanf(line, "%7s%n", kind, &off) != 1) continue;
+        if(nann == MAX_ANN){
+            fprintf(stderr, "%s:%d: too many annotations\n", path, lineno);
+            break;
+        }
+        memset(a, 0, sizeof(*a));
+        rest[0] = 0;
+        if(!strcmp(kind, "loop") && sscanf(line + off, "%23s %199[^\n]", num, rest) == 2 && bound(num, &a->n)){
+            if(rest[0] == '@'){
+                a->kind = 'L';
+                sscanf(rest + 1, "%47s", a->func);
+            }
+            else{
+                a->kind = 'l';
+                squeeze(a->text, rest, sizeof(a->text));
+            }
+        }
+        else if(!strcmp(kind, "cost") && sscanf(line + off, "%23s %47s", num, a->func) == 2 && bound(num, &a->n)) a->kind = 'c';
+        else if(!strcmp(kind, "path") && sscanf(line + off, "%31s %47s %199[^\n]", a->name, a->func, rest) == 3){
+            a->kind = 'p';
+            squeeze(a->text, rest, sizeof(a->text));
+        }
+        else{
+            fprintf(stderr, "%s:%d: bad annotation: %s", path, lineno, line);
+            fclose(f);
+            return -1;
+        }
+        nann++;
+    }
+    fclose(f);
+    return 0;
+}
+
+static int names(const ann_t *a, const fn_t *fn){
+    //An annotation for _foo also covers XC8's interrupt copy i2_foo
+    const char *name = fn->f->name;
+    return !strcmp(a->func, name) || (!strncmp(name, "i2", 2) && !strcmp(a->func, name + 2));
+}
+
+static const char *skip_space(const char *p){
+    while(isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+static double expr(const char **p);
+
+static double factor(const char **p){
+    double v;
+    char *end;
+
+    *p = skip_space(*p);
+    if(**p == '('){
+        const char *q = skip_space(*p + 1);
+        if(isalpha((unsigned char)*q) || *q == '_'){
+            //Cast, "(unsigned long)"
+            *p = strchr(q, ')');
+            if(!*p) return -1;
+            (*p)++;
+            return factor(p);
+        }
+        *p = q;
+        v = expr(p);
+        *p = skip_space(*p);
+        if(**p == ')') (*p)++;
+        return v;
+    }
+    v = strtod(*p, &end);
+    if(end == *p) return -1;
+    *p = end;
+    while(**p == 'L' || **p == 'l' || **p == 'U' || **p == 'u') (*p)++;
+    return v;
+}
+
+static double term(const char **p){
+    double v = factor(p);
+    while(1){
+        *p = skip_space(*p);
+        if(**p == '*'){ (*p)++; v *= factor(p); }
+        else if(**p == '/'){ (*p)++; v /= factor(p); }
+        else return v;
+    }
+}
+
+static double expr(const char **p){
+    double v = term(p);
+    while(1){
+        *p = skip_space(*p);
+        if(**p == '+'){ (*p)++; v += term(p); }
+        else if(**p == '-'){ (*p)++; v -= term(p); }
+        else return v;
+    }
+}
+
+static cyc_t delay_cycles(const char *src){
+    //"_delay((unsigned long)((500)*(10000000/4000.0)));", -1 if not a delay
+    const char *p = strstr(code_of(src), "_delay(");
+    double v;
+
+    if(!src || !p) return -1;
+    p += 6;
+    v = factor(&p);
+    return v < 0 ? -1 : (cyc_t)(v + 0.5);
+}
+
+static const char *where(const fn_t *fn, int node){
+    //Source line or address of a node, for messages
+    static char buf[2][160];
+    static int k;
+    const lst_insn_t *in = &lst.insn[fn->base + node];
+
+    k ^= 1;
+    if(in->src){
+        const char *c = code_of(in->src);
+        snprintf(buf[k], sizeof(buf[k]), "%.*s:%s", (int)(c - in->src - 1), in->src, c);
+    }
+    else snprintf(buf[k], sizeof(buf[k]), "%s+0x%x", fn->f->name, in->addr - fn->f->start);
+    return buf[k];
+}
+
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc=" DECODER ">
+
+static int32_t sext(uint32_t v, int bits){
+    return (int32_t)(v << (32 - bits)) >> (32 - bits);
+}
+
+static op_t decode(const lst_insn_t *in){
+    uint16_t w = in->op[0];
+    uint8_t hi = w >> 8;
+    op_t op = {OP_NEXT, 1, 0};
+
+    if(w == 0x0010 || w == 0x0011 || w == 0x0012 || w == 0x0013 || hi == 0x0C){
+        op.kind = OP_RETURN;            //retfie, return, retlw
+        op.cycles = 2;
+    }
+    else if(w >= 0x0008 && w <= 0x000F) op.cycles = 2;     //tblrd, tblwt
+    else if(w == 0x00FF) op.kind = OP_HALT;                 //reset
+    else if((hi >= 0x2C && hi <= 0x2F) || (hi >= 0x3C && hi <= 0x3F) || (hi >= 0x48 && hi <= 0x4F)
+            || (hi >= 0x60 && hi <= 0x67) || (hi >= 0xA0 && hi <= 0xBF)){
+        op.kind = OP_SKIP;              //decfsz, incfsz, infsnz, dcfsnz, cpfs*, tstfsz, btfss, btfsc
+    }
+    else if(hi >= 0xC0 && hi <= 0xCF) op.cycles = 2;       //movff
+    else if(hi >= 0xD0 && hi <= 0xDF){
+        op.kind = hi < 0xD8 ? OP_JUMP : OP_CALL;            //bra, rcall
+        op.cycles = 2;
+        op.target = in->addr + 2 + 2 * sext(w & 0x7FF, 11);
+    }
+    else if(hi >= 0xE0 && hi <= 0xE7){
+        op.kind = OP_BRANCH;            //bz, bnz, bc, bnc, bov, bnov, bn, bnn
+        op.target = in->addr + 2 + 2 * sext(w & 0xFF, 8);
+    }
+    else if(hi == 0xEC || hi == 0xED || hi == 0xEF){
+        op.kind = hi == 0xEF ? OP_JUMP : OP_CALL;           //call, goto
+        op.cycles = 2;
+        op.target = (((uint32_t)(in->op[1] & 0xFFF) << 8) | (w & 0xFF)) << 1;
+    }
+    else if(hi == 0xEE) op.cycles = 2;                      //lfsr
+    //movwf PCL, addwf PCL,f: a computed jump the graph can't follow
+    if((w & 0xFFFF) == 0x6EF9 || (w & 0xFFFF) == 0x26F9) op.kind = OP_COMPUTED;
+    return op;
+}
+
+//</editor-fold>
+
+//<editor-fold defaultstate="collapsed" desc=" GRAPH ">
+
+static cyc_t analyse(fn_t *fn);
+
+static fn_t *fn_at(uint32_t addr){
+    for(int n = 0; n < lst.nfunc; n++) if(lst.func[n].start == addr) return &fns[n];
+    return NULL;
+}
+
+static fn_t *fn_named(const char *name){
+    const lst_func_t *f = listing_func(&lst, name);
+    return f ? &fns[f - lst.func] : NULL;
+}
+
+static int local(const fn_t *fn, uint32_t addr){
+    int k = listing_insn_at(&lst, addr);
+    return k >= fn->base && k < fn->base + fn->m ? k - fn->base : -1;
+}
+
+static void edge(fn_t *fn, int from, int to, cyc_t w){
+    if(fn->ne == fn->cap){
+        fn->cap = fn->cap ? fn->cap * 2 : 64;
+        fn->e = realloc(fn->e, fn->cap * sizeof(*fn->e));
+        if(!fn->e){
+            perror("wcet");
+            exit(1);
+        }
+    }
+    fn->e[fn->ne].from = from;
+    fn->e[fn->ne].to = to;
+    fn->e[fn->ne++].w = w;
+}
+
+static cyc_t callee(fn_t *fn, uint32_t target, int node){
+    fn_t *c = fn_at(target);
+    if(!c){
+        fprintf(stderr, "warning: %s calls 0x%x, not a function entry\n", where(fn, node), target);
+        unbounded++;
+        return INF;
+    }
+    return analyse(c);
+}
+
+static void build(fn_t *fn){
+    for(int i = 0; i < fn->m; i++){
+        const lst_insn_t *in = &lst.insn[fn->base + i];
+        op_t op = decode(in);
+        int next = local(fn, in->addr + 2 * in->words), to;
+        cyc_t c;
+
+        if(next < 0) next = fn->m;
+        switch(op.kind){
+            case OP_NEXT:
+                edge(fn, i, next, op.cycles);
+                break;
+            case OP_SKIP:
+                edge(fn, i, next, 1);
+                if(next < fn->m){
+                    const lst_insn_t *skipped = &lst.insn[fn->base + next];
+                    to = local(fn, skipped->addr + 2 * skipped->words);
+                    edge(fn, i, to < 0 ? fn->m : to, 1 + skipped->words);
+                }
+                break;
+            case OP_BRANCH:
+                edge(fn, i, next, 1);
+                to = local(fn, op.target);
+                edge(fn, i, to < 0 ? fn->m : to, 2);
+                break;
+            case OP_JUMP:
+                if((to = local(fn, op.target)) >= 0) edge(fn, i, to, op.cycles);
+                else if((c = callee(fn, op.target, i)) != NEVER) edge(fn, i, fn->m, add(op.cycles, c));
+                break;
+            case OP_CALL:
+                //call int_func,f in the isr prologue is a jump that pops its own return
+                if((to = local(fn, op.target)) >= 0) edge(fn, i, to, op.cycles);
+                else if((c = callee(fn, op.target, i)) != NEVER) edge(fn, i, next, add(op.cycles, c));
+                break;
+            case OP_RETURN:
+                edge(fn, i, fn->m, op.cycles);
+                break;
+            case OP_HALT:
+                break;
+            case OP_COMPUTED:
+                fprintf(stderr, "warning: %s: computed jump, not followed\n", where(fn, i));
+                unbounded++;
+                edge(fn, i, fn->m, INF);
+                break;
+        }
+    }
+}
+
+static int longest(fn_t *fn, const char *in, int src, int skip_into, int reverse, cyc_t *dist){
+    //Longest distances from src over edges between nodes in `in` (all alive
+    //nodes if NULL), edges into skip_into ignored. -1 if a cycle is left
+    int n = fn->m + 1, *deg = calloc(n, sizeof(int)), *queue = malloc(n * sizeof(int));
+    char *seen = calloc(n, 1);
+    int head = 0, tail = 0, reached = 0, done = 0, changed = 1;
+
+    for(int v = 0; v < n; v++) dist[v] = -1;
+    //Reachable set first, then Kahn over it
+    seen[src] = 1;
+    while(changed){
+        changed = 0;
+        for(int k = 0; k < fn->ne; k++){
+            const edge_t *e = &fn->e[k];
+            int a = reverse ? e->to : e->from, b = reverse ? e->from : e->to;
+            if(e->from < 0 || e->to == skip_into || !seen[a] || seen[b]) continue;
+            if(in ? !in[b] : (b < fn->m && !fn->alive[b])) continue;
+            seen[b] = 1;
+            changed = 1;
+        }
+    }
+    for(int k = 0; k < fn->ne; k++){
+        const edge_t *e = &fn->e[k];
+        int a = reverse ? e->to : e->from, b = reverse ? e->from : e->to;
+        if(e->from >= 0 && e->to != skip_into && seen[a] && seen[b]) deg[b]++;
+    }
+    for(int v = 0; v < n; v++) reached += seen[v];
+    dist[src] = 0;
+    queue[tail++] = src;
+    while(head < tail){
+        int u = queue[head++];
+        done++;
+        for(int k = 0; k < fn->ne; k++){
+            const edge_t *e = &fn->e[k];
+            int a = reverse ? e->to : e->from, b = reverse ? e->from : e->to;
+            if(e->from < 0 || a != u || e->to == skip_into || !seen[b]) continue;
+            cyc_t d = add(dist[u], e->w);
+            if(d > dist[b]) dist[b] = d;
+            if(--deg[b] == 0) queue[tail++] = b;
+        }
+    }
+    free(deg);
+    free(queue);
+    free(seen);
+    return done == reached ? 0 : -1;
+}
+
+static cyc_t loop_bound(fn_t *fn, const char *in, int *is_delay){
+    //Delay expansions first: one C line, no loop folded inside
+    const char *src = NULL;
+    int same = 1;
+    cyc_t bound = -1;
+
+    *is_delay = 0;
+    for(int v = 0; v < fn->m; v++){
+        if(!in[v]) continue;
+        const char *s = lst.insn[fn->base + v].src;
+        if(fn->collapsed[v] || !s || (src && s != src)) same = 0;
+        if(!src) src = s;
+    }
+    if(same && src && delay_cycles(src) >= 0){
+        *is_delay = 1;
+        return delay_cycles(src);
+    }
+    for(int v = 0; v < fn->m; v++){
+        const char *s = lst.insn[fn->base + v].src;
+        if(!in[v] || fn->collapsed[v] || !s) continue;
+        for(int a = 0; a < nann; a++){
+            if(ann[a].kind != 'l' || !src_has(s, ann[a].text)) continue;
+            ann[a].used = 1;
+            if(ann[a].n > bound) bound = ann[a].n;
+        }
+    }
+    if(bound < 0){
+        for(int a = 0; a < nann; a++){
+            if(ann[a].kind != 'L' || !names(&ann[a], fn)) continue;
+            ann[a].used = 1;
+            if(ann[a].n > bound) bound = ann[a].n;
+        }
+    }
+    return bound;
+}
+
+static void collapse(fn_t *fn, loop_t *lp){
+    //Folds the loop into its header: header -> each exit target costs
+    //bound x longest iteration + longest way from the header to that exit
+    int n = fn->m + 1, h = lp->header, exits = 0, is_delay;
+    char *in = calloc(n, 1);
+    cyc_t *dist = malloc(n * sizeof(cyc_t)), iter = 0, *out = malloc(n * sizeof(cyc_t)), bound;
+
+    for(int v = 0; v < fn->m; v++) in[v] = lp->in[v] && fn->alive[v];
+    if(longest(fn, in, h, h, 0, dist)){
+        fprintf(stderr, "warning: %s: loop with more than one entry, not bounded\n", where(fn, h));
+        unbounded++;
+        for(int v = 0; v < fn->m; v++) if(in[v]) dist[v] = 0;
+        iter = INF;
+    }
+    for(int v = 0; v < n; v++) out[v] = -1;
+    for(int k = 0; k < fn->ne; k++){
+        const edge_t *e = &fn->e[k];
+        if(e->from < 0 || !in[e->from] || dist[e->from] < 0) continue;
+        cyc_t d = add(dist[e->from], e->w);
+        if(e->to == h){
+            if(d > iter) iter = d;
+        }
+        else if(!in[e->to] && d > out[e->to]) out[e->to] = d;
+    }
+
+    bound = loop_bound(fn, in, &is_delay);
+    for(int v = 0; v < n; v++) exits += out[v] >= 0;
+    if(bound < 0 && exits){
+        fprintf(stderr, "warning: %s: loop without a bound in the annotations\n", where(fn, h));
+        unbounded++;
+        bound = INF;
+    }
+
+    for(int k = 0; k < fn->ne; k++){
+        edge_t *e = &fn->e[k];
+        if(e->from < 0) continue;
+        if(in[e->from]) e->from = -1;               //Replaced by the header's exits below
+        else if(e->to < fn->m && in[e->to]) e->to = h;  //Side entry, only in irreducible code
+    }
+    for(int v = 0; v < n; v++){
+        if(out[v] < 0) continue;
+        if(is_delay) edge(fn, h, v, bound);
+        else edge(fn, h, v, add(bound >= INF ? INF : mul(bound, iter), out[v]));
+    }
+    for(int v = 0; v < fn->m; v++){
+        if(!in[v]) continue;
+        fn->rep[v] = h;
+        if(v != h) fn->alive[v] = 0;
+    }
+    fn->collapsed[h] = 1;
+    free(in);
+    free(dist);
+    free(out);
+}
+
+static int by_size(const void *a, const void *b){
+    return ((const loop_t *)a)->size - ((const loop_t *)b)->size;
+}
+
+static void fold_loops(fn_t *fn){
+    int n = fn->m + 1, *stack = malloc(n * sizeof(int)), *next = calloc(n, sizeof(int)), sp = 0, nloops = 0;
+    char *state = calloc(n, 1);         //0 new, 1 on the stack, 2 finished
+    loop_t *loops = NULL;
+
+    //Depth first from the entry, an edge to a node on the stack closes a loop
+    stack[sp++] = 0;
+    state[0] = 1;
+    while(sp){
+        int u = stack[sp - 1], k = next[u]++;
+        if(k >= fn->ne){
+            state[u] = 2;
+            sp--;
+            continue;
+        }
+        const edge_t *e = &fn->e[k];
+        if(e->from != u) continue;
+        if(state[e->to] == 0){
+            state[e->to] = 1;
+            stack[sp++] = e->to;
+        }
+        else if(state[e->to] == 1){
+            int h = e->to, l;
+            for(l = 0; l < nloops && loops[l].header != h; l++);
+            if(l == nloops){
+                loops = realloc(loops, (nloops + 1) * sizeof(*loops));
+                loops[l].header = h;
+                loops[l].in = calloc(n, 1);
+                loops[l].in[h] = 1;
+                nloops++;
+            }
+            //Natural loop: everything that reaches u without passing the header
+            int *work = malloc(n * sizeof(int)), wn = 0;
+            if(!loops[l].in[u]){
+                loops[l].in[u] = 1;
+                work[wn++] = u;
+            }
+            while(wn){
+                int v = work[--wn];
+                for(int j = 0; j < fn->ne; j++){
+                    if(fn->e[j].to != v || fn->e[j].from < 0 || loops[l].in[fn->e[j].from]) continue;
+                    loops[l].in[fn->e[j].from] = 1;
+                    work[wn++] = fn->e[j].from;
+                }
+            }
+            free(work);
+        }
+    }
+    for(int l = 0; l < nloops; l++){
+        loops[l].size = 0;
+        for(int v = 0; v < n; v++) loops[l].size += loops[l].in[v];
+    }
+    qsort(loops, nloops, sizeof(*loops), by_size);
+    for(int l = 0; l < nloops; l++){
+        collapse(fn, &loops[l]);
+        free(loops[l].in);
+    }
+    free(loops);
+    free(stack);
+    free(next);
+    free(state);
+}
+
+static cyc_t analyse(fn_t *fn){
+    if(fn->state == 2) return fn->wcet;
+    if(fn->state == 1){
+        fprintf(stderr, "warning: %s is recursive\n", fn->f->name);
+        unbounded++;
+        return INF;
+    }
+    fn->state = 1;
+    for(int a = 0; a < nann; a++){
+        if(ann[a].kind != 'c' || !names(&ann[a], fn)) continue;
+        ann[a].used = 1;
+        fn->wcet = ann[a].n;
+        fn->state = 2;
+        return fn->wcet;
+    }
+
+    fn->base = listing_insn_at(&lst, fn->f->start);
+    for(fn->m = 0; fn->base >= 0 && fn->base + fn->m < lst.ninsn && lst.insn[fn->base + fn->m].addr < fn->f->end; fn->m++);
+    if(fn->base < 0 || !fn->m){
+        fprintf(stderr, "warning: %s has no instructions in the listing\n", fn->f->name);
+        unbounded++;
+        fn->wcet = INF;
+        fn->state = 2;
+        return fn->wcet;
+    }
+    fn->alive = malloc(fn->m + 1);
+    fn->collapsed = calloc(fn->m + 1, 1);
+    fn->rep = malloc((fn->m + 1) * sizeof(int));
+    fn->din = malloc((fn->m + 1) * sizeof(cyc_t));
+    fn->dout = malloc((fn->m + 1) * sizeof(cyc_t));
+    memset(fn->alive, 1, fn->m + 1);
+    for(int v = 0; v <= fn->m; v++) fn->rep[v] = v;
+
+    build(fn);
+    fold_loops(fn);
+    if(longest(fn, NULL, 0, -1, 0, fn->din) || longest(fn, NULL, fn->m, -1, 1, fn->dout)){
+        fprintf(stderr, "warning: %s: cycle left after folding loops\n", fn->f->name);
+        unbounded++;
+        fn->wcet = INF;
+    }
+    else fn->wcet = fn->din[fn->m] < 0 ? NEVER : fn->din[fn->m];
+    fn->state = 2;
+    return fn->wcet;
+}
+
+static int rep(const fn_t *fn, int v){
+    while(fn->rep[v] != v) v = fn->rep[v];
+    return v;
+}
+
+//</editor-fold>
+
+static void print(const char *key, cyc_t c){
+    if(c == NEVER) printf("%-32s never returns\n", key);
+    else if(c >= INF) printf("%-32s unbounded\n", key);
+    else printf("%-32s %10lld cycles %12.1f us\n", key, c, us(c));
+}
+
+static void paths(cyc_t *worst, cyc_t *ahead){
+    //Path annotations: longest way through any instruction of the C line
+    for(int a = 0; a < nann; a++){
+        fn_t *fn;
+        cyc_t best = -1, first = -1;
+        char key[64];
+
+        if(ann[a].kind != 'p') continue;
+        if(!(fn = fn_named(ann[a].func))){
+            fprintf(stderr, "warning: path %s: no function %s\n", ann[a].name, ann[a].func);
+            continue;
+        }
+        analyse(fn);
+        if(!fn->din) continue;
+        for(int v = 0; v < fn->m; v++){
+            if(!src_has(lst.insn[fn->base + v].src, ann[a].text)) continue;
+            int r = rep(fn, v);
+            if(fn->din[r] < 0 || fn->dout[r] < 0) continue;
+            ann[a].used = 1;
+            if(add(fn->din[r], fn->dout[r]) > best) best = add(fn->din[r], fn->dout[r]);
+            if(first < 0 || fn->din[r] < first) first = fn->din[r];
+        }
+        snprintf(key, sizeof(key), "path %s", ann[a].name);
+        if(best < 0){
+            printf("%-32s not found or never returns\n", key);
+            continue;
+        }
+        print(key, best);
+        worst[a] = best;
+        ahead[a] = first;
+    }
+}
+
+static cyc_t critical(void){
+    //bcf INTCON,GIE ... bsf INTCON,GIE outside the isr
+    cyc_t most = 0;
+
+    for(int n = 0; n < lst.nfunc; n++){
+        fn_t *fn = &fns[n];
+        const lst_func_t *f = &lst.func[n];
+        int has = 0;
+
+        if(!strncmp(f->name, "i2", 2) || !strcmp(f->name, "_isr")) continue;
+        for(int k = listing_insn_at(&lst, f->start); k >= 0 && k < lst.ninsn && lst.insn[k].addr < f->end; k++)
+            has |= lst.insn[k].op[0] == 0x9EF2;
+        if(!has) continue;
+        analyse(fn);
+        if(!fn->din) continue;
+
+        cyc_t *dist = malloc((fn->m + 1) * sizeof(cyc_t));
+        for(int v = 0; v < fn->m; v++){
+            if(lst.insn[fn->base + v].op[0] != 0x9EF2) continue;
+            cyc_t longest_on = -1;
+            char key[96];
+            int a = rep(fn, v);
+            if(fn->din[a] < 0) continue;        //Unreachable
+            longest(fn, NULL, a, -1, 0, dist);
+            for(int b = 0; b < fn->m; b++){
+                if(lst.insn[fn->base + b].op[0] != 0x8EF2) continue;
+                int r = rep(fn, b);
+                if(r != a && dist[r] > longest_on) longest_on = dist[r];
+            }
+            snprintf(key, sizeof(key), "interrupts off %s", where(fn, v));
+            if(longest_on < 0){
+                printf("%-32s not enabled again before return\n", key);
+                continue;
+            }
+            print(key, longest_on);
+            if(longest_on > most) most = longest_on;
+        }
+        free(dist);
+    }
+    return most;
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-a annotations] [-f fosc] [-p us] [-F function]... image\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    const char *ann_path = NULL, *extra[MAX_FUNCS];
+    char sym[512], lstp[512], def[512];
+    double tol = 100;
+    int opt, nextra = 0;
+    cyc_t worst[MAX_ANN], ahead[MAX_ANN], crit;
+    fn_t *isr;
+
+    while((opt = getopt(argc, argv, "a:f:p:F:")) != -1){
+        switch(opt){
+            case 'a': ann_path = optarg; break;
+            case 'f': fosc = atof(optarg); break;
+            case 'p': tol = atof(optarg); break;
+            case 'F': if(nextra < MAX_FUNCS) extra[nextra++] = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind != argc - 1 || fosc <= 0) usage(argv[0]);
+    if(!ann_path){
+        //Next to the binary
+        const char *slash = strrchr(argv[0], '/');
+        snprintf(def, sizeof(def), "%.*swcet.ann", slash ? (int)(slash - argv[0] + 1) : 0, argv[0]);
+        ann_path = def;
+    }
+    snprintf(sym, sizeof(sym), "%s.sym", argv[optind]);
+    snprintf(lstp, sizeof(lstp), "%s.lst", argv[optind]);
+    if(load_ann(ann_path) || listing_load_sym(&lst, sym) || listing_load_lst(&lst, lstp)) return 1;
+    fns = calloc(lst.nfunc, sizeof(*fns));
+    for(int n = 0; n < lst.nfunc; n++) fns[n].f = &lst.func[n];
+
+    printf("# wcet %s, instruction cycles at %.0f Hz\n", argv[optind], fosc);
+    if((isr = fn_named("_isr"))) print("function _isr", analyse(isr));
+    for(int n = 0; n < nextra; n++){
+        fn_t *fn = fn_named(extra[n]);
+        char key[64];
+        snprintf(key, sizeof(key), "function %s", extra[n]);
+        if(fn) print(key, analyse(fn));
+        else printf("%-32s not in the symbol file\n", key);
+    }
+    for(int a = 0; a < nann; a++) worst[a] = ahead[a] = -1;
+    paths(worst, ahead);
+    crit = critical();
+
+    //Servo pulse latency: everything that can run before its branch starts
+    for(int a = 0; a < nann; a++){
+        cyc_t other = 0, lat;
+        char key[64];
+        if(ann[a].kind != 'p' || strncmp(ann[a].name, "servo", 5) || worst[a] < 0) continue;
+        for(int b = 0; b < nann; b++) if(b != a && worst[b] > other) other = worst[b];
+        lat = add(add(other, crit), ahead[a]);
+        snprintf(key, sizeof(key), "latency %s", ann[a].name);
+        print(key, lat);
+        if(lat >= INF || us(lat) > tol){
+            printf("warning: %s pulse can be late by more than %.0f us\n", ann[a].name, tol);
+        }
+    }
+    for(int a = 0; a < nann; a++){
+        if(!ann[a].used) fprintf(stderr, "note: annotation %d (%s %s%s) matched nothing\n", a + 1,
+                                 ann[a].kind == 'c' ? "cost" : ann[a].kind == 'p' ? "path" : "loop",
+                                 ann[a].func, ann[a].text);
+    }
+    if(unbounded) fprintf(stderr, "%d places could not be bounded, see the warnings above\n", unbounded);
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * File:   uart.c
+ * Author: Administrator
+ *
+ * Interrupt driven EUSART transmit and receive.
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include "configBits.h"
+#include "uart.h"
+
+#if UART_SPBRG < 0 || UART_SPBRG > 65535
+#error "UART_BAUD can't be generated from _XTAL_FREQ"
+#endif
+//Reject more than 2% baud error, receivers start failing around 3%
+#if ((_XTAL_FREQ / (4 * (UART_SPBRG + 1)) - UART_BAUD) * 50 > UART_BAUD) || \
+    ((UART_BAUD - _XTAL_FREQ / (4 * (UART_SPBRG + 1))) * 50 > UART_BAUD)
+#error "UART_BAUD error exceeds 2% at this _XTAL_FREQ"
+#endif
+
+#define UART_TXMASK     (UART_TXSIZE - 1)
+#define UART_RXMASK     (UART_RXSIZE - 1)
+
+static uint8_t tx_buf[UART_TXSIZE];
+static volatile uint8_t tx_head;        //Next free slot, written by the main loop
+static volatile uint8_t tx_tail;        //Next byte to send, written by the ISR
+static uint8_t rx_buf[UART_RXSIZE];
+static volatile uint8_t rx_head;        //Written by the ISR
+static volatile uint8_t rx_tail;        //Written by the main loop
+uint16_t uart_tx_overflow;
+uint16_t uart_rx_errors;
+
+void uart_init(void){
+    tx_head = 0;
+    tx_tail = 0;
+    rx_head = 0;
+    rx_tail = 0;
+    uart_tx_overflow = 0;
+    uart_rx_errors = 0;
+
+    TRISCbits.TRISC6 = 1;       //EUSART takes over RC6/RC7 when SPEN is set
+    TRISCbits.TRISC7 = 1;
+    SPBRGH = (unsigned char)(UART_SPBRG >> 8);
+    SPBRG = (unsigned char)UART_SPBRG;
+    BAUDCONbits.BRG16 = 1;
+    TXSTAbits.BRGH = 1;
+    TXSTAbits.SYNC = 0;         //Asynchronous
+    RCSTAbits.SPEN = 1;
+    TXSTAbits.TXEN = 1;
+    RCSTAbits.CREN = 1;
+    PIE1bits.TXIE = 0;          //Enabled only while the buffer holds data
+    PIE1bits.RCIE = 1;
+}
+
+uint8_t uart_tx_free(void){
+    return UART_TXMASK - ((tx_head - tx_tail) & UART_TXMASK);
+}
+
+uint8_t uart_write(const uint8_t *p, uint8_t len){
+    //All or nothing, so a frame is never split by an overflow
+    uint8_t n;
+
+    if(uart_tx_free() < len){
+        uart_tx_overflow += 1;
+        return 0;
+    }
+    for(n=0;n<len;n++){
+        tx_buf[tx_head] = p[n];
+        tx_head = (tx_head + 1) & UART_TXMASK;
+    }
+    PIE1bits.TXIE = 1;
+    return 1;
+}
+
+void uart_tx_isr(void){
+    if(tx_tail == tx_head){
+        PIE1bits.TXIE = 0;      //Drained, TXIF stays set while TXREG is empty
+        return;
+    }
+    TXREG = tx_buf[tx_tail];
+    tx_tail = (tx_tail + 1) & UART_TXMASK;
+}
+
+uint8_t uart_read(uint8_t *c){
+    if(rx_tail == rx_head) return 0;
+    *c = rx_buf[rx_tail];
+    rx_tail = (rx_tail + 1) & UART_RXMASK;
+    return 1;
+}
+
+void uart_rx_isr(void){
+    uint8_t c;
+
+    if(RCSTAbits.OERR){         //Overrun stops the receiver until CREN toggles
+        RCSTAbits.CREN = 0;
+        RCSTAbits.CREN = 1;
+        uart_rx_errors += 1;
+        return;
+    }
+    if(RCSTAbits.FERR){
+        c = RCREG;              //Reading RCREG clears FERR
+        uart_rx_errors += 1;
+        return;
+    }
+    c = RCREG;
+    if(((rx_head + 1) & UART_RXMASK) == rx_tail){
+        uart_rx_errors += 1;
+        return;
+    }
+    rx_buf[rx_head] = c;
+    rx_head = (rx_head + 1) & UART_RXMASK;
+}
@@ -0,0 +1,35 @@
+/*
+ * File:   uart.h
+ * Author: Administrator
+ *
+ * EUSART driver. Transmit goes through a ring buffer drained by the TXIF
+ * interrupt; writes never wait for the line, a frame that doesn't fit is
+ * dropped and counted instead. Received bytes are buffered by the RCIF
+ * interrupt and read from the main loop.
+ */
+
+#ifndef UART_H
+#define	UART_H
+
+#include <stdint.h>
+
+#ifndef UART_BAUD
+#define UART_BAUD       57600L
+#endif
+#define UART_TXSIZE     128         //Must be a power of 2, holds the frames sent at the end of a run
+#define UART_RXSIZE     16          //Must be a power of 2
+
+//BRG16 = 1, BRGH = 1: baud = Fosc / (4 * (SPBRG + 1)), rounded to nearest
+#define UART_SPBRG      ((_XTAL_FREQ + 2 * UART_BAUD) / (4 * UART_BAUD) - 1)
+
+extern uint16_t uart_tx_overflow;   //Frames dropped because the buffer was full
+extern uint16_t uart_rx_errors;     //Bytes lost to overrun, framing or a full buffer
+
+void uart_init(void);
+uint8_t uart_tx_free(void);
+uint8_t uart_write(const uint8_t *p, uint8_t len);
+void uart_tx_isr(void);
+uint8_t uart_read(uint8_t *c);
+void uart_rx_isr(void);
+
+#endif	/* UART_H */
@@ -0,0 +1,48 @@
+/*
+ * File:   watchdog.c
+ * Author: Administrator
+ *
+ * Reset cause and WDT control, see watchdog.h.
+ */
+
+#include <xc.h>
+#include <stdint.h>
+#include "configBits.h"
+#include "watchdog.h"
+
+persistent uint16_t wd_armed;
+persistent uint8_t wd_resets;
+uint8_t wd_cause;
+
+uint8_t wd_init(void){
+    //nPOR and nBOR are cleared by their reset and set again here, nRI by
+    //a RESET instruction. nTO is cleared by a WDT time out and set by
+    //CLRWDT, a WDT wake from SLEEP never gets here
+    wd_cause = RCON;
+    if(!RCONbits.nPOR || !RCONbits.nBOR){
+        wd_armed = 0;
+        wd_resets = 0;
+    }
+    RCONbits.nPOR = 1;
+    RCONbits.nBOR = 1;
+    RCONbits.nRI = 1;
+    if(RCONbits.nTO){
+        wd_armed = 0;               //MCLR or RESET, a cold start on purpose
+        return 0;
+    }
+    if(wd_resets != 255) wd_resets += 1;
+    return wd_armed == WD_ARMED;
+}
+
+void wd_start(void){
+    CLRWDT();
+    WDTCONbits.SWDTEN = 1;
+}
+
+void wd_stop(void){
+    WDTCONbits.SWDTEN = 0;
+}
+
+void wd_arm(uint8_t on){
+    wd_armed = on ? WD_ARMED : 0;
+}
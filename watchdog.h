@@ -0,0 +1,40 @@
+/*
+ * File:   watchdog.h
+ * Author: Administrator
+ *
+ * Watchdog supervision and warm restart. wd_start() turns the WDT on
+ * (SWDTEN, configBits.h leaves it to software) once start up is done and
+ * the main loop clears it every pass; waits in idle_ms() clear it as
+ * well, SLEEP does. WDT_PERIOD_MS is about twice the longest pass that
+ * does not sleep, the white card calibration, so it only runs out when
+ * something hangs: an I2C wait the bus never finishes, the bad ISR loop.
+ *
+ * What a run needs to carry on is persistent, left alone by XC8's start
+ * up code: the screen, the counts and the run's bookkeeping in main.h,
+ * the bottle in front of the sensor (det) and the servo positions that
+ * steer the bottles on their way to the chutes, the clock, the ambient
+ * baseline, the metrics and the event log's page. After a watchdog reset
+ * with a run armed, main() skips the cold start (LCD power up wait,
+ * sensor set up, RTC read, history and log init) and run_resume() picks
+ * the run up where it was. Any other reset is a cold start, which sets
+ * persistent RAM up again; after a power up or brown-out it holds
+ * nothing.
+ */
+
+#ifndef WATCHDOG_H
+#define	WATCHDOG_H
+
+#include <stdint.h>
+
+#define WD_ARMED            0x5AA5  //wd_armed while a run can be resumed
+
+extern persistent uint16_t wd_armed;
+extern persistent uint8_t wd_resets;    //Watchdog resets since power up, held at 255
+extern uint8_t wd_cause;                //RCON as start up found it
+
+uint8_t wd_init(void);              //First thing in main(), 1 = resume the run
+void wd_start(void);
+void wd_stop(void);                 //E-stop parks for good, the WDT must not undo it
+void wd_arm(uint8_t on);            //Run started or stopped
+
+#endif	/* WATCHDOG_H */
@@ -0,0 +1,60 @@
+/*
+ * File:   wb.c
+ * Author: Administrator
+ *
+ * White balance gains, see wb.h.
+ */
+
+#include <stdint.h>
+#include "eeprom.h"
+#include "wb.h"
+
+static const uint16_t wb_ref[3] = {WB_REF_R, WB_REF_G, WB_REF_B};
+
+uint16_t wb_gain[2][3];
+uint8_t wb_status;
+
+uint8_t wb_init(void){
+    uint8_t s, n;
+
+    if(eeprom_read_record(WBADDR, (uint8_t *)wb_gain, sizeof(wb_gain))){
+        wb_status = WB_OK;
+        return 1;
+    }
+    for(s=0;s<2;s++){
+        for(n=0;n<3;n++) wb_gain[s][n] = WB_ONE;
+    }
+    wb_status = WB_NONE;
+    return 0;
+}
+
+void wb_apply(uint8_t s, unsigned int *c){
+    uint8_t n;
+    uint32_t v;
+
+    for(n=0;n<3;n++){
+        v = ((uint32_t)c[n + 1] * wb_gain[s][n]) >> WB_SHIFT;
+        c[n + 1] = v > 0xFFFF ? 0xFFFF : (unsigned int)v;
+    }
+}
+
+uint8_t wb_set(uint8_t s, const uint16_t *crgb){
+    //gain = (ref share of clear) / (measured share of clear)
+    uint16_t gain[3];
+    uint32_t g;
+    uint8_t n;
+
+    if(crgb[0] < WB_MINCLEAR) return 0;
+    for(n=0;n<3;n++){
+        if(!crgb[n + 1]) return 0;
+        g = ((uint32_t)wb_ref[n] * crgb[0] << WB_SHIFT) / ((uint32_t)WB_REF_C * crgb[n + 1]);
+        if(g < WB_GAINMIN || g > WB_GAINMAX) return 0;
+        gain[n] = (uint16_t)g;
+    }
+    for(n=0;n<3;n++) wb_gain[s][n] = gain[n];
+    return 1;
+}
+
+void wb_commit(void){
+    eeprom_write_record(WBADDR, (const uint8_t *)wb_gain, sizeof(wb_gain));
+}
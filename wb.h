@@ -0,0 +1,54 @@
+/*
+ * File:   wb.h
+ * Author: Administrator
+ *
+ * White balance. Sensors and LEDs differ from unit to unit, which moves
+ * the red/blue ratios the classifier compares against its thresholds.
+ * The CALIBRATE state samples a white reference card in front of the
+ * sensor and derives a gain for red, green and blue that brings their
+ * share of the clear count to what the card reads on the unit the
+ * thresholds were tuned on (WB_REF_*). Working from shares of clear
+ * makes the gains independent of how brightly the card is lit.
+ *
+ * Gains are WB_ONE = 1.0 fixed point and are applied to every sample as
+ * one multiply and a shift per channel. Clear is left alone, it carries
+ * presence detection and the sensor's own interrupt threshold. The gains
+ * are kept in internal EEPROM; without a record they are 1.0 and the
+ * firmware starts in CALIBRATE.
+ */
+
+#ifndef WB_H
+#define	WB_H
+
+#include <stdint.h>
+
+#define WB_SHIFT            8
+#define WB_ONE              (1 << WB_SHIFT)
+#define WB_PCT(g)           ((unsigned int)(((g) * 100UL) >> WB_SHIFT))
+#define WB_GAINMIN          (WB_ONE / 4)    //Outside these the card wasn't there
+#define WB_GAINMAX          (WB_ONE * 4)
+#define WB_SAMPLES          16              //Averaged per sensor, a power of 2
+#define WB_MINCLEAR         200             //Card clear count, well above any bottle
+
+//The reference card on the tuning unit, counts at 16x gain, 2.4 ms
+#define WB_REF_C            400
+#define WB_REF_R            140
+#define WB_REF_G            150
+#define WB_REF_B            110
+
+#define WBADDR              192     //Internal EEPROM record, 1 + 2*6 bytes, after the run history
+
+//wb_status
+#define WB_NONE             0       //Never calibrated, gains are 1.0
+#define WB_OK               1
+#define WB_FAIL             2       //Last attempt saw no card, gains unchanged
+
+extern uint16_t wb_gain[2][3];      //Red, green, blue per sensor, by MUX_ channel
+extern uint8_t wb_status;
+
+uint8_t wb_init(void);              //Loads the gains, 0 if there are none
+void wb_apply(uint8_t s, unsigned int *c);
+uint8_t wb_set(uint8_t s, const uint16_t *crgb);    //Averaged card reading, 0 if rejected
+void wb_commit(void);
+
+#endif	/* WB_H */